@@ -18,17 +18,24 @@ pub fn build(b: *std.Build) void {
         .target = target,
         .optimize = optimize,
     });
+    // batch noise kernels must round exactly like the scalar versions, so don't let the compiler fuse multiply-adds
+    const c_flags = &.{"-ffp-contract=off"};
     lib.addCSourceFiles(.{ .root = b.path("src"), .files = &.{
         "htw_core_math.c",
+        "htw_core_parallel.c",
         "htw_random.c",
-    } });
+    }, .flags = c_flags });
     lib.addCSourceFiles(.{ .root = b.path("src/geomap"), .files = &.{
         "htw_geomap_chunkmap.c",
+        "htw_geomap_chunkmapFile.c",
+        "htw_geomap_compressedStore.c",
+        "htw_geomap_concurrentSpatial.c",
         "htw_geomap_generators.c",
         "htw_geomap_hexgrid.c",
         "htw_geomap_spatialStorage.c",
+        "htw_geomap_stencil.c",
         "htw_geomap_valuemap.c",
-    } });
+    }, .flags = c_flags });
     lib.addIncludePath(b.path("include"));
     lib.installHeadersDirectory(b.path("include"), "", .{});
 
@@ -23,6 +23,14 @@ typedef int64_t s64;
                     float stopwatch__seconds = (float)(stopwatch__end - stopwatch__start) / CLOCKS_PER_SEC; \
                     printf("%s finished in %.3f seconds / %li ticks\n", #x, stopwatch__seconds, stopwatch__end - stopwatch__start); }
 
+/// Same as HTW_STOPWATCH, but measures elapsed real time instead of CPU time, for timing multithreaded code
+#define HTW_STOPWATCH_WALL(x) { struct timespec stopwatch__start, stopwatch__end; \
+                    timespec_get(&stopwatch__start, TIME_UTC); \
+                    x; \
+                    timespec_get(&stopwatch__end, TIME_UTC); \
+                    double stopwatch__seconds = (stopwatch__end.tv_sec - stopwatch__start.tv_sec) + (stopwatch__end.tv_nsec - stopwatch__start.tv_nsec) / 1e9; \
+                    printf("%s finished in %.3f seconds (wall time)\n", #x, stopwatch__seconds); }
+
 static inline void htw_printArray(FILE* dest, void* data, u32 size, u32 count, u32 valuesPerLine, char* format) {
     for (int i = 0; i < count; i++) {
         void* p = (char*)data + (i * size);
@@ -104,7 +112,7 @@ static inline int htw_strToInt(const char *str) {
 /// returns the smallest multiple of alignment which is >= value
 int htw_align(int value, int alignment);
 
-/// returns the smallest power of 2 which is >= value
+/// returns the smallest power of 2 which is >= value. Values above 2^31 return 2^31, the largest power of 2 an unsigned int holds
 unsigned int htw_nextPow(unsigned int value);
 
 /// unbounded lerp
@@ -167,6 +175,30 @@ float htw_smoothstep(float edge0, float edge1, float x);
 /// Smoothstep with continuous derivative at x = edge0 and x = edge1
 float htw_smootherstep(float edge0, float edge1, float x);
 
+/* Parallel loops */
+
+/// Processes items [start, end) of a parallel loop. May be called from any thread
+typedef void (*htw_ParallelRangeFn)(void *context, u32 start, u32 end);
+
+/// Number of online processor cores, at least 1
+u32 htw_cpuCount();
+
+/**
+ * @brief Call [rangeFn] on every item in [0, count), split into contiguous ranges that are spread across worker
+ * threads. Returns once every range is finished. Ranges never overlap, but the order they run in is unspecified, so
+ * each item's result must depend only on the item itself.
+ * Workers are started the first time they're needed and then kept waiting for the next loop, so repeated loops (e.g.
+ * one per simulation tick) don't pay for starting threads. Loops can be started from several threads at once, and from
+ * inside another loop's ranges.
+ *
+ * @param count number of items
+ * @param threadCount maximum number of threads to use, including the calling thread. 0 means one per core, and 1
+ * runs everything on the calling thread
+ * @param rangeFn called once per range
+ * @param context passed to every call of rangeFn
+ */
+void htw_parallelFor(u32 count, u32 threadCount, htw_ParallelRangeFn rangeFn, void *context);
+
 /* Simple file handling utilities */
 static const int HTW_FILE_LOAD_MAX_LENGTH = 1024*1024;
 
@@ -25,6 +25,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "htw_core.h"
 
 // useful constants; based on distance between 2 adjacent hex centers == 1
@@ -103,6 +104,39 @@ typedef enum HexCorner {
     HEX_CORNER_COUNT // Limit for iterating over values in this enum
 } HexCorner;
 
+/// Location of one field inside the cells of a chunk, for generators and other code working on a single field across a
+/// whole chunkmap. See also htw_geo_getSchemaField
+typedef struct {
+    size_t offset; // bytes from the start of a chunk's cellData to the field in its first cell
+    size_t stride; // bytes from the field in one cell to the same field in the next cell
+} htw_geo_CellField;
+
+/// Field descriptor for [member] of [type], where each chunk's cellData is an array of [type]
+#define HTW_GEO_CELL_FIELD(type, member) ((htw_geo_CellField){offsetof(type, member), sizeof(type)})
+
+typedef enum {
+    HTW_GEO_LAYOUT_CELLS, // each chunk's cellData is an array of cell structs (the default)
+    HTW_GEO_LAYOUT_COLUMNS, // each chunk's cellData holds one dense array per field, for passes that only touch a few fields
+} htw_geo_CellLayout;
+
+/// Order of the cells inside a chunk's cellData, and so the meaning of a cellIndex; see htw_geo_setCellOrder
+typedef enum {
+    HTW_GEO_CELL_ORDER_ROWS, // row by row; cellIndex = x + (y * chunkSize) (the default)
+    HTW_GEO_CELL_ORDER_MORTON, // Z-order; x and y bits interleaved, x in the low bit
+    HTW_GEO_CELL_ORDER_HILBERT, // Hilbert curve; each cell is next to the one before it
+} htw_geo_CellOrder;
+
+/// One field of a cell struct, for htw_geo_setCellSchema
+typedef struct {
+    size_t offset; // position in the cell struct
+    size_t size;
+} htw_geo_SchemaField;
+
+/// Schema entry for [member] of [type]
+#define HTW_GEO_SCHEMA_FIELD(type, member) ((htw_geo_SchemaField){offsetof(type, member), sizeof(((type*)0)->member)})
+
+#define HTW_GEO_MAX_SCHEMA_FIELDS 32
+
 // Note on 'striped' vs 'chunked' layout for map tiles in memory:
 // 'striped' can be most performant for iterating over every tile in the map in order
 // 'chunked' (minecraft-like) can be most performant for operating on smaller parts of the map at a time (e.g. 3x3 cookie that moves over a local area)
@@ -117,9 +151,71 @@ typedef struct {
     u32 mapWidth, mapHeight; // total map dimensions
     u32 cellsPerChunk;
     size_t cellDataSize;
+    // When chunkSize, chunkCountX, and chunkCountY are all powers of 2, cells can be found with shifts and masks
+    // instead of divisions; see htw_geo_getCellPow2
+    u32 isPow2;
+    u32 chunkShift; // log2(chunkSize)
+    u32 chunkCountXShift; // log2(chunkCountX)
+    u32 mapWidthMask, mapHeightMask; // mapWidth - 1, mapHeight - 1
+    // When created with htw_geo_createChunkMapWithHalo, each chunk is surrounded by haloWidth cells copied from the
+    // chunks around it (see htw_geo_syncHalos), so code reading neighbors never has to leave the chunk's memory.
+    // cellData still points to the chunk's first cell, but rows are chunkPitch cells apart instead of chunkSize, and
+    // cells with x or y in [-haloWidth, 0) or [chunkSize, chunkSize + haloWidth) are valid to read
+    u32 haloWidth;
+    u32 chunkPitch; // cells from the start of one row of a chunk to the next; chunkSize + (2 * haloWidth)
     htw_Chunk *chunks;
+    struct htw_geo_ChunkResidency *residency; // NULL unless created by htw_geo_createLazyChunkMap
+    // When created with HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED, chunks holds the front buffer that every read uses, and writes
+    // go to backChunks. A chunk only has a back buffer (backChunks[i].cellData != NULL) once it has been written to
+    // since the last htw_geo_swapChunkMap; until then it has a single buffer, shared by the front and back
+    htw_Chunk *backChunks;
+    struct htw_geo_BackBuffers *backBuffers;
+    struct htw_geo_ChangeTracking *changes; // which chunks were written in which generation; see htw_geo_newChangeGeneration
+    // Set by htw_geo_setCellSchema. fields[i] locates schema field i in every chunk's cellData, for either layout
+    u32 layout; // htw_geo_CellLayout
+    u32 fieldCount; // 0 until a schema is set
+    htw_geo_CellField fields[HTW_GEO_MAX_SCHEMA_FIELDS];
+    u32 cellOrder; // htw_geo_CellOrder, set by htw_geo_setCellOrder
+    // When created with HTW_GEO_CHUNKMAP_SLAB, every chunk's cellData is in this one allocation, in chunk index order,
+    // so the whole map can be copied, written to a file, or uploaded (e.g. with htw_writeBuffer) in one operation.
+    // Chunk i's cellData is at slab + (i * chunkStride), plus the size of its top halo rows and left halo column if it
+    // has a halo. NULL for other maps
+    void *slab;
+    size_t slabSize; // bytes from the start of the slab to the end of the last chunk
+    size_t chunkStride; // bytes from one chunk's cellData to the next; more than cellsPerChunk * cellDataSize when padded for alignment
+    void *fileMapping; // when opened by htw_geo_openChunkMap: the mapped file, which contains the slab. NULL for other maps
+    size_t fileMappingSize;
 } htw_ChunkMap;
 
+typedef enum {
+    HTW_GEO_CHUNKMAP_SLAB = 1 << 0, // allocate all cell data in a single zeroed slab instead of once per chunk
+    HTW_GEO_CHUNKMAP_CACHE_ALIGNED = 1 << 1, // implies SLAB; each chunk starts on a cache line (HTW_GEO_CACHE_LINE_SIZE)
+    HTW_GEO_CHUNKMAP_HUGE_PAGES = 1 << 2, // implies SLAB; align the slab to 2MB and ask for transparent huge pages (MADV_HUGEPAGE), to cut TLB misses on large maps
+    HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED = 1 << 3, // reads see the state before the last htw_geo_swapChunkMap, writes go to the next state. Chunks are allocated one at a time, so this can't be combined with the slab flags
+} htw_geo_ChunkMapFlags;
+
+#define HTW_GEO_CACHE_LINE_SIZE 64
+
+#define HTW_GEO_CHUNKMAP_FILE_VERSION 3
+// Alignment of the chunks in a chunkmap file; the page size on most systems
+#define HTW_GEO_CHUNKMAP_FILE_ALIGNMENT 4096
+
+/// Fills the (zeroed) cellData of a chunk that is being created for the first time
+typedef void (*htw_geo_ChunkGenerateFn)(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData);
+/// Copies a previously stored chunk into cellData. Returns 0 if there is no stored copy of the chunk
+typedef int (*htw_geo_ChunkLoadFn)(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData);
+/// Keeps a copy of a modified chunk that is being evicted, to be loaded again later
+typedef void (*htw_geo_ChunkStoreFn)(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, const void *cellData);
+
+/// Where the chunks of a lazy chunkmap come from, and where they go when evicted. Any callback may be NULL
+typedef struct {
+    htw_geo_ChunkGenerateFn generate;
+    htw_geo_ChunkLoadFn load;
+    htw_geo_ChunkStoreFn store;
+    void *context; // passed to every callback
+    int storeGenerated; // if nonzero, generated chunks are stored when evicted even if never written, so they are loaded instead of generated again
+} htw_geo_ChunkSource;
+
 typedef struct {
     uint32_t width;
     uint32_t height;
@@ -127,22 +223,393 @@ typedef struct {
     int32_t *values;
 } htw_ValueMap;
 
+// Links and hash slots refer to items by index + 1, so that 0 (and zeroed memory) means no item
 typedef struct htw_Link {
-    struct htw_Link *next;
+    u32 next; // the next item in the same hash slot
+    // what refers to this link: HTW_GEO_SPATIAL_SLOT_REF | its hash slot if it's first, otherwise the previous item.
+    // Lets an item be removed without finding its slot again. 0 if the item isn't in the storage
+    u32 prev;
+    htw_geo_GridCoord coord; // where the item was inserted; items at other coordinates can share a hash slot
 } htw_Link;
 
+// Hash slots, and the strip counts for the items linked into them
 typedef struct {
-    size_t maxItemCount;
-    size_t hashSlotCount;
-    u32 hashBitMask;
-    htw_Link *links;
-    htw_Link **hashSlots;
+    u32 *slots; // the first item in each slot
+    u32 slotMask; // slot count - 1
+    // Coarse occupancy for range queries: number of items in each strip of cells along a row, hashed like slots.
+    // Strips that hash together share a count, so a nonzero count means a strip may have items, and zero means it has none
+    u32 *stripCounts;
+    u32 stripMask;
+} htw_SpatialTable;
+
+typedef struct {
+    size_t maxItemCount; // one past the largest item index the links have room for; grows to fit the largest inserted
+    size_t itemCount;
+    // Links in segments of HTW_GEO_SPATIAL_LINK_SEGMENT_SIZE, so growing never moves the links already there, and a
+    // large item index only allocates its own segment. Segments no item has been inserted into are NULL
+    htw_Link **linkSegments;
+    size_t segmentCapacity; // number of entries in linkSegments
+    htw_SpatialTable table;
+    // While the table is growing, the previous one, half the size. Its slots below migratedSlots have been moved to
+    // [table], and the rest are still in use. slots is NULL the rest of the time
+    htw_SpatialTable oldTable;
+    u32 migratedSlots;
 } htw_SpatialStorage;
 
 // Allocates a map and enough space for all map elements
 htw_ChunkMap *htw_geo_createChunkMap(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize);
+/// Same as htw_geo_createChunkMap, with a combination of htw_geo_ChunkMapFlags to control how cell data is allocated.
+/// Returns NULL if the flags can't be combined
+htw_ChunkMap *htw_geo_createChunkMapWithFlags(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize, u32 flags);
+/**
+ * @brief Same as htw_geo_createChunkMapWithFlags, but each chunk is surrounded by a halo of copies of the cells around
+ * it, [haloWidth] cells wide, for stencils and other code that reads neighbors. Halos start zeroed; call
+ * htw_geo_syncHalos after writing cells to update them. See htw_ChunkMap.haloWidth for the memory layout
+ *
+ * @param haloWidth at most chunkSize; 0 gives the same map as htw_geo_createChunkMapWithFlags
+ * @return the map, or NULL if [haloWidth] is too wide or [flags] can't be combined
+ */
+htw_ChunkMap *htw_geo_createChunkMapWithHalo(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize, u32 flags, u32 haloWidth);
+/**
+ * @brief Allocates a map with no chunks in memory. A chunk is created the first time it is read (if [source] can load
+ * or generate it) or written, and can be evicted again with htw_geo_evictChunks, so memory use follows the chunks in
+ * use instead of the size of the map.
+ *
+ * NOTE: writes to a lazy map's cells must go through htw_geo_getCellForWrite or htw_geo_getChunkForWrite. A chunk is
+ * only passed to [source].store if it was written to through those since it was created or loaded (or was generated,
+ * with [source].storeGenerated), so writes through htw_geo_getCell or htw_geo_getChunk are lost on eviction. Reading a
+ * chunk that doesn't exist, when [source] can neither load nor generate it, returns shared read-only zeroed cells, and
+ * writing to those faults.
+ * NOTE: reading and writing chunks, including creating them, is safe from several threads at once, even though the
+ * read accessors take a const map. [source] callbacks are called with a lock held, so they never run at the same time
+ * and need no locking of their own. htw_geo_evictChunks is not thread safe
+ *
+ * @param source callbacks for creating and evicting chunks
+ * @return the map, or NULL if the zeroed cells for [source] couldn't be mapped
+ */
+htw_ChunkMap *htw_geo_createLazyChunkMap(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize, htw_geo_ChunkSource source);
+/**
+ * @brief Writes a chunkmap to a file that htw_geo_openChunkMap can map straight back into memory.
+ *
+ * The file starts with a versioned header recording the map's dimensions, cellDataSize, cell schema, and cell order,
+ * followed by every chunk's cellData in chunk index order, each starting on a HTW_GEO_CHUNKMAP_FILE_ALIGNMENT boundary.
+ * Values are written in the byte order of the machine writing them. Chunks of a lazy map that aren't in memory are
+ * loaded or generated first. Halos aren't saved, so the opened map has none
+ *
+ * @return 0 on success, -1 if the file couldn't be written
+ */
+int htw_geo_saveChunkMap(const htw_ChunkMap *chunkMap, const char *path);
+/**
+ * @brief Maps a file written by htw_geo_saveChunkMap into memory, without reading it. Each chunk's cellData points into
+ * the mapping, so a chunk costs nothing until it is touched, and the file's chunks form the map's slab. The map gets
+ * the cell schema and cell order it was saved with.
+ *
+ * @param writeBack if nonzero, changes to cells are written back to the file. Otherwise they stay in memory, and the
+ * file is never modified
+ * @return the map, or NULL if the file can't be opened or isn't a valid chunkmap file
+ */
+htw_ChunkMap *htw_geo_openChunkMap(const char *path, int writeBack);
+/* Compressed chunk storage */
+typedef enum {
+    HTW_GEO_CODEC_RAW, // values copied as they are
+    HTW_GEO_CODEC_RLE, // runs of equal values
+    HTW_GEO_CODEC_BITPACK, // offset from the smallest value, packed into as few bits as the largest offset needs
+    HTW_GEO_CODEC_DELTA, // difference from the previous value, bitpacked; for smooth values like elevation
+    HTW_GEO_CODEC_COUNT
+} htw_geo_ChunkCodec;
+
+typedef struct {
+    size_t rawBytes;
+    size_t compressedBytes;
+    double compressionRatio; // rawBytes / compressedBytes
+    double lastDecodeSeconds; // time taken by the most recent decompression of this chunk; 0 if never decompressed
+    u32 decodeCount;
+    u32 columnsByCodec[HTW_GEO_CODEC_COUNT]; // how many of the chunk's columns use each codec
+} htw_geo_CompressedChunkStats;
+
+typedef struct htw_geo_CompressedChunkStore htw_geo_CompressedChunkStore;
+
+/**
+ * @brief In-memory backing store for a lazy chunkmap, that keeps evicted chunks compressed.
+ *
+ * Each chunk is split into columns, one per 4 byte word of a cell (or 2 or 1 byte word, if cellDataSize isn't a
+ * multiple of 4), so each field of a cell struct is compressed separately. Every column is encoded with whichever
+ * htw_geo_ChunkCodec makes it smallest. Chunks are compressed when evicted with htw_geo_evictChunks, and decompressed
+ * when next accessed through htw_geo_getCell or any other chunk access.
+ *
+ * @param chunkCount number of chunks in the map this will back
+ * @param cellsPerChunk
+ * @param cellDataSize
+ */
+htw_geo_CompressedChunkStore *htw_geo_createCompressedChunkStore(u32 chunkCount, u32 cellsPerChunk, size_t cellDataSize);
+void htw_geo_destroyCompressedChunkStore(htw_geo_CompressedChunkStore *store);
+/**
+ * @brief Source to pass to htw_geo_createLazyChunkMap, backed by [store]. Generated chunks are compressed on eviction
+ * too, so they are only generated once
+ *
+ * @param generate NULL, or called for chunks the store doesn't have yet
+ * @param generateContext passed to [generate]
+ */
+htw_geo_ChunkSource htw_geo_getCompressedChunkSource(htw_geo_CompressedChunkStore *store, htw_geo_ChunkGenerateFn generate, void *generateContext);
+/// Fills [stats] for one chunk. Returns 0 if the store has no copy of the chunk
+int htw_geo_getCompressedChunkStats(const htw_geo_CompressedChunkStore *store, u32 chunkIndex, htw_geo_CompressedChunkStats *stats);
+/// Same as htw_geo_getCompressedChunkStats, summed over every chunk in the store; lastDecodeSeconds is the mean
+void htw_geo_getCompressedStoreStats(const htw_geo_CompressedChunkStore *store, htw_geo_CompressedChunkStats *stats);
+
+/// Frees a map created by any of the htw_geo_create*ChunkMap functions, or opened by htw_geo_openChunkMap. Lazy map chunks are not stored first
+void htw_geo_destroyChunkMap(htw_ChunkMap *chunkMap);
+/// Sets a map's dimensions and the fields derived from them, for code that builds an htw_ChunkMap itself. Allocates nothing
+void htw_geo_setChunkMapDimensions(htw_ChunkMap *chunkMap, u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize);
+/// Allocates change tracking for a map with its dimensions set, for code that builds an htw_ChunkMap itself. Once per
+/// map; freed by htw_geo_destroyChunkMap. Maps without it record no changes
+void htw_geo_initChangeTracking(htw_ChunkMap *chunkMap);
 // NOTE: no out of bounds access possible through these methods, coordinates always wrap based on map size
 void *htw_geo_getCell(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord);
+/**
+ * @brief Same as htw_geo_getCell, but creates the chunk if needed, and marks it as modified on lazy maps. On double
+ * buffered maps, returns the cell in the back buffer, which starts as a copy of the front buffer's chunk the first time
+ * the chunk is written to after a swap
+ */
+void *htw_geo_getCellForWrite(htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord);
+/// cellData of a chunk, for reading. See htw_geo_getCell. Rows are chunkPitch cells apart. On lazy maps this records
+/// the chunk's use and may create it, despite the const map; see htw_geo_createLazyChunkMap
+void *htw_geo_getChunk(const htw_ChunkMap *chunkMap, u32 chunkIndex);
+/// cellData of a chunk, for writing. See htw_geo_getCellForWrite. Safe to call from several threads, on any map
+void *htw_geo_getChunkForWrite(htw_ChunkMap *chunkMap, u32 chunkIndex);
+/**
+ * @brief Declares the fields of a map's cells, so they can be found by index with htw_geo_getSchemaField and the other
+ * field accessors below, whichever layout the map uses.
+ *
+ * With HTW_GEO_LAYOUT_COLUMNS, each chunk's cellData is split into one dense array per field, so a pass over one field
+ * reads only that field's memory. Columns are placed from the most to the least aligned field, and together take no
+ * more than cellsPerChunk * cellDataSize bytes, so chunks are allocated, stored, copied, and saved the same as before.
+ * Cells are no longer contiguous, so htw_geo_getCell and stencil cell pointers only point into the first column; use
+ * the field accessors instead. Existing cell data isn't rearranged, so set the schema before writing cells. Maps opened
+ * with htw_geo_openChunkMap already have the schema they were saved with, and only accept the same one again (or any
+ * HTW_GEO_LAYOUT_CELLS schema, if they were saved without one).
+ *
+ * @param fields one entry per field of the cell struct, e.g. HTW_GEO_SCHEMA_FIELD(MyCell, elevation)
+ * @param fieldCount at most HTW_GEO_MAX_SCHEMA_FIELDS
+ * @param layout htw_geo_CellLayout
+ * @return 0 on success, -1 if there are too many fields, a field doesn't fit in cellDataSize, the map has halos
+ * and [layout] is HTW_GEO_LAYOUT_COLUMNS, or the map was opened from a file saved with a different schema
+ */
+int htw_geo_setCellSchema(htw_ChunkMap *chunkMap, const htw_geo_SchemaField *fields, u32 fieldCount, htw_geo_CellLayout layout);
+/**
+ * @brief Sets the order cells are stored in inside each chunk. Cells that are close on the map are close in memory in
+ * Morton and Hilbert order, in both directions, so small area and radius queries touch fewer cache lines than in rows.
+ *
+ * cellIndex is always a cell's position in its chunk's cellData, so htw_geo_gridCoordinateToChunkAndCellIndex,
+ * htw_geo_chunkAndCellToGridCoordinates, htw_geo_getCell, the fills, stencils, and schema accessors all follow the
+ * order, and code walking a chunk by cellIndex visits it in that order. Code that assumes rows (e.g. the typed
+ * name_getChunkRow, or indexing a chunk by x + (y * chunkSize) itself) only works with HTW_GEO_CELL_ORDER_ROWS.
+ * Existing cell data isn't rearranged, so set the order before writing cells. The order is saved with
+ * htw_geo_saveChunkMap, and maps opened with htw_geo_openChunkMap keep the order they were saved with.
+ *
+ * @param cellOrder htw_geo_CellOrder
+ * @return 0 on success, -1 if the order needs a chunk size that is a power of 2 and isn't, the map has halos, or the
+ * map was opened from a file saved with a different order
+ */
+int htw_geo_setCellOrder(htw_ChunkMap *chunkMap, htw_geo_CellOrder cellOrder);
+/// cellIndex of the cell at [cellX], [cellY] inside a chunk, in the map's cell order. Both must be less than chunkSize
+u32 htw_geo_cellCoordToCellIndex(const htw_ChunkMap *chunkMap, u32 cellX, u32 cellY);
+/// Position inside a chunk of the cell at [cellIndex], in the map's cell order; the inverse of htw_geo_cellCoordToCellIndex
+htw_geo_GridCoord htw_geo_cellIndexToCellCoord(const htw_ChunkMap *chunkMap, u32 cellIndex);
+/// Where schema field [fieldIndex] is in each chunk's cellData, for the chunkmap fills and other code working on one field
+static inline htw_geo_CellField htw_geo_getSchemaField(const htw_ChunkMap *chunkMap, u32 fieldIndex) {
+    return chunkMap->fields[fieldIndex];
+}
+/// Field [fieldIndex] of a cell, for reading; the field's equivalent of htw_geo_getCell
+void *htw_geo_getCellValue(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord, u32 fieldIndex);
+/// Field [fieldIndex] of a cell, for writing; the field's equivalent of htw_geo_getCellForWrite
+void *htw_geo_getCellValueForWrite(htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord, u32 fieldIndex);
+/**
+ * @brief First value of field [fieldIndex] in a chunk, for reading. On maps with HTW_GEO_LAYOUT_COLUMNS the chunk's
+ * values follow it as a dense array in cellIndex order; otherwise they are cellDataSize bytes apart
+ */
+void *htw_geo_getChunkColumn(const htw_ChunkMap *chunkMap, u32 chunkIndex, u32 fieldIndex);
+/// Same as htw_geo_getChunkColumn, for writing. See htw_geo_getChunkForWrite
+void *htw_geo_getChunkColumnForWrite(htw_ChunkMap *chunkMap, u32 chunkIndex, u32 fieldIndex);
+/// htw_geo_getChunkColumn cast to an array of [type]
+#define HTW_GEO_CHUNK_COLUMN(type, chunkMap, chunkIndex, fieldIndex) ((const type*)htw_geo_getChunkColumn(chunkMap, chunkIndex, fieldIndex))
+/// htw_geo_getChunkColumnForWrite cast to an array of [type]
+#define HTW_GEO_CHUNK_COLUMN_FOR_WRITE(type, chunkMap, chunkIndex, fieldIndex) ((type*)htw_geo_getChunkColumnForWrite(chunkMap, chunkIndex, fieldIndex))
+/**
+ * @brief Makes everything written to a double buffered map since the last swap visible to reads. Each chunk that was
+ * written to trades its front buffer for its back buffer; no cell data is copied, and chunks that weren't written to
+ * are untouched. Cell pointers from before the swap must not be used after it. Does nothing on other maps
+ *
+ * @return number of chunks that were written to, and swapped
+ */
+u32 htw_geo_swapChunkMap(htw_ChunkMap *chunkMap);
+/**
+ * @brief Wraps a grid coordinate and splits it into its chunk, and its position in that chunk's cellData in cells, with
+ * shifts and masks. Only for maps where isPow2 is set
+ *
+ * @param chunkShift the map's chunkShift; passing a constant lets the compiler fold it into the shifts
+ */
+static inline void htw_geo_splitGridCoordPow2(const htw_ChunkMap *chunkMap, u32 chunkShift, htw_geo_GridCoord cellCoord, u32 *chunkIndex, u32 *cellPosition) {
+    // masking the two's complement bits wraps negative coordinates too
+    u32 x = (u32)cellCoord.x & chunkMap->mapWidthMask;
+    u32 y = (u32)cellCoord.y & chunkMap->mapHeightMask;
+    u32 cellMask = (1U << chunkShift) - 1;
+    *chunkIndex = ((y >> chunkShift) << chunkMap->chunkCountXShift) | (x >> chunkShift);
+    if (chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) {
+        // maps with another order never have halos
+        *cellPosition = htw_geo_cellCoordToCellIndex(chunkMap, x & cellMask, y & cellMask);
+        return;
+    }
+    // chunkPitch is chunkSize unless the map has halos
+    *cellPosition = ((y & cellMask) * chunkMap->chunkPitch) + (x & cellMask);
+}
+/**
+ * @brief Same as htw_geo_getCell, but inline, and wraps and splits coordinates with shifts and masks. Only for maps
+ * where isPow2 is set (chunk size and chunk counts that are all powers of 2)
+ */
+static inline void *htw_geo_getCellPow2(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord) {
+    u32 chunkIndex, cellPosition;
+    htw_geo_splitGridCoordPow2(chunkMap, chunkMap->chunkShift, cellCoord, &chunkIndex, &cellPosition);
+    if (chunkMap->residency != NULL) {
+        // lazy maps track chunk use and create chunks on access
+        return (u8*)htw_geo_getChunk(chunkMap, chunkIndex) + (cellPosition * chunkMap->cellDataSize);
+    }
+    return (u8*)chunkMap->chunks[chunkIndex].cellData + (cellPosition * chunkMap->cellDataSize);
+}
+/// Bytes from a chunk's cellData to the cell at [cellIndex]; cellIndex * cellDataSize, unless the map has halos
+static inline size_t htw_geo_getCellOffset(const htw_ChunkMap *chunkMap, u32 cellIndex) {
+    if (chunkMap->haloWidth == 0) {
+        return cellIndex * chunkMap->cellDataSize;
+    }
+    u32 x = cellIndex % chunkMap->chunkSize;
+    u32 y = cellIndex / chunkMap->chunkSize;
+    return ((size_t)y * chunkMap->chunkPitch + x) * chunkMap->cellDataSize;
+}
+/// 1 if the chunk's cellData is in memory. Always 1 for maps that aren't lazy
+int htw_geo_isChunkResident(const htw_ChunkMap *chunkMap, u32 chunkIndex);
+/**
+ * @brief Evicts the least recently used chunks of a lazy map, until at most [maxResidentChunks] are left in memory.
+ * Modified chunks are passed to the map's store callback first. Call it at a point where no cell pointers are held,
+ * e.g. once per frame. Does nothing on maps that aren't lazy
+ *
+ * @return number of chunks evicted
+ */
+u32 htw_geo_evictChunks(htw_ChunkMap *chunkMap, u32 maxResidentChunks);
+
+/* Change tracking */
+/*
+ * Every chunk records the generation it was last written in, so that uploading, saving, or regenerating a map can
+ * follow what changed instead of the whole map. Writes are seen when they go through htw_geo_getChunkForWrite,
+ * htw_geo_getCellForWrite, the chunkmap fills, or a stencil pass; writes through pointers from htw_geo_getCell or
+ * htw_geo_getChunk aren't. Recording a write is thread safe.
+ *
+ * Each consumer keeps the generation it last caught up to, starting from 0:
+ * htw_geo_ChangedChunkIterator iter;
+ * htw_geo_beginChangedChunks(&iter, chunkMap, uploadedGeneration);
+ * while (htw_geo_nextChangedChunk(&iter, &chunkIndex)) { ... upload chunkIndex ... }
+ * uploadedGeneration = htw_geo_newChangeGeneration(chunkMap);
+ */
+typedef struct {
+    const htw_ChunkMap *chunkMap;
+    u32 sinceGeneration;
+    u32 position;
+    int scanning; // 0 while reading the current generation's list of changed chunks, 1 while checking every chunk
+} htw_geo_ChangedChunkIterator;
+
+/**
+ * @brief Ends the current generation of changes. Call it once every consumer that needs this generation's changes has
+ * been through them, and before any more writes
+ *
+ * @return the generation that just ended; chunks written from now on are changed since it
+ */
+u32 htw_geo_newChangeGeneration(htw_ChunkMap *chunkMap);
+/// Generation a chunk was last written in; 0 if it was never written to
+u32 htw_geo_getChunkGeneration(const htw_ChunkMap *chunkMap, u32 chunkIndex);
+/**
+ * @brief Starts a walk over the chunks written to after [sinceGeneration] ended, in no particular order. Costs as much
+ * as the number of changed chunks when [sinceGeneration] is the most recent value of htw_geo_newChangeGeneration, and
+ * as much as the number of chunks otherwise
+ */
+void htw_geo_beginChangedChunks(htw_geo_ChangedChunkIterator *iter, const htw_ChunkMap *chunkMap, u32 sinceGeneration);
+/// Sets [chunkIndex] to the next changed chunk. Returns 0 once there are no more
+int htw_geo_nextChangedChunk(htw_geo_ChangedChunkIterator *iter, u32 *chunkIndex);
+
+/* Neighborhood stencils */
+/**
+ * @brief Walks the cells of one chunk in cellIndex order, along with each cell's 6 neighbors. Inside the chunk the
+ * neighbors are found with constant pointer offsets; only cells on the chunk's outer ring look into the neighboring
+ * chunks, which are found once when the walk starts. On maps with halos, every neighbor is read from the chunk's own
+ * memory, so halos must be up to date; see htw_geo_syncHalos. On maps with a Morton or Hilbert cell order, every
+ * neighbor is found by its position instead, since neighbors aren't a constant distance apart
+ *
+ * Usage:
+ * htw_geo_StencilIterator iter;
+ * htw_geo_beginChunkStencil(&iter, chunkMap, chunkIndex);
+ * while (htw_geo_nextStencilCell(&iter)) { ... iter.cell, iter.neighbors[HEX_DIRECTION_EAST] ... }
+ *
+ * Write a cell's new value through htw_geo_getStencilWriteCell, which opens the chunk for writing the first time it is
+ * called, so walks that only read never copy a chunk into its back buffer or record it as changed
+ */
+typedef struct {
+    void *cell;
+    void *neighbors[HEX_DIRECTION_COUNT]; // indexed by HexDirection; same cells as POSITION_IN_DIRECTION + htw_geo_getCell
+    htw_geo_GridCoord coord; // grid coordinate of cell
+    u32 chunkIndex;
+    u32 cellIndex;
+    // internal
+    const htw_ChunkMap *chunkMap;
+    u8 *chunkData[3][3]; // cellData of this chunk ([1][1]) and the chunks around it, indexed by [chunk offset y + 1][chunk offset x + 1]
+    htw_ChunkMap *writeMap; // the map, for opening the chunk for writing; NULL during htw_geo_forEachCellStencilRead
+    u8 *writeData; // cellData that htw_geo_getStencilWriteCell points into; NULL until the chunk is opened for writing
+    size_t cellOffset; // bytes from the chunk's cellData to cell
+    ptrdiff_t neighborOffsets[HEX_DIRECTION_COUNT]; // bytes from a cell to each neighbor in the same chunk
+    u32 edgeWidth; // width of the outer ring of cells with neighbors in other chunks; 0 on maps with halos
+    u32 x, y; // position of cell inside the chunk
+} htw_geo_StencilIterator;
+
+/// Called once per cell by htw_geo_forEachCellStencil
+typedef void (*htw_geo_StencilKernel)(void *context, const htw_geo_StencilIterator *stencil);
+
+/// internal; opens the chunk of a stencil walk for writing. See htw_geo_getStencilWriteCell
+u8 *htw_geo_openStencilWriteData(const htw_geo_StencilIterator *iter);
+/**
+ * @brief Where a new value for the stencil's cell goes: the same cell in the back buffer on double buffered maps,
+ * otherwise cell. The first call for a chunk opens it with htw_geo_getChunkForWrite, so only chunks that are written
+ * get a back buffer and are recorded as changed
+ */
+static inline void *htw_geo_getStencilWriteCell(const htw_geo_StencilIterator *iter) {
+    u8 *writeData = iter->writeData != NULL ? iter->writeData : htw_geo_openStencilWriteData(iter);
+    return writeData == NULL ? NULL : writeData + iter->cellOffset;
+}
+
+/**
+ * @brief Starts a walk over the cells of a chunk. The chunk and the chunks around it are opened for reading, so walks
+ * over different chunks can run on different threads, on any map
+ */
+void htw_geo_beginChunkStencil(htw_geo_StencilIterator *iter, htw_ChunkMap *chunkMap, u32 chunkIndex);
+/// Moves to the next cell of the chunk. Returns 0 once every cell has been visited
+int htw_geo_nextStencilCell(htw_geo_StencilIterator *iter);
+/**
+ * @brief Runs [kernel] for every cell of the map, with chunks split across threads. The order cells are visited in is
+ * not defined, so a kernel that reads neighbors must not write a field that its neighbors' kernels read; write to
+ * another field or another map instead. On a double buffered map, a kernel can write anything to
+ * htw_geo_getStencilWriteCell, since neighbors are read from the front buffer. Only chunks whose kernels call
+ * htw_geo_getStencilWriteCell are opened for writing, and so recorded as changed
+ *
+ * @param threadCount 1 to run on the calling thread, or 0 to use every core
+ */
+void htw_geo_forEachCellStencil(htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_StencilKernel kernel, void *context);
+/// Same as htw_geo_forEachCellStencil, for kernels that only read, e.g. to gather statistics into [context].
+/// htw_geo_getStencilWriteCell returns NULL during this pass
+void htw_geo_forEachCellStencilRead(const htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_StencilKernel kernel, void *context);
+/**
+ * @brief Copies the edge rows, columns, and corners of each chunk in [dirtyChunks] into the halos of the chunks around
+ * it, wrapping around the map the same way htw_geo_getCell does. Afterwards, a halo cell holds the same value as the
+ * cell htw_geo_getCell returns for its grid coordinate. Does nothing on maps without halos.
+ * Stencils on maps with halos read every neighbor from the halo, so sync after writing and before the next pass
+ *
+ * @param dirtyChunks chunks written to since the last sync; NULL syncs every chunk, and [dirtyChunkCount] is ignored
+ */
+void htw_geo_syncHalos(htw_ChunkMap *chunkMap, const u32 *dirtyChunks, u32 dirtyChunkCount);
 u32 htw_geo_getChunkIndexByChunkCoordinates(const htw_ChunkMap *chunkMap, htw_geo_GridCoord chunkCoord);
 u32 htw_geo_getChunkIndexByGridCoordinates(const htw_ChunkMap *chunkMap, htw_geo_GridCoord gridCoord);
 u32 htw_geo_getChunkIndexAtOffset(const htw_ChunkMap *chunkMap, u32 startingChunk, htw_geo_GridCoord chunkOffset);
@@ -156,6 +623,122 @@ htw_geo_GridCoord htw_geo_addGridCoordsWrapped(const htw_ChunkMap *chunkMap, htw
 htw_geo_GridCoord htw_geo_wrapVectorOnChunkMap(const htw_ChunkMap *chunkMap, htw_geo_GridCoord vec);
 u32 htw_geo_getChunkMapHexDistance(const htw_ChunkMap *chunkMap, htw_geo_GridCoord a, htw_geo_GridCoord b);
 float htw_geo_hexCartesianDistance(const htw_ChunkMap *chunkMap, htw_geo_GridCoord a, htw_geo_GridCoord b);
+/// Receives cells [startX] to [endX] of row [y], for htw_geo_forEachHexAreaSpan
+typedef void (*htw_geo_RowSpanFn)(void *context, s32 y, s32 startX, s32 endX);
+/**
+ * @brief Calls [spanFn] with every cell within [radius] hexes of [center], a run of cells along a row at a time, ordered
+ * by row, then by position in the row
+ *
+ * @param wrapMap if not NULL, the area wraps around the edges of this map, and runs are split where they cross an edge.
+ * [radius] must be less than half the map's width and height, or some cells will be visited twice
+ * @param ringOnly only visit cells exactly [radius] hexes from [center]
+ */
+void htw_geo_forEachHexAreaSpan(const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, int ringOnly, htw_geo_RowSpanFn spanFn, void *context);
+
+/* Typed chunkmaps */
+/*
+ * HTW_CHUNKMAP_DEFINE(name, cell_t) defines inline functions, prefixed with name_, for maps whose cells are a cell_t.
+ * They take the same htw_ChunkMap as the void * functions above, so typed code and generic code can share a map, but
+ * index cell_t arrays directly: sizeof(cell_t) is known at compile time, and cell access can be inlined and vectorized.
+ * On maps where isPow2 is set, name_getCell and name_getCellForWrite find cells with shifts and masks.
+ * HTW_CHUNKMAP_DEFINE_POW2(name, cell_t, chunkSizeLog2) also makes the chunk size a constant, so loops over a chunk's
+ * rows have a fixed length; its functions must only be used on maps made by its name_create.
+ * Neither is for maps with HTW_GEO_LAYOUT_COLUMNS, where a cell's fields aren't next to each other
+ *
+ * Usage:
+ * HTW_CHUNKMAP_DEFINE(Terrain, TerrainCell)
+ * htw_ChunkMap *chunkMap = Terrain_create(64, 16, 16, 0);
+ * Terrain_getCellForWrite(chunkMap, cellCoord)->elevation = 3;
+ *
+ * Defined functions:
+ * name_create: htw_geo_createChunkMapWithFlags with cellDataSize sizeof(cell_t). The POW2 version takes no chunk size,
+ * and returns NULL if the chunk counts aren't powers of 2
+ * name_getCell, name_getCellForWrite, name_getChunk, name_getChunkForWrite: typed htw_geo_getCell etc.
+ * name_getChunkRow: row [y] of a chunk's cells; chunkSize cells, contiguous even on maps with halos. Only for maps with
+ * HTW_GEO_CELL_ORDER_ROWS
+ * name_fill: sets every cell in the listed chunks (NULL for every chunk) to a value
+ * name_forEachCell: calls a name_CellFn, which can be inlined, for every cell in the listed chunks, with its grid
+ * coordinate. Chunks are opened for writing, so the cells can be changed
+ */
+#define HTW_CHUNKMAP_DEFINE(name, cell_t) \
+    static inline htw_ChunkMap *name##_create(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, u32 flags) { \
+        return htw_geo_createChunkMapWithFlags(chunkSize, chunkCountX, chunkCountY, sizeof(cell_t), flags); \
+    } \
+    HTW_CHUNKMAP_DEFINE_ACCESSORS(name, cell_t, chunkMap->isPow2, chunkMap->chunkShift, chunkMap->chunkSize)
+
+#define HTW_CHUNKMAP_DEFINE_POW2(name, cell_t, chunkSizeLog2) \
+    static inline htw_ChunkMap *name##_create(u32 chunkCountX, u32 chunkCountY, u32 flags) { \
+        if (!IS_POW_OF_2(chunkCountX) || !IS_POW_OF_2(chunkCountY)) { \
+            fprintf(stderr, #name " chunk counts must be powers of 2, got %u x %u\n", chunkCountX, chunkCountY); \
+            return NULL; \
+        } \
+        return htw_geo_createChunkMapWithFlags(1U << (chunkSizeLog2), chunkCountX, chunkCountY, sizeof(cell_t), flags); \
+    } \
+    HTW_CHUNKMAP_DEFINE_ACCESSORS(name, cell_t, 1, (chunkSizeLog2), (1U << (chunkSizeLog2)))
+
+/// internal; [isPow2], [chunkShift], and [chunkSize] are expressions of the htw_ChunkMap *chunkMap parameter, or constants
+#define HTW_CHUNKMAP_DEFINE_ACCESSORS(name, cell_t, isPow2, chunkShift, chunkSize) \
+    typedef void (*name##_CellFn)(void *context, cell_t *cell, htw_geo_GridCoord cellCoord); \
+    static inline cell_t *name##_getChunk(const htw_ChunkMap *chunkMap, u32 chunkIndex) { \
+        if (chunkMap->residency != NULL) { \
+            return htw_geo_getChunk(chunkMap, chunkIndex); \
+        } \
+        return chunkMap->chunks[chunkIndex].cellData; \
+    } \
+    static inline cell_t *name##_getChunkForWrite(htw_ChunkMap *chunkMap, u32 chunkIndex) { \
+        return htw_geo_getChunkForWrite(chunkMap, chunkIndex); \
+    } \
+    static inline cell_t *name##_getCell(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord) { \
+        if (!(isPow2)) { \
+            return htw_geo_getCell(chunkMap, cellCoord); \
+        } \
+        u32 chunkIndex, cellPosition; \
+        htw_geo_splitGridCoordPow2(chunkMap, chunkShift, cellCoord, &chunkIndex, &cellPosition); \
+        return name##_getChunk(chunkMap, chunkIndex) + cellPosition; \
+    } \
+    static inline cell_t *name##_getCellForWrite(htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord) { \
+        if (!(isPow2)) { \
+            return htw_geo_getCellForWrite(chunkMap, cellCoord); \
+        } \
+        u32 chunkIndex, cellPosition; \
+        htw_geo_splitGridCoordPow2(chunkMap, chunkShift, cellCoord, &chunkIndex, &cellPosition); \
+        return name##_getChunkForWrite(chunkMap, chunkIndex) + cellPosition; \
+    } \
+    static inline cell_t *name##_getChunkRow(const htw_ChunkMap *chunkMap, cell_t *chunkCells, u32 y) { \
+        return chunkCells + ((size_t)y * chunkMap->chunkPitch); \
+    } \
+    static inline void name##_fill(htw_ChunkMap *chunkMap, const u32 *chunkIndices, u32 chunkIndexCount, cell_t value) { \
+        u32 count = chunkIndices == NULL ? chunkMap->chunkCountX * chunkMap->chunkCountY : chunkIndexCount; \
+        for (u32 c = 0; c < count; c++) { \
+            cell_t *chunkCells = name##_getChunkForWrite(chunkMap, chunkIndices == NULL ? c : chunkIndices[c]); \
+            for (u32 y = 0; y < (chunkSize); y++) { \
+                cell_t *row = name##_getChunkRow(chunkMap, chunkCells, y); \
+                for (u32 x = 0; x < (chunkSize); x++) { \
+                    row[x] = value; \
+                } \
+            } \
+        } \
+    } \
+    static inline void name##_forEachCell(htw_ChunkMap *chunkMap, const u32 *chunkIndices, u32 chunkIndexCount, name##_CellFn fn, void *context) { \
+        u32 count = chunkIndices == NULL ? chunkMap->chunkCountX * chunkMap->chunkCountY : chunkIndexCount; \
+        for (u32 c = 0; c < count; c++) { \
+            u32 chunkIndex = chunkIndices == NULL ? c : chunkIndices[c]; \
+            cell_t *chunkCells = name##_getChunkForWrite(chunkMap, chunkIndex); \
+            if (chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) { \
+                for (u32 i = 0; i < chunkMap->cellsPerChunk; i++) { \
+                    fn(context, &chunkCells[i], htw_geo_chunkAndCellToGridCoordinates(chunkMap, chunkIndex, i)); \
+                } \
+                continue; \
+            } \
+            htw_geo_GridCoord chunkRoot = htw_geo_chunkAndCellToGridCoordinates(chunkMap, chunkIndex, 0); \
+            for (u32 y = 0; y < (chunkSize); y++) { \
+                cell_t *row = name##_getChunkRow(chunkMap, chunkCells, y); \
+                for (u32 x = 0; x < (chunkSize); x++) { \
+                    fn(context, &row[x], (htw_geo_GridCoord){chunkRoot.x + (s32)x, chunkRoot.y + (s32)y}); \
+                } \
+            } \
+        } \
+    }
 
 htw_ValueMap *htw_geo_createValueMap(u32 width, u32 height, s32 maxValue);
 s32 htw_geo_getMapValueByIndex(htw_ValueMap *map, u32 cellIndex);
@@ -210,12 +793,100 @@ u32 htw_geo_getHexArea(u32 edgeLength);
 void htw_geo_getNextHexSpiralCoord(htw_geo_CubeCoord *iterCoord);
 
 /* Spatial Hashmaps */
+/*
+ * Usage, to visit every item at a coordinate:
+ * for (size_t i = htw_geo_spatialFirstIndex(ss, coord); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) { ... }
+ */
+/// Returned by htw_geo_spatialFirstIndex and htw_geo_spatialNextIndex when there are no more items
+#define HTW_GEO_SPATIAL_NO_ITEM ((size_t)-1)
+/// Set in htw_Link.prev when it refers to a hash slot rather than another item
+#define HTW_GEO_SPATIAL_SLOT_REF 0x80000000u
+/// Largest item index a spatial storage can hold
+#define HTW_GEO_SPATIAL_MAX_ITEM_INDEX (HTW_GEO_SPATIAL_SLOT_REF - 2)
+/// log2 of the number of links in each of a spatial storage's link segments
+#define HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT 12
+#define HTW_GEO_SPATIAL_LINK_SEGMENT_SIZE (1u << HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT)
+/**
+ * @brief Creates a storage sized for [maxItemCount] items. It still grows past that: larger item indices get a new
+ * segment of links, without moving the others, and the hash table doubles whenever it gets more than half full. The
+ * old table's slots are then moved over a few at a time by each insert, move, and remove, so no single call has to
+ * rehash everything or copy every link
+ */
 htw_SpatialStorage *htw_geo_createSpatialStorage(size_t maxItemCount);
+void htw_geo_destroySpatialStorage(htw_SpatialStorage *ss);
+/// Amortized constant time; each item can only be at one coordinate at a time, so inserting an item that is already in
+/// the storage moves it
 void htw_geo_spatialInsert(htw_SpatialStorage *ss, htw_geo_GridCoord coord, size_t itemIndex);
+/// Constant time; [coord] isn't needed, since each item records its own. Does nothing if the item isn't in the storage
 void htw_geo_spatialRemove(htw_SpatialStorage *ss, htw_geo_GridCoord coord, size_t itemIndex);
+/// Constant time; only [newCoord] is hashed, unless the table is growing. Same as an insert if the item isn't in the storage
 void htw_geo_spatialMove(htw_SpatialStorage *ss, htw_geo_GridCoord oldCoord, htw_geo_GridCoord newCoord, size_t itemIndex);
+/// One entry for htw_geo_spatialMoveMany
+typedef struct {
+    size_t itemIndex;
+    htw_geo_GridCoord newCoord;
+} htw_geo_SpatialMove;
+/**
+ * @brief Same as htw_geo_spatialMove for each of [moves], but ordered by destination hash slot, so that a large batch
+ * (e.g. every unit that moved this tick) writes to the slot array in one pass instead of at random
+ *
+ * @param moves each item may appear at most once
+ */
+void htw_geo_spatialMoveMany(htw_SpatialStorage *ss, const htw_geo_SpatialMove *moves, size_t moveCount);
+/// Number of items at exactly [coord]
 size_t htw_geo_spatialItemCountAt(htw_SpatialStorage *ss, htw_geo_GridCoord coord);
+/// Most recently inserted item at [coord], or HTW_GEO_SPATIAL_NO_ITEM if there is nothing there
 size_t htw_geo_spatialFirstIndex(htw_SpatialStorage *ss, htw_geo_GridCoord coord);
+/// Next item at the same coordinate as [previousIndex], or HTW_GEO_SPATIAL_NO_ITEM after the last one
+size_t htw_geo_spatialNextIndex(htw_SpatialStorage *ss, size_t previousIndex);
+/**
+ * @brief Finds every item within [radius] hexes of [center], i.e. at a distance (htw_geo_hexGridDistance) of at most
+ * [radius]. Each row of the area is checked a strip of cells at a time, and strips with no items are skipped without
+ * looking up their cells, so sparse areas cost much less than hashing every cell in them.
+ *
+ * @param wrapMap if not NULL, the area wraps around the edges of this map, the same as htw_geo_getCell, and distances are
+ * htw_geo_getChunkMapHexDistance. Items must have been inserted at wrapped coordinates (htw_geo_wrapGridCoordOnChunkMap),
+ * and [radius] must be less than half the map's width and height, or some items will be found twice
+ * @param outIndices receives up to [maxIndices] item indices, ordered by row, then by position in the row
+ * @return number of items found, which can be more than [maxIndices]
+ */
+size_t htw_geo_spatialQueryRadius(htw_SpatialStorage *ss, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices);
+/// Same as htw_geo_spatialQueryRadius, but only finds items exactly [radius] hexes from [center]
+size_t htw_geo_spatialQueryRing(htw_SpatialStorage *ss, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices);
+
+/* Concurrent spatial hashmaps */
+/*
+ * Spatial storage that one thread can change while any number of others read it, e.g. a movement thread updating unit
+ * positions while AI threads look for nearby units. Reads take no locks: each hash slot has a sequence number that is odd
+ * while the writer changes the slot, and a reader reads a cell again if its slot's number changed while reading it.
+ * Readers never hold up the writer, and only wait for it while it is changing the slot they are reading.
+ *
+ * Each cell is read as it was at one moment, but range queries read one cell after another, so an item that moves
+ * during a query may be found at both coordinates, or at neither.
+ * The capacity is fixed, since growing would free memory that readers could still be reading.
+ * Functions marked writer only must all be called from the same thread, or otherwise never at the same time.
+ */
+typedef struct htw_ConcurrentSpatialStorage htw_ConcurrentSpatialStorage;
+htw_ConcurrentSpatialStorage *htw_geo_createConcurrentSpatialStorage(size_t maxItemCount);
+/// No other thread may be using the storage
+void htw_geo_destroyConcurrentSpatialStorage(htw_ConcurrentSpatialStorage *cs);
+/// Writer only; same as htw_geo_spatialInsert, but [itemIndex] must be less than the storage's maxItemCount
+void htw_geo_concurrentSpatialInsert(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord, size_t itemIndex);
+/// Writer only; same as htw_geo_spatialRemove
+void htw_geo_concurrentSpatialRemove(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord, size_t itemIndex);
+/// Writer only; same as htw_geo_spatialMove
+void htw_geo_concurrentSpatialMove(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord oldCoord, htw_geo_GridCoord newCoord, size_t itemIndex);
+/**
+ * @brief Any thread; finds every item at [coord], most recently inserted first
+ *
+ * @param outIndices receives up to [maxIndices] item indices
+ * @return number of items found, which can be more than [maxIndices]
+ */
+size_t htw_geo_concurrentSpatialItemsAt(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord, size_t *outIndices, size_t maxIndices);
+/// Any thread; same as htw_geo_spatialQueryRadius
+size_t htw_geo_concurrentSpatialQueryRadius(htw_ConcurrentSpatialStorage *cs, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices);
+/// Any thread; same as htw_geo_spatialQueryRing
+size_t htw_geo_concurrentSpatialQueryRing(htw_ConcurrentSpatialStorage *cs, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices);
 
 /* Map generation */
 /* For filling entire valueMaps: */
@@ -227,9 +898,30 @@ void htw_geo_fillNoise(htw_ValueMap* map, u32 seed);
 void htw_geo_fillSmoothNoise(htw_ValueMap* map, u32 seed, float scale);
 void htw_geo_fillPerlin(htw_ValueMap* map, u32 seed, u32 octaves, s32 posX, s32 posY, float scale, float repeatX, float repeatY);
 void htw_geo_fillSimplex(htw_ValueMap* map, u32 seed, u32 octaves, s32 posX, s32 posY, u32 repeatInterval, u32 samplesPerRepeat);
+/*
+ * Same as the fills above, with rows split across [threadCount] threads: 1 to fill on the calling thread, or 0 to use
+ * every core. Every cell only depends on its own coordinates, so results don't depend on the thread count
+ */
+void htw_geo_fillCircularGradientParallel(htw_ValueMap* map, u32 threadCount, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius);
+void htw_geo_fillNoiseParallel(htw_ValueMap* map, u32 threadCount, u32 seed);
+void htw_geo_fillSmoothNoiseParallel(htw_ValueMap* map, u32 threadCount, u32 seed, float scale);
+void htw_geo_fillPerlinParallel(htw_ValueMap* map, u32 threadCount, u32 seed, u32 octaves, s32 posX, s32 posY, float scale, float repeatX, float repeatY);
+void htw_geo_fillSimplexParallel(htw_ValueMap* map, u32 threadCount, u32 seed, u32 octaves, s32 posX, s32 posY, u32 repeatInterval, u32 samplesPerRepeat);
 
 /* For filling entire chunkMaps: */
-// TODO?
+/*
+ * Each of these writes one field of every cell in the selected chunks, walking each chunk's cellData in order. Results
+ * are the same as calling the matching single cell function below for every cell.
+ * [chunkIndices] lists the chunks to fill, e.g. chunks that just became visible; NULL fills every chunk, and
+ * [chunkIndexCount] is ignored. The Parallel versions split the chunks across [threadCount] threads, the same as the
+ * valueMap fills above
+ */
+/// Writes an s32 field; same as htw_geo_circularGradientByGridCoord
+void htw_geo_fillChunkMapCircularGradient(htw_ChunkMap *chunkMap, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius);
+void htw_geo_fillChunkMapCircularGradientParallel(htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius);
+/// Writes a float field; same as htw_geo_simplex
+void htw_geo_fillChunkMapSimplex(htw_ChunkMap *chunkMap, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, u32 seed, u32 octaves, u32 samplesPerRepeat);
+void htw_geo_fillChunkMapSimplexParallel(htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, u32 seed, u32 octaves, u32 samplesPerRepeat);
 
 /* For getting single cell values: */
 s32 htw_geo_circularGradientByGridCoord(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius);
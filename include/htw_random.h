@@ -4,35 +4,88 @@
 /**
  * @file htw_random.h
  * @brief These random number generation methods are designed for convenience and even distribution, NOT security
+ * Random values come from a xoshiro256** generator, not libc rand(), so results are the same on every platform for the same seed
  */
 
 #include "htw_core.h"
 
+/**
+ * @defgroup state Generator state
+ * Every random function has a _r variant which draws from an explicit htw_RandState, and a variant without the suffix which draws from the calling thread's default state.
+ * Explicit states make results reproducible and independent of other threads; use htw_randSplit_r to give each worker thread its own stream.
+ * @{
+ */
+
+/// xoshiro256** generator state. Treat as opaque; create with htw_randSeed_r or htw_randSplit_r
+typedef struct {
+    u64 s[4];
+} htw_RandState;
+
+/// Initialize [state] from a 64 bit seed. Any seed, including 0, is fine
+void htw_randSeed_r(htw_RandState *state, u64 seed);
+
+/// Reseed the calling thread's default state
+void htw_randSeed(u64 seed);
+
+/**
+ * @brief The calling thread's default state, used by all functions without the _r suffix
+ * Each thread's default state is seeded differently the first time it's used, unless seeded with htw_randSeed first
+ *
+ * @return pointer to thread-local state, only valid on the calling thread
+ */
+htw_RandState *htw_randDefaultState();
+
+/// Advance [state] by 2^128 steps; equivalent to that many calls to htw_rand64_r
+void htw_randJump_r(htw_RandState *state);
+
+/**
+ * @brief Split off an independent stream, e.g. for a worker thread
+ * The returned state continues from [state]'s current position, while [state] jumps ahead by 2^128 steps. Streams from repeated splits never overlap in practice
+ *
+ * @param state
+ * @return new state
+ */
+htw_RandState htw_randSplit_r(htw_RandState *state);
+
+/// Uniformly distributed 64 bits
+u64 htw_rand64_r(htw_RandState *state);
+u64 htw_rand64();
+
+/** @}*/
+
 /**
  * @defgroup basics Basics
+ * Integer results are unbiased for any range, using Lemire's multiply-shift method rather than a modulo
  * @{
  */
 
 /// Random int in [0, max] (inclusive)
 int htw_randInt(int max);
+int htw_randInt_r(htw_RandState *state, int max);
 
 /// Random int in [0, size) (up to but not including size)
 int htw_randIndex(int size);
+int htw_randIndex_r(htw_RandState *state, int size);
 
 /// Random int in [min, max] (inclusive)
 int htw_randIntRange(int min, int max);
+int htw_randIntRange_r(htw_RandState *state, int min, int max);
 
 /// Random float in [0, 1]
 float htw_randValue();
+float htw_randValue_r(htw_RandState *state);
 
 /// Random float in [min, max]
 float htw_randRange(float min, float max);
+float htw_randRange_r(htw_RandState *state, float min, float max);
 
 /// Returns 0 or 1
 int htw_coinFlip();
+int htw_coinFlip_r(htw_RandState *state);
 
 /// Returns 1 with probabality p (0 to 1); otherwise returns 0
 int htw_weightedFlip(float p);
+int htw_weightedFlip_r(htw_RandState *state, float p);
 
 /** @}*/
 
@@ -44,16 +97,22 @@ int htw_weightedFlip(float p);
 /**
  * @brief Roll The Dice; get total and/or individual results for [count] dice rolls. Result for each roll will be in the range [1, sides]
  *
+ * Small dice share draws from the generator; a single draw covers up to 48 coin flips, 18 d6 or 11 d20.
+ *
  * @param count number of dice to roll
  * @param sides number of sides on each die
  * @param results NULL or a pointer to an array of at least [count] elements, to record the result of each roll
  * @return sum of all rolls
  */
 int htw_rtd(int count, int sides, int *results);
+int htw_rtd_r(htw_RandState *state, int count, int sides, int *results);
 
 float htw_randNormal(float mean, float standardDeviation);
+float htw_randNormal_r(htw_RandState *state, float mean, float standardDeviation);
 
+/// Normally distributed float, rounded to the nearest int
 int htw_randIntNormal(int mean, int standardDeviation);
+int htw_randIntNormal_r(htw_RandState *state, int mean, int standardDeviation);
 
 /**
  * @brief Random value with a Gamma probabality distribution
@@ -62,9 +121,10 @@ int htw_randIntNormal(int mean, int standardDeviation);
  *
  * @param a shape parameter, must be > 0
  * @param b scale parameter, must be > 0; typically = 1
- * @return float from 0 to RAND_MAX
+ * @return float > 0
  */
 float htw_randGamma(float a, float b);
+float htw_randGamma_r(htw_RandState *state, float a, float b);
 
 /**
  * @brief Random value with a Beta probabality distribution
@@ -75,6 +135,7 @@ float htw_randGamma(float a, float b);
  * @return float from 0 to 1
  */
 float htw_randBeta(float a, float b);
+float htw_randBeta_r(htw_RandState *state, float a, float b);
 
 /**
  * @brief Random value with a PERT probabality distribution
@@ -88,12 +149,32 @@ float htw_randBeta(float a, float b);
  * @return float from min to max
  */
 float htw_randPERT(float min, float max, float mode);
+float htw_randPERT_r(htw_RandState *state, float min, float max, float mode);
+
+/** @}*/
+
+/**
+ * @defgroup bulk Bulk sampling
+ * Fill an array with [count] values from the same distribution as the matching single value function.
+ * At least 5 times faster than calling the single value version in a loop on CPUs with AVX-512 (about 7x for normal,
+ * 5.5x for gamma and 6x for PERT values, in a release build), and about 3 times faster with AVX2, but doesn't produce
+ * the same sequence from the same state. The sequence is the same whichever vector kernels the CPU supports.
+ * @{
+ */
+
+void htw_randNormalN(htw_RandState *state, float *out, size_t count, float mean, float standardDeviation);
+
+void htw_randGammaN(htw_RandState *state, float *out, size_t count, float a, float b);
+
+void htw_randBetaN(htw_RandState *state, float *out, size_t count, float a, float b);
+
+void htw_randPERTN(htw_RandState *state, float *out, size_t count, float min, float max, float mode);
 
 /** @}*/
 
 /**
  * @defgroup hash Hash functions
- * xxHash limited implementation for procedural generation. See source file for copyright notice.
+ * xxHash implementation for procedural generation and checksums. See source file for copyright notice.
  * @{
  */
 
@@ -108,7 +189,20 @@ float htw_randPERT(float min, float max, float mode);
 u32 xxh_hash2d(u32 seed, u32 x, u32 y);
 
 /**
- * @brief Fast and well-distributed hash
+ * @brief Same as calling xxh_hash2d for 8 (x, y) pairs, with SIMD kernels when available on the running CPU
+ *
+ * @param seed optional seed
+ * @param xs array of 8 x values
+ * @param ys array of 8 y values
+ * @param out array of at least 8 elements to write hashes to
+ */
+void xxh_hash2d_x8(u32 seed, const u32 *xs, const u32 *ys, u32 *out);
+
+/// Same as xxh_hash2d_x8, for 16 (x, y) pairs
+void xxh_hash2d_x16(u32 seed, const u32 *xs, const u32 *ys, u32 *out);
+
+/**
+ * @brief Fast and well-distributed hash, same result as the reference XXH32
  * NOTE: if passing an array that isn't u8 or chars, should multiply length by sizeof(type)
  *
  * @param seed optional seed
@@ -118,6 +212,40 @@ u32 xxh_hash2d(u32 seed, u32 x, u32 y);
  */
 u32 xxh_hash(u32 seed, size_t length, const u8 *bytes);
 
+/// 64 bit version of xxh_hash, same result as the reference XXH64
+u64 xxh64_hash(u64 seed, size_t length, const u8 *bytes);
+
+/// Streaming state for xxh_hash; lets input arrive in any number of pieces. Treat fields as private
+typedef struct {
+    u64 totalLength;
+    u32 seed;
+    u32 v[4];
+    u32 bufferSize;
+    u8 buffer[16];
+} xxh_state;
+
+/// Streaming state for xxh64_hash; lets input arrive in any number of pieces. Treat fields as private
+typedef struct {
+    u64 totalLength;
+    u64 seed;
+    u64 v[4];
+    u32 bufferSize;
+    u8 buffer[32];
+} xxh64_state;
+
+/// Reset [state] to hash a new input
+void xxh_init(xxh_state *state, u32 seed);
+
+/// Add the next [length] bytes of input. The result of xxh_digest doesn't depend on how input is split between calls
+void xxh_update(xxh_state *state, size_t length, const u8 *bytes);
+
+/// Hash of all input so far; same as xxh_hash over the whole input. Doesn't modify [state], so more input can follow
+u32 xxh_digest(const xxh_state *state);
+
+void xxh64_init(xxh64_state *state, u64 seed);
+void xxh64_update(xxh64_state *state, size_t length, const u8 *bytes);
+u64 xxh64_digest(const xxh64_state *state);
+
 /** @}*/
 
 /**
@@ -147,6 +275,24 @@ float htw_simplex2d(u32 seed, float sampleX, float sampleY, u32 repeatX, u32 rep
 
 float htw_simplex2dLayered(u32 seed, float sampleX, float sampleY, u32 repeat, u32 layers);
 
+/**
+ * @brief Same as calling htw_perlin2d for each sample, with results that match bit for bit. Uses SIMD kernels (AVX2, SSE4.1, or NEON) when available on the running CPU
+ *
+ * @param xs array of [count] sample x coordinates
+ * @param ys array of [count] sample y coordinates
+ * @param out array of at least [count] elements to write results to
+ */
+void htw_perlin2dBatch(u32 seed, const float *xs, const float *ys, float *out, size_t count, u32 octaves);
+
+/**
+ * @brief Same as calling htw_simplex2dLayered for each sample, with results that match bit for bit. Uses SIMD kernels (AVX2, SSE4.1, or NEON) when available on the running CPU
+ *
+ * @param xs array of [count] sample x coordinates
+ * @param ys array of [count] sample y coordinates
+ * @param out array of at least [count] elements to write results to
+ */
+void htw_simplex2dLayeredBatch(u32 seed, const float *xs, const float *ys, float *out, size_t count, u32 repeat, u32 layers);
+
 /** @}*/
 
 #endif // HTW_RANDOM_H_INCLUDED
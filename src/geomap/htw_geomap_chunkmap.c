@@ -2,31 +2,721 @@
  * Advantage of not using custom type macros: source files working with chunkmaps don't need to know what kind of data they contain, if all it cares about is relative position or passing a celldata reference to something else
  */
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 #include "htw_geomap.h"
 #include "htw_core.h"
 
+// Bookkeeping for lazy chunkmaps. Chunks are read from several threads at once, so use is recorded with atomics, and
+// chunks are created with [lock] held
+typedef struct htw_geo_ChunkResidency {
+    htw_geo_ChunkSource source;
+    pthread_mutex_t lock; // held while creating a chunk, so a chunk is only created once, and callbacks never overlap
+    // advances on every chunk access, to order chunks by last use. Not a read-modify-write, since the order only has
+    // to be roughly right, and concurrent readers shouldn't fight over it
+    _Atomic u64 useClock;
+    _Atomic u64 *lastUse; // per chunk
+    _Atomic u8 *modified; // per chunk; written since it was created or loaded
+    u32 residentCount; // changed with [lock] held, or by htw_geo_evictChunks
+    // read-only zeroed page(s), shared by every chunk that has only been read, when the source can neither load nor
+    // generate one. Writing a cell of it without going through a ForWrite accessor faults instead of changing them all
+    void *zeroChunk;
+} htw_geo_ChunkResidency;
+
+// Bookkeeping for double buffered chunkmaps
+typedef struct htw_geo_BackBuffers {
+    pthread_mutex_t lock; // held while giving a chunk its back buffer, so chunks can be opened for writing from any thread
+    u32 *writtenChunks; // chunks that have a back buffer, i.e. were written to since the last swap
+    u32 writtenCount;
+    void **spares; // front buffers retired by swaps (as cellData pointers), reused as back buffers instead of allocating
+    u32 spareCount;
+} htw_geo_BackBuffers;
+
+// Per chunk write generations, for every chunkmap
+typedef struct htw_geo_ChangeTracking {
+    u32 generation; // current; starts at 1, so chunks that were never written (generation 0) aren't changed since anything
+    _Atomic u32 *chunkGenerations; // per chunk; generation it was last written in
+    u32 *changedChunks; // chunks first written in the current generation, so recent changes can be found without a scan
+    _Atomic u32 changedCount;
+} htw_geo_ChangeTracking;
+
+#define HTW_GEO_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+void htw_geo_setChunkMapDimensions(htw_ChunkMap *chunkMap, u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize) {
+    chunkMap->chunkSize = chunkSize;
+    chunkMap->chunkCountX = chunkCountX;
+    chunkMap->chunkCountY = chunkCountY;
+    chunkMap->mapWidth = chunkSize * chunkCountX;
+    chunkMap->mapHeight = chunkSize * chunkCountY;
+    chunkMap->cellsPerChunk = chunkSize * chunkSize;
+    chunkMap->cellDataSize = cellDataSize;
+    chunkMap->haloWidth = 0;
+    chunkMap->chunkPitch = chunkSize;
+
+    chunkMap->isPow2 = IS_POW_OF_2(chunkSize) && IS_POW_OF_2(chunkCountX) && IS_POW_OF_2(chunkCountY);
+    if (chunkMap->isPow2) {
+        chunkMap->chunkShift = __builtin_ctz(chunkSize);
+        chunkMap->chunkCountXShift = __builtin_ctz(chunkCountX);
+        chunkMap->mapWidthMask = chunkMap->mapWidth - 1;
+        chunkMap->mapHeightMask = chunkMap->mapHeight - 1;
+    }
+}
+
+void htw_geo_initChangeTracking(htw_ChunkMap *chunkMap) {
+    u32 chunkCount = chunkMap->chunkCountX * chunkMap->chunkCountY;
+    htw_geo_ChangeTracking *changes = calloc(1, sizeof(htw_geo_ChangeTracking));
+    changes->generation = 1;
+    changes->chunkGenerations = calloc(chunkCount, sizeof(_Atomic u32));
+    changes->changedChunks = malloc(sizeof(u32) * chunkCount);
+    chunkMap->changes = changes;
+}
+
 htw_ChunkMap *htw_geo_createChunkMap(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize) {
+    return htw_geo_createChunkMapWithFlags(chunkSize, chunkCountX, chunkCountY, cellDataSize, 0);
+}
+
+/// internal; bytes from the start of a chunk's allocation to its cellData, past the top halo rows and left halo column
+static size_t haloOffset(const htw_ChunkMap *chunkMap) {
+    return (((size_t)chunkMap->haloWidth * chunkMap->chunkPitch) + chunkMap->haloWidth) * chunkMap->cellDataSize;
+}
+
+/// internal; zeroed memory from the OS, aligned to [alignment] (a multiple of the page size). Free with freeSlab
+static void *allocSlab(size_t size, size_t alignment, int hugePages) {
+    size_t mappedSize = size + alignment;
+    u8 *mapped = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %zu bytes for chunkmap slab\n", size);
+        return NULL;
+    }
+    // trim the mapping down to exactly [size] bytes starting at an aligned address
+    u8 *slab = (u8*)(((uintptr_t)mapped + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    size_t head = slab - mapped;
+    if (head > 0) munmap(mapped, head);
+    size_t tail = mappedSize - head - size;
+    if (tail > 0) munmap(slab + size, tail);
+
+#ifdef MADV_HUGEPAGE
+    if (hugePages) {
+        // only a hint; without transparent huge page support this quietly has no effect
+        madvise(slab, size, MADV_HUGEPAGE);
+    }
+#endif
+    return slab;
+}
+
+/// internal
+static void freeSlab(void *slab, size_t size) {
+    munmap(slab, size);
+}
+
+/// internal; size of a chunkmap's slab mapping; slabSize rounded up to whole pages
+static size_t slabMappedSize(const htw_ChunkMap *chunkMap) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    return (chunkMap->slabSize + pageSize - 1) & ~(pageSize - 1);
+}
+
+htw_ChunkMap *htw_geo_createChunkMapWithFlags(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize, u32 flags) {
+    return htw_geo_createChunkMapWithHalo(chunkSize, chunkCountX, chunkCountY, cellDataSize, flags, 0);
+}
+
+htw_ChunkMap *htw_geo_createChunkMapWithHalo(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize, u32 flags, u32 haloWidth) {
+    // wider halos would reach past the chunks around it, and htw_geo_syncHalos only copies from those
+    if (haloWidth > chunkSize) {
+        fprintf(stderr, "Halo width %u is wider than chunk size %u\n", haloWidth, chunkSize);
+        return NULL;
+    }
+    // after a few swaps, the front buffer is a mix of chunks from everywhere, so a slab wouldn't stay contiguous
+    if ((flags & HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED) && (flags & (HTW_GEO_CHUNKMAP_SLAB | HTW_GEO_CHUNKMAP_CACHE_ALIGNED | HTW_GEO_CHUNKMAP_HUGE_PAGES))) {
+        fprintf(stderr, "Double buffered chunkmaps can't use a slab\n");
+        return NULL;
+    }
     htw_ChunkMap *newWorldMap = calloc(1, sizeof(htw_ChunkMap));
-    newWorldMap->chunkSize = chunkSize;
-    newWorldMap->chunkCountX = chunkCountX;
-    newWorldMap->chunkCountY = chunkCountY;
-    newWorldMap->mapWidth = chunkSize * chunkCountX;
-    newWorldMap->mapHeight = chunkSize * chunkCountY;
-    newWorldMap->cellsPerChunk = chunkSize * chunkSize;
-    newWorldMap->cellDataSize = cellDataSize;
+    htw_geo_setChunkMapDimensions(newWorldMap, chunkSize, chunkCountX, chunkCountY, cellDataSize);
+    htw_geo_initChangeTracking(newWorldMap);
+    newWorldMap->haloWidth = haloWidth;
+    newWorldMap->chunkPitch = chunkSize + (2 * haloWidth);
     newWorldMap->chunks = calloc(chunkCountX * chunkCountY, sizeof(htw_Chunk));
 
-    for (int i = 0; i < chunkCountX * chunkCountY; i++) {
-        newWorldMap->chunks[i].cellData = calloc(chunkSize * chunkSize, cellDataSize);
+    if (flags & HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED) {
+        newWorldMap->backChunks = calloc(chunkCountX * chunkCountY, sizeof(htw_Chunk));
+        htw_geo_BackBuffers *backBuffers = calloc(1, sizeof(htw_geo_BackBuffers));
+        pthread_mutex_init(&backBuffers->lock, NULL);
+        backBuffers->writtenChunks = malloc(sizeof(u32) * chunkCountX * chunkCountY);
+        backBuffers->spares = malloc(sizeof(void*) * chunkCountX * chunkCountY);
+        newWorldMap->backBuffers = backBuffers;
+    }
+
+    u32 pitch = newWorldMap->chunkPitch;
+    size_t chunkBytes = (size_t)pitch * pitch * cellDataSize;
+    newWorldMap->chunkStride = chunkBytes;
+    if (flags & (HTW_GEO_CHUNKMAP_SLAB | HTW_GEO_CHUNKMAP_CACHE_ALIGNED | HTW_GEO_CHUNKMAP_HUGE_PAGES)) {
+        if (flags & HTW_GEO_CHUNKMAP_CACHE_ALIGNED) {
+            newWorldMap->chunkStride = (chunkBytes + HTW_GEO_CACHE_LINE_SIZE - 1) & ~(size_t)(HTW_GEO_CACHE_LINE_SIZE - 1);
+        }
+        newWorldMap->slabSize = newWorldMap->chunkStride * chunkCountX * chunkCountY;
+        int hugePages = (flags & HTW_GEO_CHUNKMAP_HUGE_PAGES) != 0;
+        size_t alignment = hugePages ? HTW_GEO_HUGE_PAGE_SIZE : sysconf(_SC_PAGESIZE);
+        newWorldMap->slab = allocSlab(slabMappedSize(newWorldMap), alignment, hugePages);
+    }
+
+    if (newWorldMap->slab != NULL) {
+        for (int i = 0; i < chunkCountX * chunkCountY; i++) {
+            newWorldMap->chunks[i].cellData = (u8*)newWorldMap->slab + (i * newWorldMap->chunkStride) + haloOffset(newWorldMap);
+        }
+    }
+    else {
+        // also the fallback if the slab couldn't be mapped
+        newWorldMap->slabSize = 0;
+        newWorldMap->chunkStride = chunkBytes;
+        for (int i = 0; i < chunkCountX * chunkCountY; i++) {
+            newWorldMap->chunks[i].cellData = (u8*)calloc(pitch * pitch, cellDataSize) + haloOffset(newWorldMap);
+        }
+    }
+
+    return newWorldMap;
+}
+
+/// internal; size of a lazy map's zero chunk mapping; one chunk rounded up to whole pages
+static size_t zeroChunkMappedSize(const htw_ChunkMap *chunkMap) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    return (chunkMap->chunkStride + pageSize - 1) & ~(pageSize - 1);
+}
+
+htw_ChunkMap *htw_geo_createLazyChunkMap(u32 chunkSize, u32 chunkCountX, u32 chunkCountY, size_t cellDataSize, htw_geo_ChunkSource source) {
+    htw_ChunkMap *newWorldMap = calloc(1, sizeof(htw_ChunkMap));
+    htw_geo_setChunkMapDimensions(newWorldMap, chunkSize, chunkCountX, chunkCountY, cellDataSize);
+    htw_geo_initChangeTracking(newWorldMap);
+    newWorldMap->chunkStride = (size_t)chunkSize * chunkSize * cellDataSize;
+    // every cellData starts NULL
+    newWorldMap->chunks = calloc(chunkCountX * chunkCountY, sizeof(htw_Chunk));
+
+    htw_geo_ChunkResidency *residency = calloc(1, sizeof(htw_geo_ChunkResidency));
+    residency->source = source;
+    pthread_mutex_init(&residency->lock, NULL);
+    residency->lastUse = calloc(chunkCountX * chunkCountY, sizeof(_Atomic u64));
+    residency->modified = calloc(chunkCountX * chunkCountY, sizeof(_Atomic u8));
+    newWorldMap->residency = residency;
+
+    if (source.load == NULL && source.generate == NULL) {
+        // made up front, so readers never race to create it; untouched pages cost nothing
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        residency->zeroChunk = allocSlab(zeroChunkMappedSize(newWorldMap), pageSize, 0);
+        if (residency->zeroChunk == NULL || mprotect(residency->zeroChunk, zeroChunkMappedSize(newWorldMap), PROT_READ) != 0) {
+            fprintf(stderr, "Failed to map read-only zero chunk for lazy chunkmap\n");
+            htw_geo_destroyChunkMap(newWorldMap);
+            return NULL;
+        }
     }
 
     return newWorldMap;
 }
 
+void htw_geo_destroyChunkMap(htw_ChunkMap *chunkMap) {
+    if (chunkMap->fileMapping != NULL) {
+        munmap(chunkMap->fileMapping, chunkMap->fileMappingSize);
+    }
+    else if (chunkMap->slab != NULL) {
+        freeSlab(chunkMap->slab, slabMappedSize(chunkMap));
+    }
+    else {
+        for (u32 i = 0; i < chunkMap->chunkCountX * chunkMap->chunkCountY; i++) {
+            if (chunkMap->chunks[i].cellData != NULL) {
+                free((u8*)chunkMap->chunks[i].cellData - haloOffset(chunkMap));
+            }
+        }
+    }
+    if (chunkMap->backBuffers != NULL) {
+        htw_geo_BackBuffers *backBuffers = chunkMap->backBuffers;
+        for (u32 i = 0; i < backBuffers->writtenCount; i++) {
+            free((u8*)chunkMap->backChunks[backBuffers->writtenChunks[i]].cellData - haloOffset(chunkMap));
+        }
+        for (u32 i = 0; i < backBuffers->spareCount; i++) {
+            free((u8*)backBuffers->spares[i] - haloOffset(chunkMap));
+        }
+        free(backBuffers->writtenChunks);
+        free(backBuffers->spares);
+        pthread_mutex_destroy(&backBuffers->lock);
+        free(backBuffers);
+        free(chunkMap->backChunks);
+    }
+    if (chunkMap->changes != NULL) {
+        free((void*)chunkMap->changes->chunkGenerations);
+        free(chunkMap->changes->changedChunks);
+        free(chunkMap->changes);
+    }
+    if (chunkMap->residency != NULL) {
+        free((void*)chunkMap->residency->lastUse);
+        free((void*)chunkMap->residency->modified);
+        if (chunkMap->residency->zeroChunk != NULL) {
+            freeSlab(chunkMap->residency->zeroChunk, zeroChunkMappedSize(chunkMap));
+        }
+        pthread_mutex_destroy(&chunkMap->residency->lock);
+        free(chunkMap->residency);
+    }
+    free(chunkMap->chunks);
+    free(chunkMap);
+}
+
+/// internal; brings a lazy map's chunk into memory. If [forWrite] is 0 and the chunk can't be loaded or generated, it
+/// isn't created, and NULL is returned. Safe to call from several threads; if another thread creates the chunk first,
+/// returns that thread's cellData
+static void *materializeChunk(const htw_ChunkMap *chunkMap, u32 chunkIndex, int forWrite) {
+    htw_geo_ChunkResidency *residency = chunkMap->residency;
+    htw_geo_ChunkSource *source = &residency->source;
+    if (!forWrite && source->load == NULL && source->generate == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&residency->lock);
+    void *cellData = chunkMap->chunks[chunkIndex].cellData;
+    if (cellData == NULL) {
+        cellData = calloc(chunkMap->cellsPerChunk, chunkMap->cellDataSize);
+        int loaded = source->load != NULL && source->load(source->context, chunkMap, chunkIndex, cellData);
+        if (!loaded && source->generate != NULL) {
+            source->generate(source->context, chunkMap, chunkIndex, cellData);
+        }
+        atomic_store_explicit(&residency->modified[chunkIndex], !loaded && source->storeGenerated, memory_order_relaxed);
+        residency->residentCount++;
+        // release, so threads that find the pointer without taking the lock also see the chunk's contents
+        __atomic_store_n(&chunkMap->chunks[chunkIndex].cellData, cellData, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&residency->lock);
+    return cellData;
+}
+
+/// internal; cellData of a lazy map's chunk, or NULL if it isn't in memory. Pairs with the release in materializeChunk
+static inline void *residentCellData(const htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    return __atomic_load_n(&chunkMap->chunks[chunkIndex].cellData, __ATOMIC_ACQUIRE);
+}
+
+/// internal
+static inline void recordChunkUse(htw_geo_ChunkResidency *residency, u32 chunkIndex) {
+    u64 now = atomic_load_explicit(&residency->useClock, memory_order_relaxed) + 1;
+    atomic_store_explicit(&residency->useClock, now, memory_order_relaxed);
+    atomic_store_explicit(&residency->lastUse[chunkIndex], now, memory_order_relaxed);
+}
+
+void *htw_geo_getChunk(const htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    htw_geo_ChunkResidency *residency = chunkMap->residency;
+    if (residency == NULL) {
+        return chunkMap->chunks[chunkIndex].cellData;
+    }
+
+    recordChunkUse(residency, chunkIndex);
+    void *cellData = residentCellData(chunkMap, chunkIndex);
+    if (cellData == NULL) {
+        cellData = materializeChunk(chunkMap, chunkIndex, 0);
+        if (cellData == NULL) {
+            cellData = residency->zeroChunk;
+        }
+    }
+    return cellData;
+}
+
+/// internal; back buffer of a double buffered map's chunk, copied from the front buffer if it doesn't have one yet.
+/// Safe to call from several threads
+static void *openBackBuffer(htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    // pairs with the release below, so a thread that finds the buffer also sees the copy
+    void *backData = __atomic_load_n(&chunkMap->backChunks[chunkIndex].cellData, __ATOMIC_ACQUIRE);
+    if (backData != NULL) {
+        return backData;
+    }
+    htw_geo_BackBuffers *backBuffers = chunkMap->backBuffers;
+    pthread_mutex_lock(&backBuffers->lock);
+    backData = chunkMap->backChunks[chunkIndex].cellData;
+    if (backData == NULL) {
+        size_t offset = haloOffset(chunkMap);
+        size_t chunkBytes = (size_t)chunkMap->chunkPitch * chunkMap->chunkPitch * chunkMap->cellDataSize;
+        if (backBuffers->spareCount > 0) {
+            backData = backBuffers->spares[--backBuffers->spareCount];
+        }
+        else {
+            backData = (u8*)malloc(chunkBytes) + offset;
+        }
+        // writes may only touch part of the chunk, so the rest has to match the front; halos are copied too
+        memcpy((u8*)backData - offset, (u8*)chunkMap->chunks[chunkIndex].cellData - offset, chunkBytes);
+        backBuffers->writtenChunks[backBuffers->writtenCount++] = chunkIndex;
+        __atomic_store_n(&chunkMap->backChunks[chunkIndex].cellData, backData, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&backBuffers->lock);
+    return backData;
+}
+
+/// internal; records that a chunk is being written to in the current generation. May be called from several threads
+static void recordChunkWrite(htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    htw_geo_ChangeTracking *changes = chunkMap->changes;
+    if (changes == NULL) return;
+    u32 generation = changes->generation;
+    _Atomic u32 *chunkGeneration = &changes->chunkGenerations[chunkIndex];
+    // usually already recorded; the exchange makes sure only one thread adds the chunk to the list
+    if (atomic_load_explicit(chunkGeneration, memory_order_relaxed) != generation
+        && atomic_exchange_explicit(chunkGeneration, generation, memory_order_relaxed) != generation) {
+        u32 position = atomic_fetch_add_explicit(&changes->changedCount, 1, memory_order_relaxed);
+        changes->changedChunks[position] = chunkIndex;
+    }
+}
+
+void *htw_geo_getChunkForWrite(htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    recordChunkWrite(chunkMap, chunkIndex);
+    if (chunkMap->backChunks != NULL) {
+        return openBackBuffer(chunkMap, chunkIndex);
+    }
+    htw_geo_ChunkResidency *residency = chunkMap->residency;
+    if (residency == NULL) {
+        return chunkMap->chunks[chunkIndex].cellData;
+    }
+
+    recordChunkUse(residency, chunkIndex);
+    void *cellData = residentCellData(chunkMap, chunkIndex);
+    if (cellData == NULL) {
+        cellData = materializeChunk(chunkMap, chunkIndex, 1);
+    }
+    atomic_store_explicit(&residency->modified[chunkIndex], 1, memory_order_relaxed);
+    return cellData;
+}
+
+/// internal; largest power of 2, up to 16, that divides [size]; at least the alignment a field of that size needs
+static size_t fieldAlignment(size_t size) {
+    size_t alignment = 16;
+    while (size % alignment != 0) alignment /= 2;
+    return alignment;
+}
+
+/// internal; true if [fields] can replace the schema a map already has without changing where any cell data is. A map
+/// with no schema accepts any schema in its own layout
+static int isSameSchema(const htw_ChunkMap *chunkMap, const htw_geo_CellField *fields, u32 fieldCount, htw_geo_CellLayout layout) {
+    if (layout != chunkMap->layout) return 0;
+    if (chunkMap->fieldCount == 0) return 1;
+    return fieldCount == chunkMap->fieldCount && memcmp(fields, chunkMap->fields, fieldCount * sizeof(htw_geo_CellField)) == 0;
+}
+
+int htw_geo_setCellSchema(htw_ChunkMap *chunkMap, const htw_geo_SchemaField *fields, u32 fieldCount, htw_geo_CellLayout layout) {
+    if (fieldCount > HTW_GEO_MAX_SCHEMA_FIELDS) {
+        fprintf(stderr, "Cell schema has %u fields, more than the limit of %u\n", fieldCount, HTW_GEO_MAX_SCHEMA_FIELDS);
+        return -1;
+    }
+    if (layout == HTW_GEO_LAYOUT_COLUMNS && chunkMap->haloWidth > 0) {
+        fprintf(stderr, "Chunkmaps with halos can't use a column layout\n");
+        return -1;
+    }
+    size_t fieldBytes = 0;
+    for (u32 i = 0; i < fieldCount; i++) {
+        if (fields[i].offset + fields[i].size > chunkMap->cellDataSize) {
+            fprintf(stderr, "Cell schema field %u doesn't fit in a %zu byte cell\n", i, chunkMap->cellDataSize);
+            return -1;
+        }
+        fieldBytes += fields[i].size;
+    }
+    // only possible if fields overlap, which columns can't represent
+    if (layout == HTW_GEO_LAYOUT_COLUMNS && fieldBytes > chunkMap->cellDataSize) {
+        fprintf(stderr, "Cell schema fields overlap\n");
+        return -1;
+    }
+
+    htw_geo_CellField cellFields[HTW_GEO_MAX_SCHEMA_FIELDS];
+    if (layout == HTW_GEO_LAYOUT_CELLS) {
+        for (u32 i = 0; i < fieldCount; i++) {
+            cellFields[i] = (htw_geo_CellField){fields[i].offset, chunkMap->cellDataSize};
+        }
+    }
+    else {
+        // each column is a multiple of its field's alignment long, so going from most to least aligned leaves every
+        // column aligned without any padding between them
+        size_t columnOffset = 0;
+        for (size_t alignment = 16; alignment > 0; alignment /= 2) {
+            for (u32 i = 0; i < fieldCount; i++) {
+                if (fieldAlignment(fields[i].size) != alignment) continue;
+                cellFields[i] = (htw_geo_CellField){columnOffset, fields[i].size};
+                columnOffset += fields[i].size * chunkMap->cellsPerChunk;
+            }
+        }
+    }
+    // the file's cells are already laid out by the schema they were saved with
+    if (chunkMap->fileMapping != NULL && !isSameSchema(chunkMap, cellFields, fieldCount, layout)) {
+        fprintf(stderr, "Cell schema doesn't match the one the chunkmap file was saved with\n");
+        return -1;
+    }
+    memcpy(chunkMap->fields, cellFields, fieldCount * sizeof(htw_geo_CellField));
+    chunkMap->layout = layout;
+    chunkMap->fieldCount = fieldCount;
+    return 0;
+}
+
+int htw_geo_setCellOrder(htw_ChunkMap *chunkMap, htw_geo_CellOrder cellOrder) {
+    if (cellOrder != HTW_GEO_CELL_ORDER_ROWS && !IS_POW_OF_2(chunkMap->chunkSize)) {
+        fprintf(stderr, "Morton and Hilbert cell orders need a chunk size that is a power of 2, not %u\n", chunkMap->chunkSize);
+        return -1;
+    }
+    if (cellOrder != HTW_GEO_CELL_ORDER_ROWS && chunkMap->haloWidth > 0) {
+        fprintf(stderr, "Chunkmaps with halos can only store cells in rows\n");
+        return -1;
+    }
+    if (chunkMap->fileMapping != NULL && cellOrder != chunkMap->cellOrder) {
+        fprintf(stderr, "Cell order doesn't match the one the chunkmap file was saved with\n");
+        return -1;
+    }
+    chunkMap->cellOrder = cellOrder;
+    return 0;
+}
+
+// A single instruction each with BMI2. Only used when the library is built for it (e.g. -mbmi2 or -march=native); a
+// runtime check would cost about as much as the portable version
+#if defined(__BMI2__)
+/// internal; spreads the low 16 bits of [value] out to the even bits
+static u32 spreadBits(u32 value) {
+    return _pdep_u32(value, 0x55555555);
+}
+
+/// internal; inverse of spreadBits
+static u32 compactBits(u32 value) {
+    return _pext_u32(value, 0x55555555);
+}
+#else
+/// internal
+static u32 spreadBits(u32 value) {
+    value &= 0x0000ffff;
+    value = (value | (value << 8)) & 0x00ff00ff;
+    value = (value | (value << 4)) & 0x0f0f0f0f;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+/// internal
+static u32 compactBits(u32 value) {
+    value &= 0x55555555;
+    value = (value | (value >> 1)) & 0x33333333;
+    value = (value | (value >> 2)) & 0x0f0f0f0f;
+    value = (value | (value >> 4)) & 0x00ff00ff;
+    value = (value | (value >> 8)) & 0x0000ffff;
+    return value;
+}
+#endif
+
+// Hilbert curve as a state machine, one level (2 bits of cellIndex) per step. At each level the curve is the basic
+// U shape, swapped across the diagonal, flipped, or both: the state, as (swapped << 1) | flipped, starting from 0.
+// Indexed by (state << 2) | quadrant, where quadrant is (x bit << 1) | y bit, each entry is the 2 cellIndex bits for
+// that quadrant, with the next level's state above them
+static const u8 hilbertEncode[16] = {8, 1, 15, 2, 6, 11, 5, 12, 0, 7, 9, 10, 14, 13, 3, 4};
+// The inverse; indexed by (state << 2) | cellIndex bits, each entry is the quadrant, with the next state above it
+static const u8 hilbertDecode[16] = {8, 1, 3, 14, 15, 6, 4, 9, 0, 10, 11, 5, 7, 13, 12, 2};
+
+u32 htw_geo_cellCoordToCellIndex(const htw_ChunkMap *chunkMap, u32 cellX, u32 cellY) {
+    switch (chunkMap->cellOrder) {
+        case HTW_GEO_CELL_ORDER_MORTON:
+            return spreadBits(cellX) | (spreadBits(cellY) << 1);
+        case HTW_GEO_CELL_ORDER_HILBERT: {
+            u32 cellIndex = 0;
+            u32 state = 0;
+            for (u32 bit = chunkMap->chunkSize / 2; bit > 0; bit /= 2) {
+                u32 quadrant = ((cellX & bit) != 0) << 1 | ((cellY & bit) != 0);
+                u32 entry = hilbertEncode[(state << 2) | quadrant];
+                cellIndex = (cellIndex << 2) | (entry & 3);
+                state = entry >> 2;
+            }
+            return cellIndex;
+        }
+        default:
+            return cellX + (cellY * chunkMap->chunkSize);
+    }
+}
+
+htw_geo_GridCoord htw_geo_cellIndexToCellCoord(const htw_ChunkMap *chunkMap, u32 cellIndex) {
+    switch (chunkMap->cellOrder) {
+        case HTW_GEO_CELL_ORDER_MORTON:
+            return (htw_geo_GridCoord){compactBits(cellIndex), compactBits(cellIndex >> 1)};
+        case HTW_GEO_CELL_ORDER_HILBERT: {
+            u32 x = 0, y = 0;
+            u32 state = 0;
+            for (s32 shift = (s32)__builtin_ctz(chunkMap->chunkSize) - 1; shift >= 0; shift--) {
+                u32 entry = hilbertDecode[(state << 2) | ((cellIndex >> (2 * shift)) & 3)];
+                x = (x << 1) | ((entry >> 1) & 1);
+                y = (y << 1) | (entry & 1);
+                state = entry >> 2;
+            }
+            return (htw_geo_GridCoord){x, y};
+        }
+        default:
+            return (htw_geo_GridCoord){cellIndex % chunkMap->chunkSize, cellIndex / chunkMap->chunkSize};
+    }
+}
+
+/// internal; chunkIndex and cellIndex of a grid coordinate, with the shift and mask path when the map allows it
+static void splitGridCoordinate(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord, u32 *chunkIndex, u32 *cellIndex) {
+    if (!chunkMap->isPow2) {
+        htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, cellCoord, chunkIndex, cellIndex);
+        return;
+    }
+    u32 x = (u32)cellCoord.x & chunkMap->mapWidthMask;
+    u32 y = (u32)cellCoord.y & chunkMap->mapHeightMask;
+    u32 shift = chunkMap->chunkShift;
+    u32 cellMask = (1U << shift) - 1;
+    *chunkIndex = ((y >> shift) << chunkMap->chunkCountXShift) | (x >> shift);
+    if (chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) {
+        *cellIndex = htw_geo_cellCoordToCellIndex(chunkMap, x & cellMask, y & cellMask);
+        return;
+    }
+    *cellIndex = ((y & cellMask) << shift) | (x & cellMask);
+}
+
+/// internal; bytes from a chunk's cellData to field [fieldIndex] of the cell at [cellIndex]
+static size_t fieldValueOffset(const htw_ChunkMap *chunkMap, u32 cellIndex, u32 fieldIndex) {
+    htw_geo_CellField field = chunkMap->fields[fieldIndex];
+    if (chunkMap->layout == HTW_GEO_LAYOUT_COLUMNS) {
+        return field.offset + (cellIndex * field.stride);
+    }
+    return field.offset + htw_geo_getCellOffset(chunkMap, cellIndex);
+}
+
+void *htw_geo_getCellValue(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord, u32 fieldIndex) {
+    u32 chunkIndex, cellIndex;
+    splitGridCoordinate(chunkMap, cellCoord, &chunkIndex, &cellIndex);
+    return (u8*)htw_geo_getChunk(chunkMap, chunkIndex) + fieldValueOffset(chunkMap, cellIndex, fieldIndex);
+}
+
+void *htw_geo_getCellValueForWrite(htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord, u32 fieldIndex) {
+    u32 chunkIndex, cellIndex;
+    splitGridCoordinate(chunkMap, cellCoord, &chunkIndex, &cellIndex);
+    return (u8*)htw_geo_getChunkForWrite(chunkMap, chunkIndex) + fieldValueOffset(chunkMap, cellIndex, fieldIndex);
+}
+
+void *htw_geo_getChunkColumn(const htw_ChunkMap *chunkMap, u32 chunkIndex, u32 fieldIndex) {
+    return (u8*)htw_geo_getChunk(chunkMap, chunkIndex) + chunkMap->fields[fieldIndex].offset;
+}
+
+void *htw_geo_getChunkColumnForWrite(htw_ChunkMap *chunkMap, u32 chunkIndex, u32 fieldIndex) {
+    return (u8*)htw_geo_getChunkForWrite(chunkMap, chunkIndex) + chunkMap->fields[fieldIndex].offset;
+}
+
+u32 htw_geo_swapChunkMap(htw_ChunkMap *chunkMap) {
+    htw_geo_BackBuffers *backBuffers = chunkMap->backBuffers;
+    if (backBuffers == NULL) return 0;
+    for (u32 i = 0; i < backBuffers->writtenCount; i++) {
+        u32 chunkIndex = backBuffers->writtenChunks[i];
+        backBuffers->spares[backBuffers->spareCount++] = chunkMap->chunks[chunkIndex].cellData;
+        chunkMap->chunks[chunkIndex].cellData = chunkMap->backChunks[chunkIndex].cellData;
+        chunkMap->backChunks[chunkIndex].cellData = NULL;
+    }
+    u32 swapped = backBuffers->writtenCount;
+    backBuffers->writtenCount = 0;
+    return swapped;
+}
+
+u32 htw_geo_newChangeGeneration(htw_ChunkMap *chunkMap) {
+    htw_geo_ChangeTracking *changes = chunkMap->changes;
+    if (changes == NULL) return 0;
+    changes->changedCount = 0;
+    return changes->generation++;
+}
+
+u32 htw_geo_getChunkGeneration(const htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    if (chunkMap->changes == NULL) return 0;
+    return atomic_load_explicit(&chunkMap->changes->chunkGenerations[chunkIndex], memory_order_relaxed);
+}
+
+void htw_geo_beginChangedChunks(htw_geo_ChangedChunkIterator *iter, const htw_ChunkMap *chunkMap, u32 sinceGeneration) {
+    *iter = (htw_geo_ChangedChunkIterator){
+        .chunkMap = chunkMap,
+        .sinceGeneration = sinceGeneration,
+        .position = 0,
+        // every chunk changed since the end of the previous generation is in the current generation's list. Maps
+        // without change tracking have an empty list
+        .scanning = chunkMap->changes != NULL && sinceGeneration + 1 != chunkMap->changes->generation,
+    };
+}
+
+int htw_geo_nextChangedChunk(htw_geo_ChangedChunkIterator *iter, u32 *chunkIndex) {
+    const htw_geo_ChangeTracking *changes = iter->chunkMap->changes;
+    if (!iter->scanning) {
+        if (changes == NULL || iter->position >= changes->changedCount) return 0;
+        *chunkIndex = changes->changedChunks[iter->position++];
+        return 1;
+    }
+    u32 chunkCount = iter->chunkMap->chunkCountX * iter->chunkMap->chunkCountY;
+    while (iter->position < chunkCount) {
+        u32 c = iter->position++;
+        if (htw_geo_getChunkGeneration(iter->chunkMap, c) > iter->sinceGeneration) {
+            *chunkIndex = c;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int htw_geo_isChunkResident(const htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    return __atomic_load_n(&chunkMap->chunks[chunkIndex].cellData, __ATOMIC_RELAXED) != NULL;
+}
+
+typedef struct {
+    u64 lastUse;
+    u32 chunkIndex;
+} htw_geo_ChunkUse;
+
+/// internal; for sorting chunks from least to most recently used
+static int compareChunkUse(const void *a, const void *b) {
+    u64 useA = ((const htw_geo_ChunkUse*)a)->lastUse;
+    u64 useB = ((const htw_geo_ChunkUse*)b)->lastUse;
+    return (useA > useB) - (useA < useB);
+}
+
+u32 htw_geo_evictChunks(htw_ChunkMap *chunkMap, u32 maxResidentChunks) {
+    htw_geo_ChunkResidency *residency = chunkMap->residency;
+    if (residency == NULL || residency->residentCount <= maxResidentChunks) {
+        return 0;
+    }
+
+    htw_geo_ChunkUse *resident = malloc(sizeof(htw_geo_ChunkUse) * residency->residentCount);
+    u32 residentCount = 0;
+    for (u32 i = 0; i < chunkMap->chunkCountX * chunkMap->chunkCountY; i++) {
+        if (chunkMap->chunks[i].cellData != NULL) {
+            resident[residentCount++] = (htw_geo_ChunkUse){atomic_load_explicit(&residency->lastUse[i], memory_order_relaxed), i};
+        }
+    }
+    qsort(resident, residentCount, sizeof(htw_geo_ChunkUse), compareChunkUse);
+
+    u32 evictCount = residentCount - maxResidentChunks;
+    htw_geo_ChunkSource *source = &residency->source;
+    for (u32 i = 0; i < evictCount; i++) {
+        u32 chunkIndex = resident[i].chunkIndex;
+        void *cellData = chunkMap->chunks[chunkIndex].cellData;
+        // unmodified chunks can be loaded or generated again exactly as they are
+        if (atomic_load_explicit(&residency->modified[chunkIndex], memory_order_relaxed) && source->store != NULL) {
+            source->store(source->context, chunkMap, chunkIndex, cellData);
+        }
+        free(cellData);
+        chunkMap->chunks[chunkIndex].cellData = NULL;
+        atomic_store_explicit(&residency->modified[chunkIndex], 0, memory_order_relaxed);
+    }
+    residency->residentCount -= evictCount;
+
+    free(resident);
+    return evictCount;
+}
+
 void *htw_geo_getCell(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord) {
+    if (chunkMap->isPow2) {
+        return htw_geo_getCellPow2(chunkMap, cellCoord);
+    }
     u32 chunkIndex, cellIndex;
     htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, cellCoord, &chunkIndex, &cellIndex);
-    return chunkMap->chunks[chunkIndex].cellData + (cellIndex * chunkMap->cellDataSize);
+    return htw_geo_getChunk(chunkMap, chunkIndex) + htw_geo_getCellOffset(chunkMap, cellIndex);
+}
+
+void *htw_geo_getCellForWrite(htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord) {
+    if (chunkMap->isPow2) {
+        u32 chunkIndex, cellPosition;
+        htw_geo_splitGridCoordPow2(chunkMap, chunkMap->chunkShift, cellCoord, &chunkIndex, &cellPosition);
+        return htw_geo_getChunkForWrite(chunkMap, chunkIndex) + (cellPosition * chunkMap->cellDataSize);
+    }
+    u32 chunkIndex, cellIndex;
+    htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, cellCoord, &chunkIndex, &cellIndex);
+    return htw_geo_getChunkForWrite(chunkMap, chunkIndex) + htw_geo_getCellOffset(chunkMap, cellIndex);
 }
 
 u32 htw_geo_getChunkIndexByChunkCoordinates(const htw_ChunkMap *chunkMap, htw_geo_GridCoord chunkCoord) {
@@ -71,6 +761,10 @@ void htw_geo_gridCoordinateToChunkAndCellIndex(const htw_ChunkMap *chunkMap, htw
         .x = gridCoord.x - (chunkCoord.x * chunkMap->chunkSize),
         .y = gridCoord.y - (chunkCoord.y * chunkMap->chunkSize)
     };
+    if (chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) {
+        *cellIndex = htw_geo_cellCoordToCellIndex(chunkMap, cellCoord.x, cellCoord.y);
+        return;
+    }
     *cellIndex = cellCoord.x + (cellCoord.y * chunkMap->chunkSize);
 }
 
@@ -79,6 +773,11 @@ htw_geo_GridCoord htw_geo_chunkAndCellToGridCoordinates(const htw_ChunkMap *chun
     u32 chunkY = chunkIndex / chunkMap->chunkCountX;
     u32 cellX = cellIndex % chunkMap->chunkSize;
     u32 cellY = cellIndex / chunkMap->chunkSize;
+    if (chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) {
+        htw_geo_GridCoord cellCoord = htw_geo_cellIndexToCellCoord(chunkMap, cellIndex);
+        cellX = cellCoord.x;
+        cellY = cellCoord.y;
+    }
     htw_geo_GridCoord worldCoord = {
         .x = (chunkX * chunkMap->chunkSize) + cellX,
         .y = (chunkY * chunkMap->chunkSize) + cellY
@@ -119,6 +818,43 @@ u32 htw_geo_getChunkMapHexDistance(const htw_ChunkMap *chunkMap, htw_geo_GridCoo
     return htw_geo_hexGridMagnitude(htw_geo_wrapVectorOnChunkMap(chunkMap, htw_geo_subGridCoords(b, a)));
 }
 
+/// internal; cells [startX] to [endX] of row [row] relative to [center], wrapped around [wrapMap] if it's set
+static void visitRowSpan(const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, s32 row, s32 startX, s32 endX, htw_geo_RowSpanFn spanFn, void *context) {
+    s32 y = center.y + row;
+    s32 x = center.x + startX;
+    s32 length = endX - startX + 1;
+    if (wrapMap == NULL) {
+        spanFn(context, y, x, x + length - 1);
+        return;
+    }
+    s32 width = wrapMap->mapWidth;
+    y = MOD(y, (s32)wrapMap->mapHeight);
+    x = MOD(x, width);
+    // split where the row wraps around
+    s32 firstLength = MIN(length, width - x);
+    spanFn(context, y, x, x + firstLength - 1);
+    if (firstLength < length) {
+        spanFn(context, y, 0, length - firstLength - 1);
+    }
+}
+
+void htw_geo_forEachHexAreaSpan(const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, int ringOnly, htw_geo_RowSpanFn spanFn, void *context) {
+    s32 r = radius;
+    for (s32 row = -r; row <= r; row++) {
+        // the cells of each row at distance [radius] or less from the center, as offsets from it, are a single span
+        s32 startX = MAX(-r, -row - r);
+        s32 endX = MIN(r, -row + r);
+        if (ringOnly && row != -r && row != r) {
+            // the first and last rows are entirely on the ring, and the rest only at their ends
+            visitRowSpan(wrapMap, center, row, startX, startX, spanFn, context);
+            visitRowSpan(wrapMap, center, row, endX, endX, spanFn, context);
+        }
+        else {
+            visitRowSpan(wrapMap, center, row, startX, endX, spanFn, context);
+        }
+    }
+}
+
 // More complicated than a typical wrapped space distance check because of the effect y position has on x offset
 // First determine which offset directions to use: only one (+ or -) in each axis can potentially put point b closer to a than it is already
 // Next find the simple distance, and the distance after moving point b into the nearby 'parallel dimensions' indicated by the offest directions
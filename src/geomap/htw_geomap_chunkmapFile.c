@@ -0,0 +1,228 @@
+/* Saving chunkmaps to files that can be mapped straight back into memory
+ */
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "htw_geomap.h"
+#include "htw_core.h"
+
+static const char HTW_GEO_CHUNKMAP_FILE_MAGIC[8] = "HTWCMAP";
+// Written as a u32 in the writer's byte order; reads back differently on a machine with the other byte order
+#define HTW_GEO_CHUNKMAP_FILE_BYTE_ORDER 0x01020304
+
+typedef struct {
+    char magic[8];
+    u32 version;
+    u32 byteOrder;
+    u32 headerSize; // sizeof this struct when written; lets later versions append fields
+    u32 chunkSize;
+    u32 chunkCountX;
+    u32 chunkCountY;
+    u64 cellDataSize;
+    u64 chunkStride; // bytes from one chunk's cells to the next; chunk size rounded up to the file alignment
+    u64 payloadOffset; // position of the first chunk in the file
+    // the map's cell schema, from htw_geo_setCellSchema; fieldCount is 0 if it had none
+    u32 layout;
+    u32 fieldCount;
+    struct {
+        u64 offset;
+        u64 stride;
+    } fields[HTW_GEO_MAX_SCHEMA_FIELDS]; // the map's htw_geo_CellField for each schema field
+    u32 cellOrder; // htw_geo_CellOrder
+    u32 reserved; // zero; pads the header to a multiple of 8 bytes
+} htw_geo_ChunkMapFileHeader;
+
+/// internal; rounds up to a multiple of HTW_GEO_CHUNKMAP_FILE_ALIGNMENT
+static u64 alignToFile(u64 size) {
+    return (size + HTW_GEO_CHUNKMAP_FILE_ALIGNMENT - 1) & ~(u64)(HTW_GEO_CHUNKMAP_FILE_ALIGNMENT - 1);
+}
+
+int htw_geo_saveChunkMap(const htw_ChunkMap *chunkMap, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return -1;
+    }
+
+    u64 chunkBytes = (u64)chunkMap->cellsPerChunk * chunkMap->cellDataSize;
+    htw_geo_ChunkMapFileHeader header = {
+        .version = HTW_GEO_CHUNKMAP_FILE_VERSION,
+        .byteOrder = HTW_GEO_CHUNKMAP_FILE_BYTE_ORDER,
+        .headerSize = sizeof(htw_geo_ChunkMapFileHeader),
+        .chunkSize = chunkMap->chunkSize,
+        .chunkCountX = chunkMap->chunkCountX,
+        .chunkCountY = chunkMap->chunkCountY,
+        .cellDataSize = chunkMap->cellDataSize,
+        .chunkStride = alignToFile(chunkBytes),
+        .payloadOffset = alignToFile(sizeof(htw_geo_ChunkMapFileHeader)),
+        .layout = chunkMap->layout,
+        .fieldCount = chunkMap->fieldCount,
+        .cellOrder = chunkMap->cellOrder,
+    };
+    memcpy(header.magic, HTW_GEO_CHUNKMAP_FILE_MAGIC, sizeof(header.magic));
+    for (u32 i = 0; i < chunkMap->fieldCount; i++) {
+        header.fields[i].offset = chunkMap->fields[i].offset;
+        header.fields[i].stride = chunkMap->fields[i].stride;
+    }
+
+    // header and every chunk are followed by zero padding up to the next aligned position
+    static const u8 padding[HTW_GEO_CHUNKMAP_FILE_ALIGNMENT] = {0};
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(padding, header.payloadOffset - sizeof(header), 1, fp) == 1;
+    u32 chunkCount = chunkMap->chunkCountX * chunkMap->chunkCountY;
+    for (u32 i = 0; ok && i < chunkCount; i++) {
+        u8 *cellData = htw_geo_getChunk(chunkMap, i);
+        if (chunkMap->haloWidth == 0) {
+            ok = fwrite(cellData, chunkBytes, 1, fp) == 1;
+        }
+        else {
+            // halos aren't saved; they can be rebuilt with htw_geo_syncHalos
+            size_t rowBytes = chunkMap->chunkSize * chunkMap->cellDataSize;
+            for (u32 y = 0; ok && y < chunkMap->chunkSize; y++) {
+                ok = fwrite(cellData + (y * chunkMap->chunkPitch * chunkMap->cellDataSize), rowBytes, 1, fp) == 1;
+            }
+        }
+        if (header.chunkStride > chunkBytes) {
+            ok = ok && fwrite(padding, header.chunkStride - chunkBytes, 1, fp) == 1;
+        }
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        fprintf(stderr, "Failed to write chunkmap to %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/// internal; checks that the schema fields in a header stay inside their cell, or for columns inside their chunk of
+/// [chunkBytes] bytes
+static int isValidSchema(const htw_geo_ChunkMapFileHeader *header, u64 chunkBytes) {
+    if ((header->layout != HTW_GEO_LAYOUT_CELLS && header->layout != HTW_GEO_LAYOUT_COLUMNS) || header->fieldCount > HTW_GEO_MAX_SCHEMA_FIELDS) {
+        fprintf(stderr, "Chunkmap file has an unknown cell schema\n");
+        return 0;
+    }
+    u64 cellsPerChunk = (u64)header->chunkSize * header->chunkSize;
+    for (u32 i = 0; i < header->fieldCount; i++) {
+        u64 offset = header->fields[i].offset;
+        u64 stride = header->fields[i].stride;
+        u64 columnBytes, fieldEnd;
+        int fits = header->layout == HTW_GEO_LAYOUT_CELLS
+            ? stride == header->cellDataSize && offset < header->cellDataSize
+            : stride != 0 && !__builtin_mul_overflow(stride, cellsPerChunk, &columnBytes)
+                && !__builtin_add_overflow(offset, columnBytes, &fieldEnd) && fieldEnd <= chunkBytes;
+        if (!fits) {
+            fprintf(stderr, "Chunkmap file has cell schema field %u out of range\n", i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/// internal; checks that a header describes a map this build can use, and that fits in a file of [fileSize] bytes.
+/// Every size is checked for overflow, since the header may come from anywhere
+static int isValidHeader(const htw_geo_ChunkMapFileHeader *header, u64 fileSize) {
+    if (memcmp(header->magic, HTW_GEO_CHUNKMAP_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "Not a chunkmap file\n");
+        return 0;
+    }
+    if (header->byteOrder != HTW_GEO_CHUNKMAP_FILE_BYTE_ORDER) {
+        fprintf(stderr, "Chunkmap file was written on a machine with a different byte order\n");
+        return 0;
+    }
+    if (header->version != HTW_GEO_CHUNKMAP_FILE_VERSION || header->headerSize < sizeof(htw_geo_ChunkMapFileHeader)) {
+        fprintf(stderr, "Unsupported chunkmap file version %u\n", header->version);
+        return 0;
+    }
+    // counts and sizes the map keeps as u32: chunk count, cells per chunk, and map width and height in cells
+    u64 chunkCount = (u64)header->chunkCountX * header->chunkCountY;
+    u64 cellsPerChunk = (u64)header->chunkSize * header->chunkSize;
+    if (chunkCount == 0 || header->chunkSize == 0 || header->cellDataSize == 0 || chunkCount > UINT32_MAX
+        || cellsPerChunk > UINT32_MAX || (u64)header->chunkSize * header->chunkCountX > UINT32_MAX
+        || (u64)header->chunkSize * header->chunkCountY > UINT32_MAX) {
+        fprintf(stderr, "Chunkmap file has dimensions out of range\n");
+        return 0;
+    }
+    // chunks are mapped in place, so they have to start where htw_geo_saveChunkMap puts them
+    if (header->chunkStride % HTW_GEO_CHUNKMAP_FILE_ALIGNMENT != 0 || header->payloadOffset % HTW_GEO_CHUNKMAP_FILE_ALIGNMENT != 0) {
+        fprintf(stderr, "Chunkmap file has misaligned chunks\n");
+        return 0;
+    }
+    u64 chunkBytes, payloadBytes, payloadEnd;
+    if (__builtin_mul_overflow(cellsPerChunk, header->cellDataSize, &chunkBytes)
+        || __builtin_mul_overflow(header->chunkStride, chunkCount, &payloadBytes)
+        || __builtin_add_overflow(header->payloadOffset, payloadBytes, &payloadEnd)
+        || payloadEnd > SIZE_MAX) {
+        fprintf(stderr, "Chunkmap file has sizes out of range\n");
+        return 0;
+    }
+    if (header->chunkStride < chunkBytes || header->payloadOffset < header->headerSize || payloadEnd > fileSize) {
+        fprintf(stderr, "Chunkmap file is truncated or has inconsistent dimensions\n");
+        return 0;
+    }
+    if (header->cellOrder > HTW_GEO_CELL_ORDER_HILBERT) {
+        fprintf(stderr, "Chunkmap file has an unknown cell order\n");
+        return 0;
+    }
+    if (header->cellOrder != HTW_GEO_CELL_ORDER_ROWS && !IS_POW_OF_2(header->chunkSize)) {
+        fprintf(stderr, "Chunkmap file has a cell order that needs a chunk size that is a power of 2\n");
+        return 0;
+    }
+    return isValidSchema(header, chunkBytes);
+}
+
+htw_ChunkMap *htw_geo_openChunkMap(const char *path, int writeBack) {
+    int fd = open(path, writeBack ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return NULL;
+    }
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0 || fileInfo.st_size < sizeof(htw_geo_ChunkMapFileHeader)) {
+        fprintf(stderr, "Failed to read chunkmap header from %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    // a private mapping can still be written to; changes just aren't carried through to the file
+    size_t mappingSize = fileInfo.st_size;
+    void *mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, writeBack ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the file is closed
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s\n", path);
+        return NULL;
+    }
+
+    htw_geo_ChunkMapFileHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    if (!isValidHeader(&header, mappingSize)) {
+        munmap(mapping, mappingSize);
+        return NULL;
+    }
+
+    htw_ChunkMap *chunkMap = calloc(1, sizeof(htw_ChunkMap));
+    htw_geo_setChunkMapDimensions(chunkMap, header.chunkSize, header.chunkCountX, header.chunkCountY, header.cellDataSize);
+    htw_geo_initChangeTracking(chunkMap);
+    chunkMap->cellOrder = header.cellOrder;
+    chunkMap->layout = header.layout;
+    chunkMap->fieldCount = header.fieldCount;
+    for (u32 i = 0; i < header.fieldCount; i++) {
+        chunkMap->fields[i] = (htw_geo_CellField){header.fields[i].offset, header.fields[i].stride};
+    }
+    chunkMap->fileMapping = mapping;
+    chunkMap->fileMappingSize = mappingSize;
+    chunkMap->slab = (u8*)mapping + header.payloadOffset;
+    chunkMap->chunkStride = header.chunkStride;
+    chunkMap->slabSize = header.chunkStride * header.chunkCountX * header.chunkCountY;
+
+    u32 chunkCount = header.chunkCountX * header.chunkCountY;
+    chunkMap->chunks = calloc(chunkCount, sizeof(htw_Chunk));
+    for (u32 i = 0; i < chunkCount; i++) {
+        chunkMap->chunks[i].cellData = (u8*)chunkMap->slab + (i * chunkMap->chunkStride);
+    }
+
+    return chunkMap;
+}
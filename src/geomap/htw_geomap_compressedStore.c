@@ -0,0 +1,396 @@
+/* Compressed in-memory backing store for lazy chunkmaps
+ *
+ * Encoded chunk layout: for each column, one byte for the codec, a varint payload length, then the payload.
+ * Column values are handled as u32, zero extended from the column's word size.
+ * - RAW: every value, [wordSize] bytes each
+ * - RLE: pairs of varint run length, varint value
+ * - BITPACK: varint minimum value, one byte bit width, then (value - minimum) packed LSB first
+ * - DELTA: varint first value, one byte bit width, then zigzag encoded differences from the previous value, packed
+ */
+#include <string.h>
+#include <time.h>
+#include "htw_geomap.h"
+#include "htw_core.h"
+
+typedef struct {
+    u8 *data; // NULL if the store has no copy of this chunk
+    size_t size;
+    double lastDecodeSeconds;
+    u32 decodeCount;
+    u32 columnsByCodec[HTW_GEO_CODEC_COUNT];
+} htw_geo_CompressedChunk;
+
+struct htw_geo_CompressedChunkStore {
+    u32 chunkCount;
+    u32 cellsPerChunk;
+    size_t cellDataSize;
+    u32 wordSize; // bytes per column value
+    u32 columnCount; // columns per cell
+    htw_geo_CompressedChunk *chunks;
+    u32 *columnValues; // scratch space for one column, cellsPerChunk values
+    u8 *encodeBuffer; // scratch space for a whole encoded chunk
+    u8 *trialBuffer; // scratch space for trying a codec on one column
+    htw_geo_ChunkGenerateFn generate;
+    void *generateContext;
+};
+
+// Worst case bytes for any codec's encoding of one column: RLE with every run of length 1, two 5 byte varints each
+#define HTW_GEO_MAX_COLUMN_BYTES(valueCount) ((valueCount) * 10 + 16)
+
+/// internal; LEB128
+static u8 *writeVarint(u8 *dest, u32 value) {
+    while (value >= 0x80) {
+        *dest++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *dest++ = value;
+    return dest;
+}
+
+/// internal
+static const u8 *readVarint(const u8 *src, u32 *value) {
+    u32 result = 0;
+    u32 shift = 0;
+    u8 byte;
+    do {
+        byte = *src++;
+        result |= (u32)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *value = result;
+    return src;
+}
+
+/// internal; bits needed to hold every value up to and including [max]
+static u32 bitWidth(u32 max) {
+    return max == 0 ? 0 : 32 - __builtin_clz(max);
+}
+
+/// internal; packs [count] values of [bits] bits each. Returns the end of the written data
+static u8 *packBits(u8 *dest, const u32 *values, u32 count, u32 bits) {
+    u64 accumulator = 0;
+    u32 pending = 0;
+    for (u32 i = 0; i < count; i++) {
+        accumulator |= (u64)values[i] << pending;
+        pending += bits;
+        while (pending >= 8) {
+            *dest++ = accumulator;
+            accumulator >>= 8;
+            pending -= 8;
+        }
+    }
+    if (pending > 0) {
+        *dest++ = accumulator;
+    }
+    return dest;
+}
+
+/// internal; reverse of packBits
+static const u8 *unpackBits(const u8 *src, u32 *values, u32 count, u32 bits) {
+    u64 accumulator = 0;
+    u32 available = 0;
+    u32 mask = bits == 32 ? 0xFFFFFFFF : (1U << bits) - 1;
+    for (u32 i = 0; i < count; i++) {
+        while (available < bits) {
+            accumulator |= (u64)*src++ << available;
+            available += 8;
+        }
+        values[i] = accumulator & mask;
+        accumulator >>= bits;
+        available -= bits;
+    }
+    return src;
+}
+
+/// internal
+static u32 zigzag(u32 delta) {
+    return (delta << 1) ^ (u32)((s32)delta >> 31);
+}
+
+/// internal
+static u32 unzigzag(u32 value) {
+    return (value >> 1) ^ -(value & 1);
+}
+
+/// internal; encodes [values] with [codec] into [dest], and returns the number of bytes written. [scratch] must hold
+/// [count] values
+static size_t encodeColumn(htw_geo_ChunkCodec codec, const u32 *values, u32 count, u32 wordSize, u32 *scratch, u8 *dest) {
+    u8 *end = dest;
+    switch (codec) {
+        case HTW_GEO_CODEC_RAW:
+            for (u32 i = 0; i < count; i++) {
+                // little endian, regardless of platform, so the encoding is the same everywhere
+                for (u32 b = 0; b < wordSize; b++) {
+                    *end++ = values[i] >> (b * 8);
+                }
+            }
+            break;
+        case HTW_GEO_CODEC_RLE:
+            for (u32 i = 0; i < count;) {
+                u32 run = 1;
+                while (i + run < count && values[i + run] == values[i]) {
+                    run++;
+                }
+                end = writeVarint(end, run);
+                end = writeVarint(end, values[i]);
+                i += run;
+            }
+            break;
+        case HTW_GEO_CODEC_BITPACK: {
+            u32 min = values[0], max = values[0];
+            for (u32 i = 1; i < count; i++) {
+                min = MIN(min, values[i]);
+                max = MAX(max, values[i]);
+            }
+            for (u32 i = 0; i < count; i++) {
+                scratch[i] = values[i] - min;
+            }
+            u32 bits = bitWidth(max - min);
+            end = writeVarint(end, min);
+            *end++ = bits;
+            end = packBits(end, scratch, count, bits);
+            break;
+        }
+        case HTW_GEO_CODEC_DELTA: {
+            u32 maxDelta = 0;
+            for (u32 i = 1; i < count; i++) {
+                scratch[i - 1] = zigzag(values[i] - values[i - 1]);
+                maxDelta = MAX(maxDelta, scratch[i - 1]);
+            }
+            u32 bits = bitWidth(maxDelta);
+            end = writeVarint(end, values[0]);
+            *end++ = bits;
+            end = packBits(end, scratch, count - 1, bits);
+            break;
+        }
+        default:
+            break;
+    }
+    return end - dest;
+}
+
+/// internal; reverse of encodeColumn. Returns the end of the column's data
+static const u8 *decodeColumn(htw_geo_ChunkCodec codec, const u8 *src, u32 *values, u32 count, u32 wordSize) {
+    switch (codec) {
+        case HTW_GEO_CODEC_RAW:
+            for (u32 i = 0; i < count; i++) {
+                u32 value = 0;
+                for (u32 b = 0; b < wordSize; b++) {
+                    value |= (u32)*src++ << (b * 8);
+                }
+                values[i] = value;
+            }
+            break;
+        case HTW_GEO_CODEC_RLE:
+            for (u32 i = 0; i < count;) {
+                u32 run, value;
+                src = readVarint(src, &run);
+                src = readVarint(src, &value);
+                for (u32 r = 0; r < run; r++) {
+                    values[i++] = value;
+                }
+            }
+            break;
+        case HTW_GEO_CODEC_BITPACK: {
+            u32 min;
+            src = readVarint(src, &min);
+            u32 bits = *src++;
+            if (bits == 0) {
+                for (u32 i = 0; i < count; i++) values[i] = min;
+                break;
+            }
+            src = unpackBits(src, values, count, bits);
+            for (u32 i = 0; i < count; i++) {
+                values[i] += min;
+            }
+            break;
+        }
+        case HTW_GEO_CODEC_DELTA: {
+            src = readVarint(src, &values[0]);
+            u32 bits = *src++;
+            if (bits == 0) {
+                for (u32 i = 1; i < count; i++) values[i] = values[0];
+                break;
+            }
+            src = unpackBits(src, &values[1], count - 1, bits);
+            for (u32 i = 1; i < count; i++) {
+                values[i] = values[i - 1] + unzigzag(values[i]);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return src;
+}
+
+/// internal
+static u32 readWord(const u8 *src, u32 wordSize) {
+    switch (wordSize) {
+        case 4: { u32 v; memcpy(&v, src, 4); return v; }
+        case 2: { u16 v; memcpy(&v, src, 2); return v; }
+        default: return *src;
+    }
+}
+
+/// internal
+static void writeWord(u8 *dest, u32 value, u32 wordSize) {
+    switch (wordSize) {
+        case 4: { u32 v = value; memcpy(dest, &v, 4); break; }
+        case 2: { u16 v = value; memcpy(dest, &v, 2); break; }
+        default: *dest = value; break;
+    }
+}
+
+htw_geo_CompressedChunkStore *htw_geo_createCompressedChunkStore(u32 chunkCount, u32 cellsPerChunk, size_t cellDataSize) {
+    htw_geo_CompressedChunkStore *store = calloc(1, sizeof(htw_geo_CompressedChunkStore));
+    store->chunkCount = chunkCount;
+    store->cellsPerChunk = cellsPerChunk;
+    store->cellDataSize = cellDataSize;
+    store->wordSize = cellDataSize % 4 == 0 ? 4 : cellDataSize % 2 == 0 ? 2 : 1;
+    store->columnCount = cellDataSize / store->wordSize;
+    store->chunks = calloc(chunkCount, sizeof(htw_geo_CompressedChunk));
+    // one extra value, for the scratch space used by delta encoding
+    store->columnValues = malloc(sizeof(u32) * (cellsPerChunk + 1) * 2);
+    store->encodeBuffer = malloc(HTW_GEO_MAX_COLUMN_BYTES(cellsPerChunk) * store->columnCount);
+    store->trialBuffer = malloc(HTW_GEO_MAX_COLUMN_BYTES(cellsPerChunk));
+    return store;
+}
+
+void htw_geo_destroyCompressedChunkStore(htw_geo_CompressedChunkStore *store) {
+    for (u32 i = 0; i < store->chunkCount; i++) {
+        free(store->chunks[i].data);
+    }
+    free(store->chunks);
+    free(store->columnValues);
+    free(store->encodeBuffer);
+    free(store->trialBuffer);
+    free(store);
+}
+
+/// internal; htw_geo_ChunkStoreFn
+static void storeCompressedChunk(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, const void *cellData) {
+    htw_geo_CompressedChunkStore *store = context;
+    htw_geo_CompressedChunk *chunk = &store->chunks[chunkIndex];
+    u32 *values = store->columnValues;
+    u32 *scratch = values + store->cellsPerChunk + 1;
+    const u8 *cells = cellData;
+
+    memset(chunk->columnsByCodec, 0, sizeof(chunk->columnsByCodec));
+    u8 *end = store->encodeBuffer;
+    for (u32 c = 0; c < store->columnCount; c++) {
+        const u8 *src = cells + (c * store->wordSize);
+        for (u32 i = 0; i < store->cellsPerChunk; i++) {
+            values[i] = readWord(src, store->wordSize);
+            src += store->cellDataSize;
+        }
+
+        // keep whichever codec is smallest for this column
+        htw_geo_ChunkCodec bestCodec = HTW_GEO_CODEC_RAW;
+        size_t bestSize = encodeColumn(HTW_GEO_CODEC_RAW, values, store->cellsPerChunk, store->wordSize, scratch, store->trialBuffer);
+        for (htw_geo_ChunkCodec codec = HTW_GEO_CODEC_RLE; codec < HTW_GEO_CODEC_COUNT; codec++) {
+            size_t size = encodeColumn(codec, values, store->cellsPerChunk, store->wordSize, scratch, store->trialBuffer);
+            if (size < bestSize) {
+                bestCodec = codec;
+                bestSize = size;
+            }
+        }
+
+        *end++ = bestCodec;
+        end = writeVarint(end, bestSize);
+        end += encodeColumn(bestCodec, values, store->cellsPerChunk, store->wordSize, scratch, end);
+        chunk->columnsByCodec[bestCodec]++;
+    }
+
+    chunk->size = end - store->encodeBuffer;
+    chunk->data = realloc(chunk->data, chunk->size);
+    memcpy(chunk->data, store->encodeBuffer, chunk->size);
+}
+
+/// internal; htw_geo_ChunkLoadFn
+static int loadCompressedChunk(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData) {
+    htw_geo_CompressedChunkStore *store = context;
+    htw_geo_CompressedChunk *chunk = &store->chunks[chunkIndex];
+    if (chunk->data == NULL) {
+        return 0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    u32 *values = store->columnValues;
+    u8 *cells = cellData;
+    const u8 *src = chunk->data;
+    for (u32 c = 0; c < store->columnCount; c++) {
+        htw_geo_ChunkCodec codec = *src++;
+        u32 size;
+        src = readVarint(src, &size);
+        decodeColumn(codec, src, values, store->cellsPerChunk, store->wordSize);
+        src += size;
+
+        u8 *dest = cells + (c * store->wordSize);
+        for (u32 i = 0; i < store->cellsPerChunk; i++) {
+            writeWord(dest, values[i], store->wordSize);
+            dest += store->cellDataSize;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    chunk->lastDecodeSeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    chunk->decodeCount++;
+    return 1;
+}
+
+/// internal; htw_geo_ChunkGenerateFn, forwards to the generator given to htw_geo_getCompressedChunkSource
+static void generateUncompressedChunk(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData) {
+    htw_geo_CompressedChunkStore *store = context;
+    store->generate(store->generateContext, chunkMap, chunkIndex, cellData);
+}
+
+htw_geo_ChunkSource htw_geo_getCompressedChunkSource(htw_geo_CompressedChunkStore *store, htw_geo_ChunkGenerateFn generate, void *generateContext) {
+    store->generate = generate;
+    store->generateContext = generateContext;
+    return (htw_geo_ChunkSource){
+        .generate = generate == NULL ? NULL : generateUncompressedChunk,
+        .load = loadCompressedChunk,
+        .store = storeCompressedChunk,
+        .context = store,
+        .storeGenerated = 1,
+    };
+}
+
+int htw_geo_getCompressedChunkStats(const htw_geo_CompressedChunkStore *store, u32 chunkIndex, htw_geo_CompressedChunkStats *stats) {
+    const htw_geo_CompressedChunk *chunk = &store->chunks[chunkIndex];
+    *stats = (htw_geo_CompressedChunkStats){0};
+    if (chunk->data == NULL) {
+        return 0;
+    }
+    stats->rawBytes = store->cellsPerChunk * store->cellDataSize;
+    stats->compressedBytes = chunk->size;
+    stats->compressionRatio = (double)stats->rawBytes / stats->compressedBytes;
+    stats->lastDecodeSeconds = chunk->lastDecodeSeconds;
+    stats->decodeCount = chunk->decodeCount;
+    memcpy(stats->columnsByCodec, chunk->columnsByCodec, sizeof(stats->columnsByCodec));
+    return 1;
+}
+
+void htw_geo_getCompressedStoreStats(const htw_geo_CompressedChunkStore *store, htw_geo_CompressedChunkStats *stats) {
+    *stats = (htw_geo_CompressedChunkStats){0};
+    u32 decodedChunks = 0;
+    for (u32 i = 0; i < store->chunkCount; i++) {
+        htw_geo_CompressedChunkStats chunkStats;
+        if (!htw_geo_getCompressedChunkStats(store, i, &chunkStats)) continue;
+        stats->rawBytes += chunkStats.rawBytes;
+        stats->compressedBytes += chunkStats.compressedBytes;
+        stats->decodeCount += chunkStats.decodeCount;
+        if (chunkStats.decodeCount > 0) {
+            stats->lastDecodeSeconds += chunkStats.lastDecodeSeconds;
+            decodedChunks++;
+        }
+        for (int c = 0; c < HTW_GEO_CODEC_COUNT; c++) {
+            stats->columnsByCodec[c] += chunkStats.columnsByCodec[c];
+        }
+    }
+    if (stats->compressedBytes > 0) stats->compressionRatio = (double)stats->rawBytes / stats->compressedBytes;
+    if (decodedChunks > 0) stats->lastDecodeSeconds /= decodedChunks;
+}
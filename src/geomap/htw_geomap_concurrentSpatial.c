@@ -0,0 +1,243 @@
+/*
+ * Spatial storage for one writer thread and any number of reader threads, laid out like htw_SpatialStorage: items are
+ * linked by index + 1 into per slot lists, newest first, and links refer back to whatever refers to them
+ *
+ * Each hash slot is a small seqlock. The writer makes the slot's sequence odd before changing anything in its list
+ * (including links of items in it, and the slot's head), and even again after. A reader notes the sequence, walks the
+ * list, then checks the sequence again, and starts over if it was odd or has changed. Everything readers can see is
+ * read and written with atomic operations, so a reader racing the writer sees old or new values, never torn ones, and
+ * links always hold valid indices; a list can briefly look wrong (even circular), but the sequence check throws away
+ * anything read from it
+ */
+#include <sched.h>
+#include <stdatomic.h>
+#include "htw_geomap.h"
+#include "htw_core.h"
+#include "htw_random.h"
+
+// Same strips as htw_SpatialStorage: log2 of the number of cells in a row strip counted by stripCounts
+#define HTW_GEO_SPATIAL_STRIP_SHIFT 4
+// Failed reads of a slot before a reader gives up the rest of its time slice, in case the writer was interrupted
+// partway through changing that slot
+#define HTW_GEO_CONCURRENT_SPIN_LIMIT 64
+
+typedef struct {
+    _Atomic u32 next;
+    u32 prev; // only used by the writer
+    _Atomic u64 coord; // packed with packCoord, so readers can compare it in one load
+} htw_ConcurrentLink;
+
+typedef struct {
+    _Atomic u32 sequence; // odd while the writer is changing this slot
+    _Atomic u32 head;
+} htw_ConcurrentSlot;
+
+struct htw_ConcurrentSpatialStorage {
+    size_t maxItemCount;
+    u32 slotMask;
+    u32 stripMask;
+    htw_ConcurrentLink *links;
+    htw_ConcurrentSlot *slots;
+    // Coarse occupancy for range queries, as in htw_SpatialTable. Only a hint for readers: a strip that is read as empty
+    // just before an item arrives is the same as reading before the item was inserted
+    _Atomic u32 *stripCounts;
+};
+
+// Output of a range query, and the items found so far
+typedef struct {
+    htw_ConcurrentSpatialStorage *cs;
+    size_t *indices;
+    size_t maxIndices;
+    size_t count;
+} htw_geo_ConcurrentQuery;
+
+/// internal
+static inline u64 packCoord(htw_geo_GridCoord coord) {
+    return ((u64)(u32)coord.y << 32) | (u32)coord.x;
+}
+
+/// internal
+static inline htw_geo_GridCoord unpackCoord(u64 packed) {
+    return (htw_geo_GridCoord){(s32)(u32)packed, (s32)(u32)(packed >> 32)};
+}
+
+/// internal
+static inline u32 getSlotIndex(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord) {
+    return xxh_hash2d(0, coord.x, coord.y) & cs->slotMask;
+}
+
+/// internal
+static inline _Atomic u32 *getStripCount(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord) {
+    return &cs->stripCounts[xxh_hash2d(1, coord.x >> HTW_GEO_SPATIAL_STRIP_SHIFT, coord.y) & cs->stripMask];
+}
+
+/// internal; only the writer changes counts, so there is no need for an atomic read-modify-write
+static inline void addToStripCount(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord, s32 amount) {
+    _Atomic u32 *count = getStripCount(cs, coord);
+    atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+/// internal; makes the slot's sequence odd. The fence keeps the changes that follow from being seen before it
+static inline void beginSlotWrite(htw_ConcurrentSlot *slot) {
+    u32 sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/// internal; makes the slot's sequence even again, after every change to it
+static inline void endSlotWrite(htw_ConcurrentSlot *slot) {
+    u32 sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_release);
+}
+
+/// internal; the item's slot must be open for writing
+static void unlinkItem(htw_ConcurrentSpatialStorage *cs, u32 itemIndex) {
+    htw_ConcurrentLink *link = &cs->links[itemIndex];
+    u32 next = atomic_load_explicit(&link->next, memory_order_relaxed);
+    if (link->prev & HTW_GEO_SPATIAL_SLOT_REF) {
+        atomic_store_explicit(&cs->slots[link->prev & ~HTW_GEO_SPATIAL_SLOT_REF].head, next, memory_order_relaxed);
+    }
+    else {
+        atomic_store_explicit(&cs->links[link->prev - 1].next, next, memory_order_relaxed);
+    }
+    if (next != 0) {
+        cs->links[next - 1].prev = link->prev;
+    }
+    addToStripCount(cs, unpackCoord(atomic_load_explicit(&link->coord, memory_order_relaxed)), -1);
+    link->prev = 0;
+    // the link's own next is left alone, so a reader already on this link carries on along its old list, and the
+    // sequence check catches it
+}
+
+/// internal; [slotIndex] must be open for writing
+static void linkItemAtHead(htw_ConcurrentSpatialStorage *cs, u32 slotIndex, u32 itemIndex, htw_geo_GridCoord coord) {
+    htw_ConcurrentLink *link = &cs->links[itemIndex];
+    htw_ConcurrentSlot *slot = &cs->slots[slotIndex];
+    u32 head = atomic_load_explicit(&slot->head, memory_order_relaxed);
+    atomic_store_explicit(&link->coord, packCoord(coord), memory_order_relaxed);
+    atomic_store_explicit(&link->next, head, memory_order_relaxed);
+    link->prev = HTW_GEO_SPATIAL_SLOT_REF | slotIndex;
+    if (head != 0) {
+        cs->links[head - 1].prev = itemIndex + 1;
+    }
+    atomic_store_explicit(&slot->head, itemIndex + 1, memory_order_relaxed);
+    addToStripCount(cs, coord, 1);
+}
+
+htw_ConcurrentSpatialStorage *htw_geo_createConcurrentSpatialStorage(size_t maxItemCount) {
+    htw_ConcurrentSpatialStorage *newStorage = calloc(1, sizeof(htw_ConcurrentSpatialStorage));
+    newStorage->maxItemCount = MIN(maxItemCount, HTW_GEO_SPATIAL_MAX_ITEM_INDEX + 1);
+    newStorage->links = calloc(newStorage->maxItemCount, sizeof(htw_ConcurrentLink));
+    // same sizes as htw_geo_createSpatialStorage: a load factor between 0.25 and 0.5, and a strip count per 4 slots
+    u32 slotCount = htw_nextPow(MIN(newStorage->maxItemCount * 2, HTW_GEO_SPATIAL_SLOT_REF));
+    u32 stripCountSize = slotCount / 4 > 0 ? slotCount / 4 : 1;
+    newStorage->slotMask = slotCount - 1;
+    newStorage->slots = calloc(slotCount, sizeof(htw_ConcurrentSlot));
+    newStorage->stripMask = stripCountSize - 1;
+    newStorage->stripCounts = calloc(stripCountSize, sizeof(_Atomic u32));
+    return newStorage;
+}
+
+void htw_geo_destroyConcurrentSpatialStorage(htw_ConcurrentSpatialStorage *cs) {
+    free(cs->links);
+    free(cs->slots);
+    free((void*)cs->stripCounts);
+    free(cs);
+}
+
+void htw_geo_concurrentSpatialInsert(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord, size_t itemIndex) {
+    if (itemIndex >= cs->maxItemCount) {
+        fprintf(stderr, "Concurrent spatial storage item index %zu is past its capacity of %zu\n", itemIndex, cs->maxItemCount);
+        return;
+    }
+    htw_ConcurrentLink *link = &cs->links[itemIndex];
+    u32 newSlot = getSlotIndex(cs, coord);
+    // an item that is already stored leaves its old slot in the same write, so readers never see it in both or neither
+    int isStored = link->prev != 0;
+    u32 oldSlot = isStored ? getSlotIndex(cs, unpackCoord(atomic_load_explicit(&link->coord, memory_order_relaxed))) : newSlot;
+    beginSlotWrite(&cs->slots[oldSlot]);
+    if (oldSlot != newSlot) beginSlotWrite(&cs->slots[newSlot]);
+    if (isStored) unlinkItem(cs, itemIndex);
+    linkItemAtHead(cs, newSlot, itemIndex, coord);
+    if (oldSlot != newSlot) endSlotWrite(&cs->slots[newSlot]);
+    endSlotWrite(&cs->slots[oldSlot]);
+}
+
+void htw_geo_concurrentSpatialRemove(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord, size_t itemIndex) {
+    if (itemIndex >= cs->maxItemCount || cs->links[itemIndex].prev == 0) return;
+    htw_ConcurrentSlot *slot = &cs->slots[getSlotIndex(cs, unpackCoord(atomic_load_explicit(&cs->links[itemIndex].coord, memory_order_relaxed)))];
+    beginSlotWrite(slot);
+    unlinkItem(cs, itemIndex);
+    endSlotWrite(slot);
+}
+
+void htw_geo_concurrentSpatialMove(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord oldCoord, htw_geo_GridCoord newCoord, size_t itemIndex) {
+    htw_geo_concurrentSpatialInsert(cs, newCoord, itemIndex);
+}
+
+/// internal; adds every item at [coord] to [query], as they were at one moment
+static void readCell(htw_geo_ConcurrentQuery *query, htw_geo_GridCoord coord) {
+    htw_ConcurrentSpatialStorage *cs = query->cs;
+    htw_ConcurrentSlot *slot = &cs->slots[getSlotIndex(cs, coord)];
+    u64 packed = packCoord(coord);
+    for (u32 attempt = 1; ; attempt++) {
+        u32 sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (!(sequence & 1)) {
+            size_t count = query->count;
+            u32 link = atomic_load_explicit(&slot->head, memory_order_relaxed);
+            // a list read while it changes can loop, so no read goes further than the longest list could
+            for (size_t steps = 0; link != 0 && steps < cs->maxItemCount; steps++) {
+                htw_ConcurrentLink *current = &cs->links[link - 1];
+                if (atomic_load_explicit(&current->coord, memory_order_relaxed) == packed) {
+                    if (count < query->maxIndices) {
+                        query->indices[count] = link - 1;
+                    }
+                    count++;
+                }
+                link = atomic_load_explicit(&current->next, memory_order_relaxed);
+            }
+            // keeps the reads above from being seen after the sequence is checked again
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence) {
+                query->count = count;
+                return;
+            }
+        }
+        if (attempt % HTW_GEO_CONCURRENT_SPIN_LIMIT == 0) {
+            sched_yield();
+        }
+    }
+}
+
+size_t htw_geo_concurrentSpatialItemsAt(htw_ConcurrentSpatialStorage *cs, htw_geo_GridCoord coord, size_t *outIndices, size_t maxIndices) {
+    htw_geo_ConcurrentQuery query = {cs, outIndices, maxIndices, 0};
+    readCell(&query, coord);
+    return query.count;
+}
+
+/// internal; htw_geo_RowSpanFn that adds every item at each cell of the span, skipping strips without items
+static void querySpan(void *context, s32 row, s32 startX, s32 endX) {
+    htw_geo_ConcurrentQuery *query = context;
+    s32 stripWidth = 1 << HTW_GEO_SPATIAL_STRIP_SHIFT;
+    for (s32 stripX = startX >> HTW_GEO_SPATIAL_STRIP_SHIFT; stripX <= endX >> HTW_GEO_SPATIAL_STRIP_SHIFT; stripX++) {
+        htw_geo_GridCoord stripStart = {stripX * stripWidth, row};
+        if (atomic_load_explicit(getStripCount(query->cs, stripStart), memory_order_relaxed) == 0) continue;
+        s32 first = MAX(startX, stripX * stripWidth);
+        s32 last = MIN(endX, (stripX * stripWidth) + stripWidth - 1);
+        for (s32 x = first; x <= last; x++) {
+            readCell(query, (htw_geo_GridCoord){x, row});
+        }
+    }
+}
+
+size_t htw_geo_concurrentSpatialQueryRadius(htw_ConcurrentSpatialStorage *cs, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices) {
+    htw_geo_ConcurrentQuery query = {cs, outIndices, maxIndices, 0};
+    htw_geo_forEachHexAreaSpan(wrapMap, center, radius, 0, querySpan, &query);
+    return query.count;
+}
+
+size_t htw_geo_concurrentSpatialQueryRing(htw_ConcurrentSpatialStorage *cs, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices) {
+    htw_geo_ConcurrentQuery query = {cs, outIndices, maxIndices, 0};
+    htw_geo_forEachHexAreaSpan(wrapMap, center, radius, 1, querySpan, &query);
+    return query.count;
+}
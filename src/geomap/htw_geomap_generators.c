@@ -1,4 +1,5 @@
 #include <math.h>
+#include <string.h>
 #include "htw_core.h"
 #include "htw_random.h"
 #include "htw_geomap.h"
@@ -36,72 +37,375 @@ void htw_geo_fillGradient(htw_ValueMap *map, int gradStart, int gradEnd ) {
     }
 }
 
-void htw_geo_fillCircularGradient(htw_ValueMap* map, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius) {
-    gradStart = MIN(gradStart, map->maxMagnitude);
-    gradEnd = MIN(gradEnd, map->maxMagnitude);
-    for (int y = 0; y < map->height; y++) {
-        for (int x = 0; x < map->width; x++) {
-            float distance = htw_geo_hexGridDistance(center, (htw_geo_GridCoord){x, y});
+typedef struct {
+    htw_ValueMap *map;
+    htw_geo_GridCoord center;
+    s32 gradStart;
+    s32 gradEnd;
+    float radius;
+} htw_geo_CircularGradientFill;
+
+/// internal
+static void fillCircularGradientRows(void *context, u32 startRow, u32 endRow) {
+    htw_geo_CircularGradientFill *fill = context;
+    htw_ValueMap *map = fill->map;
+    for (u32 y = startRow; y < endRow; y++) {
+        s32 *row = &map->values[y * map->width];
+        for (u32 x = 0; x < map->width; x++) {
+            float distance = htw_geo_hexGridDistance(fill->center, (htw_geo_GridCoord){x, y});
             int gradValue = 0;
-            if (distance < radius) {
-                gradValue = lerp_int(gradEnd, gradStart, (radius - distance) / radius);
+            if (distance < fill->radius) {
+                gradValue = lerp_int(fill->gradEnd, fill->gradStart, (fill->radius - distance) / fill->radius);
+            }
+            row[x] = gradValue;
+        }
+    }
+}
+
+void htw_geo_fillCircularGradient(htw_ValueMap* map, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius) {
+    htw_geo_fillCircularGradientParallel(map, 1, center, gradStart, gradEnd, radius);
+}
+
+void htw_geo_fillCircularGradientParallel(htw_ValueMap* map, u32 threadCount, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius) {
+    htw_geo_CircularGradientFill fill = {
+        .map = map,
+        .center = center,
+        .gradStart = MIN(gradStart, map->maxMagnitude),
+        .gradEnd = MIN(gradEnd, map->maxMagnitude),
+        .radius = radius,
+    };
+    htw_parallelFor(map->height, threadCount, fillCircularGradientRows, &fill);
+}
+
+typedef struct {
+    htw_ValueMap *map;
+    u32 seed;
+} htw_geo_NoiseFill;
+
+/// internal
+static void fillNoiseRows(void *context, u32 startRow, u32 endRow) {
+    htw_geo_NoiseFill *fill = context;
+    htw_ValueMap *map = fill->map;
+    u32 seed = fill->seed;
+    u32 xs[16], ys[16], hashes[16];
+    for (u32 y = startRow; y < endRow; y++) {
+        s32 *row = &map->values[y * map->width];
+        for (u32 l = 0; l < 16; l++) {
+            ys[l] = y;
+        }
+        u32 x = 0;
+        // hash 16 cells at a time, then finish the row one at a time
+        for (; x + 16 <= map->width; x += 16) {
+            for (u32 l = 0; l < 16; l++) {
+                xs[l] = x + l;
+            }
+            xxh_hash2d_x16(seed, xs, ys, hashes);
+            for (u32 l = 0; l < 16; l++) {
+                row[x + l] = hashes[l] % map->maxMagnitude;
             }
-            htw_geo_setMapValue(map, (htw_geo_GridCoord){x, y}, gradValue);
+        }
+        for (; x < map->width; x++) {
+            row[x] = xxh_hash2d(seed, x, y) % map->maxMagnitude;
         }
     }
 }
 
 void htw_geo_fillNoise(htw_ValueMap* map, u32 seed) {
-    for (u32 y = 0; y < map->height; y++) {
+    htw_geo_fillNoiseParallel(map, 1, seed);
+}
+
+void htw_geo_fillNoiseParallel(htw_ValueMap* map, u32 threadCount, u32 seed) {
+    htw_geo_NoiseFill fill = {.map = map, .seed = seed};
+    htw_parallelFor(map->height, threadCount, fillNoiseRows, &fill);
+}
+
+typedef struct {
+    htw_ValueMap *map;
+    u32 seed;
+    float scale;
+} htw_geo_SmoothNoiseFill;
+
+/// internal
+static void fillSmoothNoiseRows(void *context, u32 startRow, u32 endRow) {
+    htw_geo_SmoothNoiseFill *fill = context;
+    htw_ValueMap *map = fill->map;
+    for (u32 y = startRow; y < endRow; y++) {
+        s32 *row = &map->values[y * map->width];
         for (u32 x = 0; x < map->width; x++) {
-            u32 val = xxh_hash2d(seed, x, y);
-            val = val % map->maxMagnitude;
-            htw_geo_setMapValue(map, (htw_geo_GridCoord){x, y}, val);
+            float scaledX, scaledY;
+            htw_geo_getHexCellPositionSkewed((htw_geo_GridCoord){x, y}, &scaledX, &scaledY);
+            scaledX *= fill->scale;
+            scaledY *= fill->scale;
+            float val = htw_value2d(fill->seed, scaledX, scaledY);
+            row[x] = floorf(val * map->maxMagnitude);
         }
     }
 }
 
 void htw_geo_fillSmoothNoise(htw_ValueMap* map, u32 seed, float scale) {
-    for (u32 y = 0; y < map->height; y++) {
+    htw_geo_fillSmoothNoiseParallel(map, 1, seed, scale);
+}
+
+void htw_geo_fillSmoothNoiseParallel(htw_ValueMap* map, u32 threadCount, u32 seed, float scale) {
+    htw_geo_SmoothNoiseFill fill = {.map = map, .seed = seed, .scale = scale};
+    htw_parallelFor(map->height, threadCount, fillSmoothNoiseRows, &fill);
+}
+
+typedef struct {
+    htw_ValueMap *map;
+    u32 seed;
+    u32 octaves;
+    s32 posX;
+    s32 posY;
+    float scale;
+    float repeatX;
+    float repeatY;
+} htw_geo_PerlinFill;
+
+/// internal
+static void fillPerlinRows(void *context, u32 startRow, u32 endRow) {
+    htw_geo_PerlinFill *fill = context;
+    htw_ValueMap *map = fill->map;
+    for (u32 y = startRow; y < endRow; y++) {
+        s32 *row = &map->values[y * map->width];
         for (u32 x = 0; x < map->width; x++) {
             float scaledX, scaledY;
-            htw_geo_getHexCellPositionSkewed((htw_geo_GridCoord){x, y}, &scaledX, &scaledY);
-            scaledX *= scale;
-            scaledY *= scale;
-            float val = htw_value2d(seed, scaledX, scaledY);
-            val = floorf(val * map->maxMagnitude);
-            htw_geo_setMapValue(map, (htw_geo_GridCoord){x, y}, val);
+            htw_geo_getHexCellPositionSkewed((htw_geo_GridCoord){x + fill->posX, y + fill->posY}, &scaledX, &scaledY);
+            scaledX *= fill->scale;
+            scaledY *= fill->scale;
+            float val = htw_perlin2dRepeating(fill->seed, scaledX, scaledY, fill->octaves, fill->repeatX, fill->repeatY);
+            row[x] = floorf(val * map->maxMagnitude);
         }
     }
 }
 
 void htw_geo_fillPerlin(htw_ValueMap* map, u32 seed, u32 octaves, s32 posX, s32 posY, float scale, float repeatX, float repeatY) {
-    for (u32 y = 0; y < map->height; y++) {
+    htw_geo_fillPerlinParallel(map, 1, seed, octaves, posX, posY, scale, repeatX, repeatY);
+}
+
+void htw_geo_fillPerlinParallel(htw_ValueMap* map, u32 threadCount, u32 seed, u32 octaves, s32 posX, s32 posY, float scale, float repeatX, float repeatY) {
+    htw_geo_PerlinFill fill = {
+        .map = map,
+        .seed = seed,
+        .octaves = octaves,
+        .posX = posX,
+        .posY = posY,
+        .scale = scale,
+        .repeatX = repeatX,
+        .repeatY = repeatY,
+    };
+    htw_parallelFor(map->height, threadCount, fillPerlinRows, &fill);
+}
+
+typedef struct {
+    htw_ValueMap *map;
+    u32 seed;
+    u32 octaves;
+    s32 posX;
+    s32 posY;
+    u32 samplesPerRepeat;
+    float scale;
+} htw_geo_SimplexFill;
+
+/// internal
+static void fillSimplexRows(void *context, u32 startRow, u32 endRow) {
+    htw_geo_SimplexFill *fill = context;
+    htw_ValueMap *map = fill->map;
+    // sample one row at a time through the batch noise API
+    float *rowX = malloc(sizeof(float) * map->width * 3);
+    float *rowY = rowX + map->width;
+    float *rowValues = rowY + map->width;
+    for (u32 y = startRow; y < endRow; y++) {
         for (u32 x = 0; x < map->width; x++) {
-            float scaledX, scaledY;
-            htw_geo_getHexCellPositionSkewed((htw_geo_GridCoord){x + posX, y + posY}, &scaledX, &scaledY);
-            scaledX *= scale;
-            scaledY *= scale;
-            float val = htw_perlin2dRepeating(seed, scaledX, scaledY, octaves, repeatX, repeatY);
-            val = floorf(val * map->maxMagnitude);
-            htw_geo_setMapValue(map, (htw_geo_GridCoord){x, y}, val);
+            rowX[x] = (x + fill->posX) * fill->scale;
+            rowY[x] = (y + fill->posY) * fill->scale;
+        }
+        htw_simplex2dLayeredBatch(fill->seed, rowX, rowY, rowValues, map->width, fill->samplesPerRepeat, fill->octaves);
+        s32 *row = &map->values[y * map->width];
+        for (u32 x = 0; x < map->width; x++) {
+            row[x] = floorf(rowValues[x] * map->maxMagnitude);
         }
     }
+    free(rowX);
 }
 
 void htw_geo_fillSimplex(htw_ValueMap* map, u32 seed, u32 octaves, s32 posX, s32 posY, u32 repeatInterval, u32 samplesPerRepeat) {
-    float scale = (float)samplesPerRepeat / repeatInterval;
-    for (u32 y = 0; y < map->height; y++) {
-        for (u32 x = 0; x < map->width; x++) {
-            float scaledX = (x + posX) * scale;
-            float scaledY = (y + posY) * scale;
-            float val = htw_simplex2dLayered(seed, scaledX, scaledY, samplesPerRepeat, octaves);
-            val = floorf(val * map->maxMagnitude);
-            htw_geo_setMapValue(map, (htw_geo_GridCoord){x, y}, val);
+    htw_geo_fillSimplexParallel(map, 1, seed, octaves, posX, posY, repeatInterval, samplesPerRepeat);
+}
+
+void htw_geo_fillSimplexParallel(htw_ValueMap* map, u32 threadCount, u32 seed, u32 octaves, s32 posX, s32 posY, u32 repeatInterval, u32 samplesPerRepeat) {
+    htw_geo_SimplexFill fill = {
+        .map = map,
+        .seed = seed,
+        .octaves = octaves,
+        .posX = posX,
+        .posY = posY,
+        .samplesPerRepeat = samplesPerRepeat,
+        .scale = (float)samplesPerRepeat / repeatInterval,
+    };
+    htw_parallelFor(map->height, threadCount, fillSimplexRows, &fill);
+}
+
+/* Chunkmap fills */
+
+typedef struct {
+    htw_ChunkMap *chunkMap;
+    htw_geo_CellField field;
+    const u32 *chunkIndices;
+    htw_geo_GridCoord center;
+    s32 gradStart;
+    s32 gradEnd;
+    float radius;
+} htw_geo_ChunkCircularGradientFill;
+
+/// internal; index of the nth chunk to fill
+static inline u32 selectedChunk(const u32 *chunkIndices, u32 n) {
+    return chunkIndices == NULL ? n : chunkIndices[n];
+}
+
+/// internal; records the selected chunks as changed, creates any selected chunks of a lazy map that aren't in memory
+/// yet, and gives the selected chunks of a double buffered map their back buffers. Done before the fill starts, since
+/// every selected chunk is written anyway, so workers only have to look up where each chunk's writes go
+static void prepareChunksForWrite(htw_ChunkMap *chunkMap, const u32 *chunkIndices, u32 chunkCount) {
+    for (u32 c = 0; c < chunkCount; c++) {
+        htw_geo_getChunkForWrite(chunkMap, selectedChunk(chunkIndices, c));
+    }
+}
+
+/// internal; where writes to a chunk go, once prepareChunksForWrite has run
+static u8 *chunkWriteData(const htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    htw_Chunk *chunks = chunkMap->backChunks != NULL ? chunkMap->backChunks : chunkMap->chunks;
+    return chunks[chunkIndex].cellData;
+}
+
+/// internal; bytes to skip from the end of one row of a chunk's cells to the start of the next, over the halo
+static size_t haloRowGap(const htw_ChunkMap *chunkMap, htw_geo_CellField field) {
+    return (chunkMap->chunkPitch - chunkMap->chunkSize) * field.stride;
+}
+
+/// internal; where a fill walking a chunk's rows writes the field of the cell at [x], [y]: [rowDest], the next position
+/// in the rows, unless the map stores cells in another order
+static u8 *orderedFieldDest(const htw_ChunkMap *chunkMap, htw_geo_CellField field, u8 *fieldData, u8 *rowDest, u32 x, u32 y) {
+    if (chunkMap->cellOrder == HTW_GEO_CELL_ORDER_ROWS) {
+        return rowDest;
+    }
+    return fieldData + (htw_geo_cellCoordToCellIndex(chunkMap, x, y) * field.stride);
+}
+
+/// internal
+static void fillChunkCircularGradients(void *context, u32 start, u32 end) {
+    htw_geo_ChunkCircularGradientFill *fill = context;
+    htw_ChunkMap *chunkMap = fill->chunkMap;
+    for (u32 c = start; c < end; c++) {
+        u32 chunkIndex = selectedChunk(fill->chunkIndices, c);
+        htw_geo_GridCoord root = htw_geo_chunkAndCellToGridCoordinates(chunkMap, chunkIndex, 0);
+        u8 *fieldData = chunkWriteData(chunkMap, chunkIndex) + fill->field.offset;
+        u8 *dest = fieldData;
+        size_t rowGap = haloRowGap(chunkMap, fill->field);
+        for (u32 y = 0; y < chunkMap->chunkSize; y++) {
+            for (u32 x = 0; x < chunkMap->chunkSize; x++) {
+                htw_geo_GridCoord cellCoord = {root.x + x, root.y + y};
+                s32 value = htw_geo_circularGradientByGridCoord(chunkMap, cellCoord, fill->center, fill->gradStart, fill->gradEnd, fill->radius);
+                memcpy(orderedFieldDest(chunkMap, fill->field, fieldData, dest, x, y), &value, sizeof(value));
+                dest += fill->field.stride;
+            }
+            dest += rowGap;
+        }
+    }
+}
+
+void htw_geo_fillChunkMapCircularGradient(htw_ChunkMap *chunkMap, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius) {
+    htw_geo_fillChunkMapCircularGradientParallel(chunkMap, 1, field, chunkIndices, chunkIndexCount, center, gradStart, gradEnd, radius);
+}
+
+void htw_geo_fillChunkMapCircularGradientParallel(htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius) {
+    htw_geo_ChunkCircularGradientFill fill = {
+        .chunkMap = chunkMap,
+        .field = field,
+        .chunkIndices = chunkIndices,
+        .center = center,
+        .gradStart = gradStart,
+        .gradEnd = gradEnd,
+        .radius = radius,
+    };
+    u32 chunkCount = chunkIndices == NULL ? chunkMap->chunkCountX * chunkMap->chunkCountY : chunkIndexCount;
+    prepareChunksForWrite(chunkMap, chunkIndices, chunkCount);
+    htw_parallelFor(chunkCount, threadCount, fillChunkCircularGradients, &fill);
+}
+
+typedef struct {
+    htw_ChunkMap *chunkMap;
+    htw_geo_CellField field;
+    const u32 *chunkIndices;
+    u32 seed;
+    u32 octaves;
+    u32 samplesPerRepeat;
+} htw_geo_ChunkSimplexFill;
+
+/// internal
+static void fillChunkSimplex(void *context, u32 start, u32 end) {
+    htw_geo_ChunkSimplexFill *fill = context;
+    htw_ChunkMap *chunkMap = fill->chunkMap;
+    u32 chunkSize = chunkMap->chunkSize;
+    float scale = (float)fill->samplesPerRepeat / chunkMap->mapWidth;
+    // sample one chunk row at a time through the batch noise API
+    float *rowX = malloc(sizeof(float) * chunkSize * 3);
+    float *rowY = rowX + chunkSize;
+    float *rowValues = rowY + chunkSize;
+    for (u32 c = start; c < end; c++) {
+        u32 chunkIndex = selectedChunk(fill->chunkIndices, c);
+        htw_geo_GridCoord root = htw_geo_chunkAndCellToGridCoordinates(chunkMap, chunkIndex, 0);
+        u8 *fieldData = chunkWriteData(chunkMap, chunkIndex) + fill->field.offset;
+        u8 *dest = fieldData;
+        size_t rowGap = haloRowGap(chunkMap, fill->field);
+        for (u32 y = 0; y < chunkSize; y++) {
+            for (u32 x = 0; x < chunkSize; x++) {
+                rowX[x] = (s32)(root.x + x) * scale;
+                rowY[x] = (s32)(root.y + y) * scale;
+            }
+            htw_simplex2dLayeredBatch(fill->seed, rowX, rowY, rowValues, chunkSize, fill->samplesPerRepeat, fill->octaves);
+            if (chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) {
+                for (u32 x = 0; x < chunkSize; x++) {
+                    memcpy(orderedFieldDest(chunkMap, fill->field, fieldData, dest, x, y), &rowValues[x], sizeof(float));
+                }
+            }
+            else if (fill->field.stride == sizeof(float)) {
+                // dense column (or a map of bare floats); the whole row at once
+                memcpy(dest, rowValues, sizeof(float) * chunkSize);
+                dest += sizeof(float) * chunkSize;
+            }
+            else {
+                for (u32 x = 0; x < chunkSize; x++) {
+                    memcpy(dest, &rowValues[x], sizeof(float));
+                    dest += fill->field.stride;
+                }
+            }
+            dest += rowGap;
         }
     }
+    free(rowX);
 }
 
+void htw_geo_fillChunkMapSimplex(htw_ChunkMap *chunkMap, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, u32 seed, u32 octaves, u32 samplesPerRepeat) {
+    htw_geo_fillChunkMapSimplexParallel(chunkMap, 1, field, chunkIndices, chunkIndexCount, seed, octaves, samplesPerRepeat);
+}
+
+void htw_geo_fillChunkMapSimplexParallel(htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_CellField field, const u32 *chunkIndices, u32 chunkIndexCount, u32 seed, u32 octaves, u32 samplesPerRepeat) {
+    htw_geo_ChunkSimplexFill fill = {
+        .chunkMap = chunkMap,
+        .field = field,
+        .chunkIndices = chunkIndices,
+        .seed = seed,
+        .octaves = octaves,
+        .samplesPerRepeat = samplesPerRepeat,
+    };
+    u32 chunkCount = chunkIndices == NULL ? chunkMap->chunkCountX * chunkMap->chunkCountY : chunkIndexCount;
+    prepareChunksForWrite(chunkMap, chunkIndices, chunkCount);
+    htw_parallelFor(chunkCount, threadCount, fillChunkSimplex, &fill);
+}
+
+/* Single cell values */
+
 s32 htw_geo_circularGradientByGridCoord(const htw_ChunkMap *chunkMap, htw_geo_GridCoord cellCoord, htw_geo_GridCoord center, s32 gradStart, s32 gradEnd, float radius) {
     float distance = htw_geo_hexCartesianDistance(chunkMap, cellCoord, center);
     s32 gradValue = 0;
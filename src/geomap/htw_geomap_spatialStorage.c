@@ -4,83 +4,402 @@
  *
  * The links array functions like a single linked list, but instead of storing data the array index of each link is used
  * Each link in the links array corresponds to an element of the underlying array
- * Each pointer in the hashSlots array points to the link with the same index as the first item at the hashed location, or NULL if nothing is there
- * Links point to the link with the same index as the next item at the same hashed location
+ * The links array is split into fixed size segments, allocated as item indices reach them, so it never has to be copied to grow
+ * Each hash slot holds the index of the first item at the hashed location, and each link the index of the next item at
+ * the same hashed location. Indices are 32 bits and offset by 1, so empty slots and list ends are 0
+ * Each link also records the coordinate its item was inserted at, so items at other coordinates that hash to the same slot can be skipped
+ * Links also refer back to whatever refers to them (the hash slot or the previous item), so removing an item never has to search for it
+ * Range queries skip empty parts of the world with a count of the items in each short strip of cells along a row; strips are used instead
+ * of square blocks so that a wrapped row is never split partway through one
+ * When the table gets too full, a table twice the size replaces it, and the old table's slots are moved over a few at a time.
+ * Doubling the size splits each old slot into two new ones, so a hash's old slot shows whether it has been moved yet
  */
+#include <string.h>
 #include "htw_geomap.h"
 #include "htw_core.h"
 #include "htw_random.h"
 
-static size_t getItemIndex(htw_SpatialStorage *ss, htw_Link *link);
+static inline htw_Link *getLink(htw_SpatialStorage *ss, size_t itemIndex);
+static inline int hasLink(htw_SpatialStorage *ss, size_t itemIndex);
+static inline u32 getSlotHash(htw_geo_GridCoord coord);
+static inline htw_SpatialTable *getTableForHash(htw_SpatialStorage *ss, u32 hash);
+static inline htw_SpatialTable *getTableForCoord(htw_SpatialStorage *ss, htw_geo_GridCoord coord);
+static inline u32 getHead(htw_SpatialStorage *ss, htw_geo_GridCoord coord);
+static inline u32 skipToCoord(htw_SpatialStorage *ss, u32 link, htw_geo_GridCoord coord);
+static inline void linkAtHead(htw_SpatialStorage *ss, htw_SpatialTable *table, u32 slotIndex, u32 itemIndex, htw_geo_GridCoord coord);
+static inline void unlink(htw_SpatialStorage *ss, u32 itemIndex);
+static inline u32 *getStripCount(htw_SpatialTable *table, s32 stripX, s32 y);
+static int isStripOccupied(htw_SpatialStorage *ss, s32 stripX, s32 y);
+static int reserveItem(htw_SpatialStorage *ss, size_t itemIndex);
+static inline int isTooFull(htw_SpatialStorage *ss, size_t itemCount);
+static void growToFit(htw_SpatialStorage *ss, size_t itemCount);
+static void migrateSlots(htw_SpatialStorage *ss, u32 slotCount);
+
+// Sort key for htw_geo_spatialMoveMany
+typedef struct {
+    u32 hashSlotIndex;
+    u32 moveIndex;
+} htw_geo_SlotMove;
+
+// Bits of the slot index sorted per pass of the radix sort in htw_geo_spatialMoveMany
+#define HTW_GEO_SLOT_RADIX_BITS 11
+// Moves ahead that htw_geo_spatialMoveMany starts fetching links for
+#define HTW_GEO_SPATIAL_PREFETCH_DISTANCE 16
+// log2 of the number of cells in a row strip counted by stripCounts
+#define HTW_GEO_SPATIAL_STRIP_SHIFT 4
+// Old slots moved to a growing table by each insert, move, or remove. Growth starts when the new table is a quarter full,
+// and it has to finish before that doubles, so this only has to be more than 2
+#define HTW_GEO_SPATIAL_MIGRATE_STEP 4
+
+// Output of a range query, and the items found so far
+typedef struct {
+    htw_SpatialStorage *ss;
+    size_t *indices;
+    size_t maxIndices;
+    size_t count;
+} htw_geo_SpatialQuery;
+
+/// internal; a table with [slotCount] empty slots, which must be a power of 2
+static htw_SpatialTable createTable(u32 slotCount) {
+    // a quarter as many strip counts as hash slots; even if every item is in its own strip, at most 2 share a count
+    u32 stripCountSize = slotCount / 4 > 0 ? slotCount / 4 : 1;
+    return (htw_SpatialTable){
+        .slots = calloc(slotCount, sizeof(u32)),
+        .slotMask = slotCount - 1,
+        .stripCounts = calloc(stripCountSize, sizeof(u32)),
+        .stripMask = stripCountSize - 1,
+    };
+}
+
+/// internal
+static void destroyTable(htw_SpatialTable *table) {
+    free(table->slots);
+    free(table->stripCounts);
+    *table = (htw_SpatialTable){0};
+}
 
 htw_SpatialStorage *htw_geo_createSpatialStorage(size_t maxItemCount) {
     htw_SpatialStorage *newStorage = calloc(1, sizeof(htw_SpatialStorage));
-    newStorage->maxItemCount = maxItemCount;
-    // Gives a load factor between 0.25 and 0.5
-    newStorage->hashSlotCount = htw_nextPow(maxItemCount * 2); // TODO: allow some control over hash table size; this is a decent compromise
-    newStorage->hashBitMask = newStorage->hashSlotCount - 1; // bits up to hashSlotCount = 1
-    newStorage->links = calloc(maxItemCount, sizeof(htw_Link));
-    newStorage->hashSlots = calloc(newStorage->hashSlotCount, sizeof(htw_Link*));
+    newStorage->maxItemCount = MIN(maxItemCount, HTW_GEO_SPATIAL_MAX_ITEM_INDEX + 1);
+    newStorage->segmentCapacity = (newStorage->maxItemCount + HTW_GEO_SPATIAL_LINK_SEGMENT_SIZE - 1) >> HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT;
+    newStorage->linkSegments = calloc(MAX(newStorage->segmentCapacity, 1), sizeof(htw_Link*));
+    for (size_t i = 0; i < newStorage->segmentCapacity; i++) {
+        newStorage->linkSegments[i] = calloc(HTW_GEO_SPATIAL_LINK_SEGMENT_SIZE, sizeof(htw_Link));
+    }
+    // Gives a load factor between 0.25 and 0.5, until more items than expected are inserted
+    newStorage->table = createTable(htw_nextPow(MIN(newStorage->maxItemCount * 2, HTW_GEO_SPATIAL_SLOT_REF)));
     return newStorage;
 }
 
-void htw_geo_spatialInsert(htw_SpatialStorage *ss, htw_geo_GridCoord coord, size_t itemIndex) {
-    size_t hashSlotIndex = xxh_hash2d(0, coord.x, coord.y) & ss->hashBitMask;
-    htw_Link **head = &ss->hashSlots[hashSlotIndex];
-    while (*head != NULL) {
-        head = &(*head)->next;
+void htw_geo_destroySpatialStorage(htw_SpatialStorage *ss) {
+    for (size_t i = 0; i < ss->segmentCapacity; i++) {
+        free(ss->linkSegments[i]);
     }
-    *head = &ss->links[itemIndex];
+    free(ss->linkSegments);
+    destroyTable(&ss->table);
+    destroyTable(&ss->oldTable);
+    free(ss);
+}
+
+void htw_geo_spatialInsert(htw_SpatialStorage *ss, htw_geo_GridCoord coord, size_t itemIndex) {
+    if (!hasLink(ss, itemIndex) && !reserveItem(ss, itemIndex)) return;
+    unlink(ss, itemIndex);
+    if (isTooFull(ss, ss->itemCount + 1)) growToFit(ss, ss->itemCount + 1);
+    u32 hash = getSlotHash(coord);
+    htw_SpatialTable *table = getTableForHash(ss, hash);
+    // new items go first, so nothing else in the slot has to be visited
+    linkAtHead(ss, table, hash & table->slotMask, itemIndex, coord);
+    if (ss->oldTable.slots != NULL) migrateSlots(ss, HTW_GEO_SPATIAL_MIGRATE_STEP);
 }
 
 void htw_geo_spatialRemove(htw_SpatialStorage *ss, htw_geo_GridCoord coord, size_t itemIndex) {
-    size_t hashSlotIndex = xxh_hash2d(0, coord.x, coord.y) & ss->hashBitMask;
-    htw_Link **head = &ss->hashSlots[hashSlotIndex];
-    while (*head != NULL) {
-        size_t headIndex = getItemIndex(ss, *head);
-        if (headIndex == itemIndex) {
-            htw_Link *next = (*head)->next;
-            (*head)->next = NULL;
-            *head = next;
-            break;
-        }
-        head = &(*head)->next;
-    }
+    if (!hasLink(ss, itemIndex)) return;
+    unlink(ss, itemIndex);
+    if (ss->oldTable.slots != NULL) migrateSlots(ss, HTW_GEO_SPATIAL_MIGRATE_STEP);
 }
 
 void htw_geo_spatialMove(htw_SpatialStorage *ss, htw_geo_GridCoord oldCoord, htw_geo_GridCoord newCoord, size_t itemIndex) {
-    htw_geo_spatialRemove(ss, oldCoord, itemIndex);
     htw_geo_spatialInsert(ss, newCoord, itemIndex);
 }
 
+void htw_geo_spatialMoveMany(htw_SpatialStorage *ss, const htw_geo_SpatialMove *moves, size_t moveCount) {
+    for (size_t i = 0; i < moveCount; i++) {
+        if (!hasLink(ss, moves[i].itemIndex) && !reserveItem(ss, moves[i].itemIndex)) return;
+    }
+    // every item leaves its old slot before any arrive. Old slots are in no particular order, so this goes in the
+    // caller's order, which is often item order, and so through the links in memory order
+    for (size_t i = 0; i < moveCount; i++) {
+        // knowing the upcoming moves lets the links they touch be fetched ahead: first the moved link, then once that
+        // has arrived, its neighbors
+        if (i + HTW_GEO_SPATIAL_PREFETCH_DISTANCE < moveCount) {
+            __builtin_prefetch(getLink(ss, moves[i + HTW_GEO_SPATIAL_PREFETCH_DISTANCE].itemIndex), 1);
+        }
+        if (i + (HTW_GEO_SPATIAL_PREFETCH_DISTANCE / 2) < moveCount) {
+            htw_Link *upcoming = getLink(ss, moves[i + (HTW_GEO_SPATIAL_PREFETCH_DISTANCE / 2)].itemIndex);
+            if (upcoming->prev != 0 && !(upcoming->prev & HTW_GEO_SPATIAL_SLOT_REF)) {
+                __builtin_prefetch(getLink(ss, upcoming->prev - 1), 1);
+            }
+            if (upcoming->next != 0) {
+                __builtin_prefetch(getLink(ss, upcoming->next - 1), 1);
+            }
+        }
+        unlink(ss, moves[i].itemIndex);
+    }
+    // grown before sorting, so the sort is by slots in the table the items will end up in
+    if (isTooFull(ss, ss->itemCount + moveCount)) growToFit(ss, ss->itemCount + moveCount);
+
+    htw_geo_SlotMove *buffer = malloc(sizeof(htw_geo_SlotMove) * moveCount * 2);
+    htw_geo_SlotMove *sorted = buffer;
+    htw_geo_SlotMove *scratch = buffer + moveCount;
+    for (size_t i = 0; i < moveCount; i++) {
+        sorted[i] = (htw_geo_SlotMove){getSlotHash(moves[i].newCoord) & ss->table.slotMask, i};
+    }
+    // least significant digit radix sort; linear, and stable, so moves to the same slot keep their order
+    u32 slotBits = 32 - __builtin_clz(ss->table.slotMask | 1);
+    for (u32 shift = 0; shift < slotBits; shift += HTW_GEO_SLOT_RADIX_BITS) {
+        size_t offsets[1 << HTW_GEO_SLOT_RADIX_BITS] = {0};
+        u32 digitMask = (1 << HTW_GEO_SLOT_RADIX_BITS) - 1;
+        for (size_t i = 0; i < moveCount; i++) {
+            offsets[(sorted[i].hashSlotIndex >> shift) & digitMask]++;
+        }
+        size_t total = 0;
+        for (u32 d = 0; d <= digitMask; d++) {
+            size_t count = offsets[d];
+            offsets[d] = total;
+            total += count;
+        }
+        for (size_t i = 0; i < moveCount; i++) {
+            scratch[offsets[(sorted[i].hashSlotIndex >> shift) & digitMask]++] = sorted[i];
+        }
+        htw_geo_SlotMove *swap = sorted;
+        sorted = scratch;
+        scratch = swap;
+    }
+
+    for (size_t i = 0; i < moveCount; i++) {
+        if (i + HTW_GEO_SPATIAL_PREFETCH_DISTANCE < moveCount) {
+            htw_geo_SlotMove upcoming = sorted[i + HTW_GEO_SPATIAL_PREFETCH_DISTANCE];
+            __builtin_prefetch(getLink(ss, moves[upcoming.moveIndex].itemIndex), 1);
+            __builtin_prefetch(&ss->table.slots[upcoming.hashSlotIndex], 1);
+        }
+        if (i + (HTW_GEO_SPATIAL_PREFETCH_DISTANCE / 2) < moveCount) {
+            // the slot's current first item gets a new prev
+            u32 head = ss->table.slots[sorted[i + (HTW_GEO_SPATIAL_PREFETCH_DISTANCE / 2)].hashSlotIndex];
+            if (head != 0) {
+                __builtin_prefetch(getLink(ss, head - 1), 1);
+            }
+        }
+        const htw_geo_SpatialMove *move = &moves[sorted[i].moveIndex];
+        if (ss->oldTable.slots == NULL) {
+            linkAtHead(ss, &ss->table, sorted[i].hashSlotIndex, move->itemIndex, move->newCoord);
+        }
+        else {
+            u32 hash = getSlotHash(move->newCoord);
+            htw_SpatialTable *table = getTableForHash(ss, hash);
+            linkAtHead(ss, table, hash & table->slotMask, move->itemIndex, move->newCoord);
+        }
+    }
+    free(buffer);
+    // as much migration as the same moves made one at a time
+    if (ss->oldTable.slots != NULL) migrateSlots(ss, MIN(moveCount * HTW_GEO_SPATIAL_MIGRATE_STEP, HTW_GEO_SPATIAL_SLOT_REF));
+}
+
 size_t htw_geo_spatialItemCountAt(htw_SpatialStorage *ss, htw_geo_GridCoord coord) {
-    size_t hashSlotIndex = xxh_hash2d(0, coord.x, coord.y) & ss->hashBitMask;
     size_t itemCount = 0;
-    htw_Link **head = &ss->hashSlots[hashSlotIndex];
-    while (*head != NULL) {
-        head = &(*head)->next;
+    for (u32 link = skipToCoord(ss, getHead(ss, coord), coord); link != 0; link = skipToCoord(ss, getLink(ss, link - 1)->next, coord)) {
         itemCount++;
     }
     return itemCount;
 }
 
 size_t htw_geo_spatialFirstIndex(htw_SpatialStorage *ss, htw_geo_GridCoord coord) {
-    size_t hashSlotIndex = xxh_hash2d(0, coord.x, coord.y) & ss->hashBitMask;
-    htw_Link *head = ss->hashSlots[hashSlotIndex];
-    if (head != NULL) {
-        return getItemIndex(ss, head);
-    } else {
-        // FIXME: can't return null or false, how to correctly convey when there is nothing at the provided coord?
-        // Should either be caller's responsibility to check that count at this location > 0 first
-        // Or should return '-1' and rely on caller to check for OOB indicies
-        return -1;
-    }
+    u32 link = skipToCoord(ss, getHead(ss, coord), coord);
+    return link == 0 ? HTW_GEO_SPATIAL_NO_ITEM : link - 1;
 }
 
 size_t htw_geo_spatialNextIndex(htw_SpatialStorage *ss, size_t previousIndex) {
+    htw_Link *previous = getLink(ss, previousIndex);
+    u32 link = skipToCoord(ss, previous->next, previous->coord);
+    return link == 0 ? HTW_GEO_SPATIAL_NO_ITEM : link - 1;
+}
+
+/// internal; htw_geo_RowSpanFn that adds every item at each cell of the span, skipping strips without items
+static void querySpan(void *context, s32 row, s32 startX, s32 endX) {
+    htw_geo_SpatialQuery *query = context;
+    htw_SpatialStorage *ss = query->ss;
+    s32 stripWidth = 1 << HTW_GEO_SPATIAL_STRIP_SHIFT;
+    for (s32 stripX = startX >> HTW_GEO_SPATIAL_STRIP_SHIFT; stripX <= endX >> HTW_GEO_SPATIAL_STRIP_SHIFT; stripX++) {
+        if (!isStripOccupied(ss, stripX, row)) continue;
+        s32 first = MAX(startX, stripX * stripWidth);
+        s32 last = MIN(endX, (stripX * stripWidth) + stripWidth - 1);
+        for (s32 x = first; x <= last; x++) {
+            htw_geo_GridCoord coord = {x, row};
+            for (u32 link = skipToCoord(ss, getHead(ss, coord), coord); link != 0; link = skipToCoord(ss, getLink(ss, link - 1)->next, coord)) {
+                if (query->count < query->maxIndices) {
+                    query->indices[query->count] = link - 1;
+                }
+                query->count++;
+            }
+        }
+    }
+}
 
+size_t htw_geo_spatialQueryRadius(htw_SpatialStorage *ss, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices) {
+    htw_geo_SpatialQuery query = {ss, outIndices, maxIndices, 0};
+    htw_geo_forEachHexAreaSpan(wrapMap, center, radius, 0, querySpan, &query);
+    return query.count;
 }
 
-static size_t getItemIndex(htw_SpatialStorage *ss, htw_Link *link) {
-    return link - ss->links;
+size_t htw_geo_spatialQueryRing(htw_SpatialStorage *ss, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices, size_t maxIndices) {
+    htw_geo_SpatialQuery query = {ss, outIndices, maxIndices, 0};
+    htw_geo_forEachHexAreaSpan(wrapMap, center, radius, 1, querySpan, &query);
+    return query.count;
+}
+
+static inline htw_Link *getLink(htw_SpatialStorage *ss, size_t itemIndex) {
+    return &ss->linkSegments[itemIndex >> HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT][itemIndex & (HTW_GEO_SPATIAL_LINK_SEGMENT_SIZE - 1)];
+}
+
+// Whether [itemIndex]'s link is allocated; items without one aren't in the storage
+static inline int hasLink(htw_SpatialStorage *ss, size_t itemIndex) {
+    return itemIndex < ss->maxItemCount && ss->linkSegments[itemIndex >> HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT] != NULL;
+}
+
+static inline u32 getSlotHash(htw_geo_GridCoord coord) {
+    return xxh_hash2d(0, coord.x, coord.y);
+}
+
+static inline htw_SpatialTable *getTableForHash(htw_SpatialStorage *ss, u32 hash) {
+    if (ss->oldTable.slots != NULL && (hash & ss->oldTable.slotMask) >= ss->migratedSlots) {
+        return &ss->oldTable;
+    }
+    return &ss->table;
+}
+
+static inline htw_SpatialTable *getTableForCoord(htw_SpatialStorage *ss, htw_geo_GridCoord coord) {
+    // only worth hashing while there are two tables
+    return ss->oldTable.slots == NULL ? &ss->table : getTableForHash(ss, getSlotHash(coord));
+}
+
+static inline u32 getHead(htw_SpatialStorage *ss, htw_geo_GridCoord coord) {
+    u32 hash = getSlotHash(coord);
+    htw_SpatialTable *table = getTableForHash(ss, hash);
+    return table->slots[hash & table->slotMask];
+}
+
+static inline void linkAtHead(htw_SpatialStorage *ss, htw_SpatialTable *table, u32 slotIndex, u32 itemIndex, htw_geo_GridCoord coord) {
+    (*getStripCount(table, coord.x >> HTW_GEO_SPATIAL_STRIP_SHIFT, coord.y))++;
+    htw_Link *link = getLink(ss, itemIndex);
+    u32 *head = &table->slots[slotIndex];
+    link->next = *head;
+    link->prev = HTW_GEO_SPATIAL_SLOT_REF | slotIndex;
+    link->coord = coord;
+    if (*head != 0) {
+        getLink(ss, *head - 1)->prev = itemIndex + 1;
+    }
+    *head = itemIndex + 1;
+    ss->itemCount++;
+}
+
+static inline void unlink(htw_SpatialStorage *ss, u32 itemIndex) {
+    htw_Link *link = getLink(ss, itemIndex);
+    if (link->prev == 0) return;
+    htw_SpatialTable *table = getTableForCoord(ss, link->coord);
+    (*getStripCount(table, link->coord.x >> HTW_GEO_SPATIAL_STRIP_SHIFT, link->coord.y))--;
+    if (link->prev & HTW_GEO_SPATIAL_SLOT_REF) {
+        table->slots[link->prev & ~HTW_GEO_SPATIAL_SLOT_REF] = link->next;
+    }
+    else {
+        getLink(ss, link->prev - 1)->next = link->next;
+    }
+    if (link->next != 0) {
+        getLink(ss, link->next - 1)->prev = link->prev;
+    }
+    link->next = 0;
+    link->prev = 0;
+    ss->itemCount--;
+}
+
+static inline u32 *getStripCount(htw_SpatialTable *table, s32 stripX, s32 y) {
+    return &table->stripCounts[xxh_hash2d(1, stripX, y) & table->stripMask];
+}
+
+static int isStripOccupied(htw_SpatialStorage *ss, s32 stripX, s32 y) {
+    // while growing, a strip's items can be split between both tables
+    return *getStripCount(&ss->table, stripX, y) != 0
+        || (ss->oldTable.slots != NULL && *getStripCount(&ss->oldTable, stripX, y) != 0);
+}
+
+// First item, starting from [link], at [coord]; 0 if there are none
+static inline u32 skipToCoord(htw_SpatialStorage *ss, u32 link, htw_geo_GridCoord coord) {
+    while (link != 0 && !htw_geo_isEqualGridCoords(getLink(ss, link - 1)->coord, coord)) {
+        link = getLink(ss, link - 1)->next;
+    }
+    return link;
+}
+
+// Makes room for [itemIndex]'s link, allocating its segment if it doesn't have one yet; 0 if it's too large to store.
+// Only the list of segments is ever copied, which is a pointer per HTW_GEO_SPATIAL_LINK_SEGMENT_SIZE links
+static int reserveItem(htw_SpatialStorage *ss, size_t itemIndex) {
+    if (itemIndex > HTW_GEO_SPATIAL_MAX_ITEM_INDEX) {
+        fprintf(stderr, "Spatial storage item index %zu is larger than the maximum of %u\n", itemIndex, HTW_GEO_SPATIAL_MAX_ITEM_INDEX);
+        return 0;
+    }
+    size_t segment = itemIndex >> HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT;
+    if (segment >= ss->segmentCapacity) {
+        size_t maxSegments = ((size_t)HTW_GEO_SPATIAL_MAX_ITEM_INDEX >> HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT) + 1;
+        size_t segmentCapacity = MIN(MAX(segment + 1, ss->segmentCapacity * 2), maxSegments);
+        ss->linkSegments = realloc(ss->linkSegments, segmentCapacity * sizeof(htw_Link*));
+        memset(&ss->linkSegments[ss->segmentCapacity], 0, (segmentCapacity - ss->segmentCapacity) * sizeof(htw_Link*));
+        ss->segmentCapacity = segmentCapacity;
+    }
+    // the segments in between stay unallocated until an item is inserted into them
+    if (ss->linkSegments[segment] == NULL) ss->linkSegments[segment] = calloc(HTW_GEO_SPATIAL_LINK_SEGMENT_SIZE, sizeof(htw_Link));
+    ss->maxItemCount = MAX(ss->maxItemCount, itemIndex + 1);
+    return 1;
+}
+
+// Moves up to [slotCount] of the old table's slots to the new one, which must be growing, then frees the old table once they are all moved
+static void migrateSlots(htw_SpatialStorage *ss, u32 slotCount) {
+    htw_SpatialTable *oldTable = &ss->oldTable;
+    u32 end = MIN(ss->migratedSlots + (u64)slotCount, (u64)oldTable->slotMask + 1);
+    for (u32 s = ss->migratedSlots; s < end; s++) {
+        u32 link = oldTable->slots[s];
+        if (link == 0) continue;
+        // moved from the last item back, so each new slot ends up in the same newest first order
+        while (getLink(ss, link - 1)->next != 0) {
+            link = getLink(ss, link - 1)->next;
+        }
+        while (1) {
+            htw_Link *moving = getLink(ss, link - 1);
+            u32 prev = moving->prev;
+            (*getStripCount(oldTable, moving->coord.x >> HTW_GEO_SPATIAL_STRIP_SHIFT, moving->coord.y))--;
+            ss->itemCount--;
+            linkAtHead(ss, &ss->table, getSlotHash(moving->coord) & ss->table.slotMask, link - 1, moving->coord);
+            if (prev & HTW_GEO_SPATIAL_SLOT_REF) break;
+            link = prev;
+        }
+        oldTable->slots[s] = 0;
+    }
+    ss->migratedSlots = end;
+    if (end == oldTable->slotMask + 1) {
+        destroyTable(oldTable);
+        ss->migratedSlots = 0;
+    }
+}
+
+// More than half full with [itemCount] items, and still able to grow
+static inline int isTooFull(htw_SpatialStorage *ss, size_t itemCount) {
+    return itemCount > (ss->table.slotMask + 1) / 2 && ss->table.slotMask + 1 < HTW_GEO_SPATIAL_SLOT_REF;
+}
+
+// Starts doubling the table until it is at most half full with [itemCount] items. Doubling again before the last
+// migration has finished completes it first
+static void growToFit(htw_SpatialStorage *ss, size_t itemCount) {
+    while (isTooFull(ss, itemCount)) {
+        if (ss->oldTable.slots != NULL) migrateSlots(ss, HTW_GEO_SPATIAL_SLOT_REF);
+        ss->oldTable = ss->table;
+        ss->table = createTable((ss->table.slotMask + 1) * 2);
+        ss->migratedSlots = 0;
+    }
 }
@@ -0,0 +1,228 @@
+/* Visiting every cell of a chunkmap along with its hex neighbors, without a full coordinate lookup per neighbor, and
+ * keeping chunk halos up to date for code that reads neighbors
+ */
+#include <string.h>
+#include "htw_geomap.h"
+#include "htw_core.h"
+
+/// internal; [chunkData] must already be set
+static void initStencil(htw_geo_StencilIterator *iter, const htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    iter->chunkMap = chunkMap;
+    iter->chunkIndex = chunkIndex;
+    for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+        htw_geo_GridCoord dir = htw_geo_hexGridDirections[d];
+        iter->neighborOffsets[d] = ((ptrdiff_t)dir.y * chunkMap->chunkPitch + dir.x) * (ptrdiff_t)chunkMap->cellDataSize;
+    }
+    // with a halo, even the outer ring's neighbors are in the chunk's own memory
+    iter->edgeWidth = chunkMap->haloWidth > 0 ? 0 : 1;
+    // nextStencilCell advances before filling the iterator, so start on the end of the row before the first
+    iter->cellIndex = (u32)-1;
+    iter->x = chunkMap->chunkSize - 1;
+    iter->y = (u32)-1;
+    iter->coord = htw_geo_chunkAndCellToGridCoordinates(chunkMap, chunkIndex, 0);
+    iter->coord.x += iter->x;
+    iter->coord.y -= 1;
+}
+
+/// internal; hex directions cover every chunk offset a neighbor can be in, and (1, 1) and (-1, -1) are never needed
+static void setNeighborChunk(htw_geo_StencilIterator *iter, htw_geo_GridCoord chunkOffset, u8 *cellData) {
+    iter->chunkData[chunkOffset.y + 1][chunkOffset.x + 1] = cellData;
+}
+
+/// internal; [writeMap] is the same map, or NULL if the walk may only read
+static void beginStencil(htw_geo_StencilIterator *iter, const htw_ChunkMap *chunkMap, htw_ChunkMap *writeMap, u32 chunkIndex) {
+    *iter = (htw_geo_StencilIterator){0};
+    iter->writeMap = writeMap;
+    // opened for writing later, by the first htw_geo_getStencilWriteCell
+    iter->chunkData[1][1] = htw_geo_getChunk(chunkMap, chunkIndex);
+    for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+        htw_geo_GridCoord chunkOffset = htw_geo_hexGridDirections[d];
+        u32 neighborChunk = htw_geo_getChunkIndexAtOffset(chunkMap, chunkIndex, chunkOffset);
+        setNeighborChunk(iter, chunkOffset, htw_geo_getChunk(chunkMap, neighborChunk));
+    }
+    initStencil(iter, chunkMap, chunkIndex);
+}
+
+void htw_geo_beginChunkStencil(htw_geo_StencilIterator *iter, htw_ChunkMap *chunkMap, u32 chunkIndex) {
+    beginStencil(iter, chunkMap, chunkMap, chunkIndex);
+}
+
+u8 *htw_geo_openStencilWriteData(const htw_geo_StencilIterator *iter) {
+    // kernels get the iterator as const, but it belongs to the walk that passed it, which is never const
+    htw_geo_StencilIterator *walk = (htw_geo_StencilIterator*)iter;
+    if (walk->writeMap == NULL) {
+        fprintf(stderr, "Stencil kernel tried to write during a read-only pass\n");
+        return NULL;
+    }
+    walk->writeData = htw_geo_getChunkForWrite(walk->writeMap, walk->chunkIndex);
+    if (walk->writeMap->backChunks == NULL) {
+        // a lazy map's chunk that was only read may have been the shared zero chunk until now; read it where it's written
+        walk->chunkData[1][1] = walk->writeData;
+        walk->cell = walk->writeData + walk->cellOffset;
+    }
+    return walk->writeData;
+}
+
+/// internal; neighbor in [direction] of a cell on the chunk's outer ring, which may be in another chunk
+static void *borderNeighbor(const htw_geo_StencilIterator *iter, int direction) {
+    const htw_ChunkMap *chunkMap = iter->chunkMap;
+    s32 chunkSize = chunkMap->chunkSize;
+    htw_geo_GridCoord dir = htw_geo_hexGridDirections[direction];
+    s32 x = (s32)iter->x + dir.x;
+    s32 y = (s32)iter->y + dir.y;
+    // a neighbor is never more than one cell past the edge, so a compare is enough to find which chunk it is in
+    s32 chunkOffsetX = x < 0 ? -1 : (x >= chunkSize ? 1 : 0);
+    s32 chunkOffsetY = y < 0 ? -1 : (y >= chunkSize ? 1 : 0);
+    x -= chunkOffsetX * chunkSize;
+    y -= chunkOffsetY * chunkSize;
+    u8 *cellData = iter->chunkData[chunkOffsetY + 1][chunkOffsetX + 1];
+    if (chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) {
+        return cellData + (htw_geo_cellCoordToCellIndex(chunkMap, x, y) * chunkMap->cellDataSize);
+    }
+    return cellData + (((y * chunkMap->chunkPitch) + x) * chunkMap->cellDataSize);
+}
+
+/// internal; advanceStencil for maps that don't store cells in rows. Visits cells in cellIndex order, and finds every
+/// neighbor by position, since neighbors aren't a constant distance apart in memory
+static int advanceOrderedStencil(htw_geo_StencilIterator *iter) {
+    const htw_ChunkMap *chunkMap = iter->chunkMap;
+    htw_geo_GridCoord chunkRoot = {iter->coord.x - (s32)iter->x, iter->coord.y - (s32)iter->y};
+    iter->cellIndex++;
+    if (iter->cellIndex == chunkMap->cellsPerChunk) {
+        return 0;
+    }
+    htw_geo_GridCoord cellCoord = htw_geo_cellIndexToCellCoord(chunkMap, iter->cellIndex);
+    iter->x = cellCoord.x;
+    iter->y = cellCoord.y;
+    iter->coord = (htw_geo_GridCoord){chunkRoot.x + cellCoord.x, chunkRoot.y + cellCoord.y};
+
+    iter->cellOffset = iter->cellIndex * chunkMap->cellDataSize;
+    iter->cell = iter->chunkData[1][1] + iter->cellOffset;
+    for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+        iter->neighbors[d] = borderNeighbor(iter, d);
+    }
+    return 1;
+}
+
+/// internal
+static inline int advanceStencil(htw_geo_StencilIterator *iter) {
+    if (iter->chunkMap->cellOrder != HTW_GEO_CELL_ORDER_ROWS) {
+        return advanceOrderedStencil(iter);
+    }
+    u32 chunkSize = iter->chunkMap->chunkSize;
+    iter->cellIndex++;
+    iter->x++;
+    iter->coord.x++;
+    if (iter->x == chunkSize) {
+        iter->x = 0;
+        iter->y++;
+        iter->coord.x -= chunkSize;
+        iter->coord.y++;
+    }
+    if (iter->y == chunkSize) {
+        return 0;
+    }
+
+    iter->cellOffset = ((iter->y * iter->chunkMap->chunkPitch) + iter->x) * iter->chunkMap->cellDataSize;
+    u8 *cell = iter->chunkData[1][1] + iter->cellOffset;
+    iter->cell = cell;
+    u32 edge = iter->edgeWidth;
+    if (iter->x - edge < chunkSize - (2 * edge) && iter->y - edge < chunkSize - (2 * edge)) {
+        // interior; unsigned wrap makes x < edge fail the compare too
+        for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+            iter->neighbors[d] = cell + iter->neighborOffsets[d];
+        }
+    }
+    else {
+        for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+            iter->neighbors[d] = borderNeighbor(iter, d);
+        }
+    }
+    return 1;
+}
+
+int htw_geo_nextStencilCell(htw_geo_StencilIterator *iter) {
+    return advanceStencil(iter);
+}
+
+typedef struct {
+    const htw_ChunkMap *chunkMap;
+    htw_ChunkMap *writeMap; // NULL for htw_geo_forEachCellStencilRead
+    htw_geo_StencilKernel kernel;
+    void *context;
+} htw_geo_StencilPass;
+
+/// internal
+static void runStencilOnChunks(void *context, u32 start, u32 end) {
+    htw_geo_StencilPass *pass = context;
+    htw_geo_StencilIterator iter;
+    for (u32 c = start; c < end; c++) {
+        beginStencil(&iter, pass->chunkMap, pass->writeMap, c);
+        while (advanceStencil(&iter)) {
+            pass->kernel(pass->context, &iter);
+        }
+    }
+}
+
+void htw_geo_forEachCellStencil(htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_StencilKernel kernel, void *context) {
+    u32 chunkCount = chunkMap->chunkCountX * chunkMap->chunkCountY;
+    // chunks are opened for writing by the first write from their kernels, so a pass that only reads copies and records
+    // nothing
+    htw_geo_StencilPass pass = {
+        .chunkMap = chunkMap,
+        .writeMap = chunkMap,
+        .kernel = kernel,
+        .context = context,
+    };
+    htw_parallelFor(chunkCount, threadCount, runStencilOnChunks, &pass);
+}
+
+void htw_geo_forEachCellStencilRead(const htw_ChunkMap *chunkMap, u32 threadCount, htw_geo_StencilKernel kernel, void *context) {
+    htw_geo_StencilPass pass = {
+        .chunkMap = chunkMap,
+        .kernel = kernel,
+        .context = context,
+    };
+    htw_parallelFor(chunkMap->chunkCountX * chunkMap->chunkCountY, threadCount, runStencilOnChunks, &pass);
+}
+
+/// internal; first cell and size, along one axis, of the part of a chunk next to the chunk at [chunkOffset] along that
+/// axis (-1, 0, or 1), and where that part goes in the other chunk's halo
+static void haloSpan(const htw_ChunkMap *chunkMap, s32 chunkOffset, s32 *source, s32 *dest, s32 *size) {
+    s32 chunkSize = chunkMap->chunkSize;
+    s32 halo = chunkMap->haloWidth;
+    switch (chunkOffset) {
+        case -1: *source = 0; *dest = chunkSize; *size = halo; break;
+        case 1: *source = chunkSize - halo; *dest = -halo; *size = halo; break;
+        default: *source = 0; *dest = 0; *size = chunkSize; break;
+    }
+}
+
+void htw_geo_syncHalos(htw_ChunkMap *chunkMap, const u32 *dirtyChunks, u32 dirtyChunkCount) {
+    if (chunkMap->haloWidth == 0) return;
+    u32 chunkCount = dirtyChunks == NULL ? chunkMap->chunkCountX * chunkMap->chunkCountY : dirtyChunkCount;
+    size_t rowBytes = chunkMap->chunkPitch * chunkMap->cellDataSize;
+    for (u32 c = 0; c < chunkCount; c++) {
+        u32 chunkIndex = dirtyChunks == NULL ? c : dirtyChunks[c];
+        const u8 *sourceData = htw_geo_getChunk(chunkMap, chunkIndex);
+        // every chunk around this one, corners included, so square stencils can use the halo too
+        for (s32 offsetY = -1; offsetY <= 1; offsetY++) {
+            for (s32 offsetX = -1; offsetX <= 1; offsetX++) {
+                if (offsetX == 0 && offsetY == 0) continue;
+                u32 neighborIndex = htw_geo_getChunkIndexAtOffset(chunkMap, chunkIndex, (htw_geo_GridCoord){offsetX, offsetY});
+                // halos are always written to the front buffer, since they only mirror what reads already see
+                u8 *destData = chunkMap->chunks[neighborIndex].cellData;
+                s32 sourceX, destX, width, sourceY, destY, height;
+                haloSpan(chunkMap, offsetX, &sourceX, &destX, &width);
+                haloSpan(chunkMap, offsetY, &sourceY, &destY, &height);
+                for (s32 row = 0; row < height; row++) {
+                    memcpy(
+                        destData + ((destY + row) * (ptrdiff_t)rowBytes) + (destX * (ptrdiff_t)chunkMap->cellDataSize),
+                        sourceData + ((sourceY + row) * (ptrdiff_t)rowBytes) + (sourceX * (ptrdiff_t)chunkMap->cellDataSize),
+                        width * chunkMap->cellDataSize
+                    );
+                }
+            }
+        }
+    }
+}
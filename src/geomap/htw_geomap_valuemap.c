@@ -2,7 +2,7 @@
 #include "htw_geomap.h"
 
 htw_ValueMap *htw_geo_createValueMap(u32 width, u32 height, s32 maxValue) {
-    int fullSize = sizeof(htw_ValueMap) + (sizeof(int) * width * height);
+    size_t fullSize = sizeof(htw_ValueMap) + (sizeof(int) * (size_t)width * height);
     htw_ValueMap *newMap = (htw_ValueMap*)malloc(fullSize);
     newMap->width = width;
     newMap->height = height;
@@ -14,11 +14,11 @@ int htw_align(int value, int alignment) {
 }
 
 unsigned int htw_nextPow(unsigned int value) {
-    if IS_POW_OF_2(value) {
-        return value;
-    } else {
-        return ceil(log2(value));
-    }
+    if (value <= 1) return 1;
+    // no larger power of 2 fits, and shifting by 32 is undefined
+    if (value > 1u << 31) return 1u << 31;
+    // one past the highest bit of value - 1; exact powers of 2 round to themselves
+    return 1u << (32 - __builtin_clz(value - 1));
 }
 
 double lerp(double a, double b, double progress) {
@@ -0,0 +1,140 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "htw_core.h"
+
+// Each thread claims ranges from a shared counter, so a thread that is slowed down (or gets a more expensive part of
+// the loop) doesn't hold up the others. More ranges per thread balances better, but costs more claims
+#define HTW_PARALLEL_RANGES_PER_THREAD 8
+// Thread stacks aren't free; past this, more threads can't help on any machine this is likely to run on
+#define HTW_PARALLEL_MAX_THREADS 256
+
+typedef struct htw_ParallelLoop {
+    htw_ParallelRangeFn rangeFn;
+    void *context;
+    u32 count;
+    u32 rangeSize;
+    _Atomic u32 nextRange;
+    // the rest are guarded by the worker pool's lock
+    u32 workersWanted;
+    u32 workersJoined;
+    u32 workersRunning;
+    struct htw_ParallelLoop *next;
+} htw_ParallelLoop;
+
+// Workers are started the first time a loop needs them, then kept for the life of the process, parked on [wake]
+// between loops, so a loop only pays for waking them. Loops that still want workers are listed in [loops]; more than
+// one can be open at once, when loops are started from several threads, or from inside another loop's ranges
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t left;
+    htw_ParallelLoop *loops;
+    u32 workerCount;
+} htw_WorkerPool;
+
+static htw_WorkerPool workerPool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .left = PTHREAD_COND_INITIALIZER,
+    .loops = NULL,
+    .workerCount = 0,
+};
+
+/// internal
+static void runParallelLoop(htw_ParallelLoop *loop) {
+    u32 rangeCount = (loop->count + loop->rangeSize - 1) / loop->rangeSize;
+    for (u32 r = loop->nextRange++; r < rangeCount; r = loop->nextRange++) {
+        u32 start = r * loop->rangeSize;
+        u32 end = MIN(start + loop->rangeSize, loop->count);
+        loop->rangeFn(loop->context, start, end);
+    }
+}
+
+/// internal; the oldest listed loop that wants another worker, or NULL. Call with the pool locked
+static htw_ParallelLoop *findOpenLoop() {
+    htw_ParallelLoop *open = NULL;
+    for (htw_ParallelLoop *loop = workerPool.loops; loop != NULL; loop = loop->next) {
+        if (loop->workersJoined < loop->workersWanted) open = loop;
+    }
+    return open;
+}
+
+/// internal
+static void *runWorker(void *arg) {
+    pthread_mutex_lock(&workerPool.lock);
+    while (1) {
+        htw_ParallelLoop *loop = findOpenLoop();
+        if (loop == NULL) {
+            pthread_cond_wait(&workerPool.wake, &workerPool.lock);
+            continue;
+        }
+        loop->workersJoined++;
+        loop->workersRunning++;
+        pthread_mutex_unlock(&workerPool.lock);
+        runParallelLoop(loop);
+        pthread_mutex_lock(&workerPool.lock);
+        // the loop's owner is waiting for this before it returns, and the loop goes with it
+        if (--loop->workersRunning == 0) pthread_cond_broadcast(&workerPool.left);
+    }
+    return NULL;
+}
+
+/// internal; starts workers until there are [workerCount]. Call with the pool locked
+static void growWorkerPool(u32 workerCount) {
+    while (workerPool.workerCount < workerCount) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, runWorker, NULL) != 0) {
+            // not fatal; the workers that did start, and the calling thread, still finish every range
+            fprintf(stderr, "Failed to start worker thread %u of %u\n", workerPool.workerCount + 1, workerCount);
+            return;
+        }
+        pthread_detach(worker);
+        workerPool.workerCount++;
+    }
+}
+
+u32 htw_cpuCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
+void htw_parallelFor(u32 count, u32 threadCount, htw_ParallelRangeFn rangeFn, void *context) {
+    if (count == 0) return;
+    if (threadCount == 0) threadCount = htw_cpuCount();
+    threadCount = MIN(MIN(threadCount, count), HTW_PARALLEL_MAX_THREADS);
+    if (threadCount == 1) {
+        rangeFn(context, 0, count);
+        return;
+    }
+
+    u32 rangeCount = MIN(count, threadCount * HTW_PARALLEL_RANGES_PER_THREAD);
+    htw_ParallelLoop loop = {
+        .rangeFn = rangeFn,
+        .context = context,
+        .count = count,
+        .rangeSize = (count + rangeCount - 1) / rangeCount,
+        .nextRange = 0,
+    };
+
+    // the calling thread works too, so only threadCount - 1 workers are woken
+    pthread_mutex_lock(&workerPool.lock);
+    growWorkerPool(threadCount - 1);
+    loop.workersWanted = threadCount - 1;
+    loop.next = workerPool.loops;
+    workerPool.loops = &loop;
+    pthread_cond_broadcast(&workerPool.wake);
+    pthread_mutex_unlock(&workerPool.lock);
+
+    runParallelLoop(&loop);
+
+    // every range has been claimed by now, so workers that haven't joined yet would have nothing to do
+    pthread_mutex_lock(&workerPool.lock);
+    htw_ParallelLoop **link = &workerPool.loops;
+    while (*link != &loop) link = &(*link)->next;
+    *link = loop.next;
+    while (loop.workersRunning > 0) {
+        pthread_cond_wait(&workerPool.left, &workerPool.lock);
+    }
+    pthread_mutex_unlock(&workerPool.lock);
+}
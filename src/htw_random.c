@@ -1,55 +1,255 @@
 #include "htw_random.h"
 #include "htw_core.h"
 #include <math.h>
+#include <string.h>
 
-//extern int htw_randRange(int range);
+/* Generator state
+ * xoshiro256** by David Blackman and Sebastiano Vigna, public domain (CC0). See https://prng.di.unimi.it/
+ * State is seeded through splitmix64, which is the seeding method recommended by the xoshiro authors.
+ */
+
+// Base seed for thread-local default states; each thread that uses one gets the next seed after this
+#define HTW_RAND_DEFAULT_SEED 0x853C49E6748FEA9BULL
+
+static _Atomic u64 defaultStateCount = 0;
+static _Thread_local htw_RandState defaultState;
+static _Thread_local int defaultStateSeeded = 0;
+
+/// internal
+static inline u64 rotateLeft64(u64 value, s32 count) {
+    return (value << count) | (value >> (64 - count));
+}
+
+/// internal
+static inline u64 splitmix64(u64 *x) {
+    u64 z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void htw_randSeed_r(htw_RandState *state, u64 seed) {
+    for (int i = 0; i < 4; i++) {
+        state->s[i] = splitmix64(&seed);
+    }
+}
+
+void htw_randSeed(u64 seed) {
+    htw_randSeed_r(&defaultState, seed);
+    defaultStateSeeded = 1;
+}
+
+htw_RandState *htw_randDefaultState() {
+    if (!defaultStateSeeded) {
+        htw_randSeed_r(&defaultState, HTW_RAND_DEFAULT_SEED + defaultStateCount++);
+        defaultStateSeeded = 1;
+    }
+    return &defaultState;
+}
+
+/// internal; same as htw_rand64_r, but can always be inlined
+static inline u64 nextRand64(htw_RandState *state) {
+    u64 *s = state->s;
+    const u64 result = rotateLeft64(s[1] * 5, 7) * 9;
+    const u64 t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+    s[3] = rotateLeft64(s[3], 45);
+
+    return result;
+}
+
+/// internal; same as htw_randValue_r, but can always be inlined
+static inline float nextRandValue(htw_RandState *state) {
+    // top 24 bits, so every result is exactly representable
+    return (float)(nextRand64(state) >> 40) / (float)0xFFFFFF;
+}
+
+u64 htw_rand64_r(htw_RandState *state) {
+    return nextRand64(state);
+}
+
+void htw_randJump_r(htw_RandState *state) {
+    static const u64 JUMP[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+
+    u64 s[4] = {0};
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (JUMP[i] & (1ULL << b)) {
+                for (int w = 0; w < 4; w++) {
+                    s[w] ^= state->s[w];
+                }
+            }
+            nextRand64(state);
+        }
+    }
+    memcpy(state->s, s, sizeof(s));
+}
+
+htw_RandState htw_randSplit_r(htw_RandState *state) {
+    htw_RandState child = *state;
+    htw_randJump_r(state);
+    return child;
+}
+
+u64 htw_rand64() {
+    return htw_rand64_r(htw_randDefaultState());
+}
 
 /* Basics */
 
+/// internal; Lemire's multiply-shift method. Unbiased integer in [0, range) for range > 0; only divides when a
+/// draw lands in the small region that needs rejecting, which happens with probability below range / 2^32
+static inline u32 nextBounded(htw_RandState *state, u32 range) {
+    u64 m = (nextRand64(state) >> 32) * (u64)range;
+    u32 low = (u32)m;
+    if (low < range) {
+        u32 threshold = -range % range; // 2^32 % range
+        while (low < threshold) {
+            m = (nextRand64(state) >> 32) * (u64)range;
+            low = (u32)m;
+        }
+    }
+    return m >> 32;
+}
+
+/// internal; returns the high 64 bits of a * b, and stores the low 64 bits in [low]
+static inline u64 mulHigh64(u64 a, u64 b, u64 *low) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 m = (unsigned __int128)a * b;
+    *low = (u64)m;
+    return m >> 64;
+#else
+    u64 aLo = a & 0xFFFFFFFF, aHi = a >> 32;
+    u64 bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+    u64 lolo = aLo * bLo;
+    u64 hilo = aHi * bLo;
+    u64 lohi = aLo * bHi;
+    u64 cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+    *low = (cross << 32) | (lolo & 0xFFFFFFFF);
+    return (aHi * bHi) + (hilo >> 32) + (cross >> 32);
+#endif
+}
+
+int htw_randInt_r(htw_RandState *state, int max) {
+    return nextBounded(state, (u32)max + 1);
+}
+
+int htw_randIndex_r(htw_RandState *state, int size) {
+    return nextBounded(state, size);
+}
+
+int htw_randIntRange_r(htw_RandState *state, int min, int max) {
+    u32 range = ((u32)max - (u32)min) + 1;
+    // range wraps to 0 when it covers every int
+    u32 r = range == 0 ? (u32)(nextRand64(state) >> 32) : nextBounded(state, range);
+    return (int)((u32)min + r);
+}
+
+float htw_randValue_r(htw_RandState *state) {
+    return nextRandValue(state);
+}
+
+float htw_randRange_r(htw_RandState *state, float min, float max) {
+    return fmaf(htw_randValue_r(state), max - min, min);
+}
+
+int htw_coinFlip_r(htw_RandState *state) {
+    return htw_rand64_r(state) >> 63;
+}
+
+int htw_weightedFlip_r(htw_RandState *state, float p) {
+    return htw_randValue_r(state) < p;
+}
+
+// Largest product of die sizes rolled from a single 64 bit draw. Keeping it well below 2^64 makes rejection (and the
+// division needed to check for it) rare: a batch is rejected with probability below HTW_RAND_DICE_BOUND / 2^64
+#define HTW_RAND_DICE_BOUND (1ULL << 48)
+
+int htw_rtd_r(htw_RandState *state, int count, int sides, int *results) {
+    if (sides < 2) {
+        // only one possible result
+        if (results != NULL) {
+            for (int i = 0; i < count; i++) results[i] = 1;
+        }
+        return count;
+    }
+
+    // Multiplying a 64 bit draw by [sides] puts a roll in the high word, and leaves the low word as a fresh fraction
+    // to roll the next die from. After a batch, the remaining low word tells whether the whole batch must be
+    // rejected, the same way as for a single bounded integer (Brackett-Rozinsky & Lemire's batched method)
+    int perDraw = 1;
+    u64 batchBound = sides;
+    while (batchBound <= HTW_RAND_DICE_BOUND / sides) {
+        batchBound *= sides;
+        perDraw++;
+    }
+
+    int total = 0;
+    int rolls[64];
+    for (int i = 0; i < count; i += perDraw) {
+        int batchSize = MIN(perDraw, count - i);
+        u64 bound = batchBound;
+        if (batchSize < perDraw) {
+            bound = 1;
+            for (int d = 0; d < batchSize; d++) bound *= sides;
+        }
+
+        int batchTotal;
+        u64 low;
+        do {
+            low = nextRand64(state);
+            batchTotal = 0;
+            for (int d = 0; d < batchSize; d++) {
+                int roll = (int)mulHigh64(low, sides, &low) + 1;
+                rolls[d] = roll;
+                batchTotal += roll;
+            }
+        } while (low < bound && low < (-bound % bound)); // -bound % bound is 2^64 % bound
+
+        if (results != NULL) {
+            memcpy(&results[i], rolls, sizeof(int) * batchSize);
+        }
+        total += batchTotal;
+    }
+    return total;
+}
+
 int htw_randInt(int max) {
-    return rand() % (max + 1);
+    return htw_randInt_r(htw_randDefaultState(), max);
 }
 
 int htw_randIndex(int size) {
-    return rand() % size;
+    return htw_randIndex_r(htw_randDefaultState(), size);
 }
 
 int htw_randIntRange(int min, int max) {
-    return (rand() % ((max - min) + 1)) + min;
+    return htw_randIntRange_r(htw_randDefaultState(), min, max);
 }
 
 float htw_randValue() {
-    return (float)rand() / (float)RAND_MAX;
+    return htw_randValue_r(htw_randDefaultState());
 }
 
 float htw_randRange(float min, float max) {
-    return fmaf((float)rand() / (float)RAND_MAX, max - min, min);
+    return htw_randRange_r(htw_randDefaultState(), min, max);
 }
 
 int htw_coinFlip() {
-    return rand() & 1;
+    return htw_coinFlip_r(htw_randDefaultState());
 }
 
 int htw_weightedFlip(float p) {
-    return htw_randValue() < p;
+    return htw_weightedFlip_r(htw_randDefaultState(), p);
 }
 
-
 int htw_rtd(int count, int sides, int *results) {
-    int total = 0;
-    if (results == NULL) {
-        for (int i = 0; i < count; i++) {
-            total += htw_randIndex(sides) + 1;
-        }
-    }
-    else {
-        for (int i = 0; i < count; i++) {
-            int r = htw_randIndex(sides) + 1;
-            results[i] = r;
-            total += r;
-        }
-    }
-    return total;
+    return htw_rtd_r(htw_randDefaultState(), count, sides, results);
 }
 
 /* htw_randGamma and gsl_ran_gaussian_ziggurat and supporting constants are adapted from GSL, the GNU Scientific Library.
@@ -141,7 +341,7 @@ static const double ytab[128] = {
 
 /* tabulated values for 2^24 times x[i]/x[i+1],
  * used to accept for U*x[i+1]<=x[i] without any floating point operations */
-static const unsigned long ktab[128] = {
+static const u64 ktab[128] = {
     0, 12590644, 14272653, 14988939,
     15384584, 15635009, 15807561, 15933577,
     16029594, 16105155, 16166147, 16216399,
@@ -212,71 +412,78 @@ static const double wtab[128] = {
     1.83813550477e-07, 1.92166040885e-07, 2.05295471952e-07, 2.22600839893e-07
 };
 
-float gsl_ran_gaussian_ziggurat(float sigma) {
+/// internal; one pass of the ziggurat loop for draw [k]. If accepted, returns 1 and sets [result] to a standard normal value
+static inline int gsl_ran_gaussian_ziggurat_try(htw_RandState *state, u64 k, double *result) {
     unsigned long int i, j;
     int sign;
     double x, y;
 
-    const unsigned long int range = RAND_MAX;
+    // one draw covers both the step and the 24 bit sample
+    i = (k & 0xFF);
+    j = (k >> 40) & 0x00FFFFFF;
+
+    sign = (i & 0x80) ? +1 : -1;
+    i &= 0x7f;
+
+    x = j * wtab[i];
 
-    while (1)
+    if (j < ktab[i])
     {
-        if (range >= 0x00FFFFFF)
-        {
-            unsigned long int k1 = rand();
-            unsigned long int k2 = rand();
-            i = (k1 & 0xFF);
-            j = (k2 & 0x00FFFFFF);
-        }
-        else
-        {
-            i = htw_randIndex(256); /*  choose the step */
-            j = htw_randIndex(16777216);  /* sample from 2^24 */
-        }
+        *result = sign * x;
+        return 1;
+    }
 
-        sign = (i & 0x80) ? +1 : -1;
-        i &= 0x7f;
+    if (i < 127)
+    {
+        double y0, y1, U1;
+        y0 = ytab[i];
+        y1 = ytab[i + 1];
+        U1 = nextRandValue(state);
+        y = y1 + (y0 - y1) * U1;
+    }
+    else
+    {
+        double U1, U2;
+        U1 = 1.0 - nextRandValue(state);
+        U2 = nextRandValue(state);
+        x = PARAM_R - log (U1) / PARAM_R;
+        y = exp (-PARAM_R * (x - 0.5 * PARAM_R)) * U2;
+    }
 
-        x = j * wtab[i];
+    if (y < exp (-0.5 * x * x))
+    {
+        *result = sign * x;
+        return 1;
+    }
 
-        if (j < ktab[i])
-            break;
+    return 0;
+}
 
-        if (i < 127)
-        {
-            double y0, y1, U1;
-            y0 = ytab[i];
-            y1 = ytab[i + 1];
-            U1 = htw_randValue();
-            y = y1 + (y0 - y1) * U1;
-        }
-        else
-        {
-            double U1, U2;
-            U1 = 1.0 - htw_randValue();
-            U2 = htw_randValue();
-            x = PARAM_R - log (U1) / PARAM_R;
-            y = exp (-PARAM_R * (x - 0.5 * PARAM_R)) * U2;
-        }
+static float gsl_ran_gaussian_ziggurat(htw_RandState *state, float sigma) {
+    double x;
+    while (!gsl_ran_gaussian_ziggurat_try(state, nextRand64(state), &x));
+    return sigma * x;
+}
 
-        if (y < exp (-0.5 * x * x))
-            break;
-    }
+float htw_randNormal_r(htw_RandState *state, float mean, float standardDeviation) {
+    return mean + gsl_ran_gaussian_ziggurat(state, standardDeviation);
+}
 
-    return sign * sigma * x;
+int htw_randIntNormal_r(htw_RandState *state, int mean, int standardDeviation) {
+    return lroundf(htw_randNormal_r(state, mean, standardDeviation));
 }
 
 /*
  * Implementation based on the Marsaglia-Tsang method used in GSL.
  * TODO: use guaranteed nonzero rand function where required? At first glance doesn't look like it matters.
  */
-float htw_randGamma(float a, float b) {
+float htw_randGamma_r(htw_RandState *state, float a, float b) {
     /* assume a > 0 */
 
     if (a < 1)
     {
-        double u = htw_randValue();
-        return htw_randGamma(1.0 + a, b) * pow (u, 1.0 / a);
+        double u = nextRandValue(state);
+        return htw_randGamma_r(state, 1.0 + a, b) * pow (u, 1.0 / a);
     }
 
     {
@@ -288,13 +495,13 @@ float htw_randGamma(float a, float b) {
         {
             do
             {
-                x = gsl_ran_gaussian_ziggurat(1.0);
+                x = gsl_ran_gaussian_ziggurat(state, 1.0);
                 v = 1.0 + c * x;
             }
             while (v <= 0);
 
             v = v * v * v;
-            u = htw_randValue();
+            u = nextRandValue(state);
 
             if (u < 1 - 0.0331 * x * x * x * x)
                 break;
@@ -307,21 +514,370 @@ float htw_randGamma(float a, float b) {
     }
 }
 
-float htw_randBeta(float a, float b) {
+float htw_randBeta_r(htw_RandState *state, float a, float b) {
     // NOTE: Knuth's method is faster when both a and b <= 1, but for my purposes this is an uncommon case.
-    float x1 = htw_randGamma(a, 1.0);
-    float x2 = htw_randGamma(b, 1.0);
+    float x1 = htw_randGamma_r(state, a, 1.0);
+    float x2 = htw_randGamma_r(state, b, 1.0);
     return x1 / (x1 + x2);
 }
 
+float htw_randPERT_r(htw_RandState *state, float min, float max, float mode) {
+    const float LAMBDA = 4.0;
+    float ba = mode - min;
+    float ca = max - min;
+    float cb = max - mode;
+    float alpha = fmaf(ba/ca, LAMBDA, 1.0);
+    float beta = fmaf(cb/ca, LAMBDA, 1.0);
+    return fmaf(htw_randBeta_r(state, alpha, beta), ca, min);
+}
+
+float htw_randNormal(float mean, float standardDeviation) {
+    return htw_randNormal_r(htw_randDefaultState(), mean, standardDeviation);
+}
+
+int htw_randIntNormal(int mean, int standardDeviation) {
+    return htw_randIntNormal_r(htw_randDefaultState(), mean, standardDeviation);
+}
+
+float htw_randGamma(float a, float b) {
+    return htw_randGamma_r(htw_randDefaultState(), a, b);
+}
+
+float htw_randBeta(float a, float b) {
+    return htw_randBeta_r(htw_randDefaultState(), a, b);
+}
+
 float htw_randPERT(float min, float max, float mode) {
+    return htw_randPERT_r(htw_randDefaultState(), min, max, mode);
+}
+
+/* Bulk sampling
+ * Same distributions as above, but each call fills a whole array. Draws are made one block at a time, so per-sample
+ * work is in tight loops instead of a chain of calls, and parameter dependent setup is done once per call.
+ *
+ * Normal, uniform, and gamma candidates come from HTW_RAND_STREAMS generators, seeded from the caller's state at the
+ * start of each call and stepped side by side, so the ziggurat and Marsaglia-Tsang run a vector of samples at a time
+ * (see the sampling kernels in htw_random_kernels.h). Each draw is used to the last bit: the ziggurat wedge test takes
+ * its uniform from the middle bits of the draw that picked the step, instead of drawing again. The wedge test's exp and
+ * the gamma log test are approximated by plain arithmetic that every kernel repeats exactly, and only run for the few
+ * samples that miss the fast path or the squeeze, collected from the whole block. The draws that still need the
+ * ziggurat's slow path finish in scalar code, drawing from the caller's state. The number of streams is fixed, so
+ * results don't depend on the vector width of the CPU, or whether it has one.
+ */
+
+// Number of values drawn at once by bulk samplers; also sizes their stack buffers. A multiple of HTW_RAND_STREAMS
+#define HTW_RAND_BLOCK_SIZE 256
+// Generators interleaved by the bulk samplers; value i of a block comes from stream i % HTW_RAND_STREAMS
+#define HTW_RAND_STREAMS 8
+// Seeding the streams costs about as much as this many normals, so shorter arrays are sampled one value at a time
+#define HTW_RAND_MIN_STREAMED 64
+// Splits ln 2 so that n * HTW_RAND_LN2_HI is exact for every n wedgeExp sees
+#define HTW_RAND_LN2_HI 6.93147180369123816490e-01
+#define HTW_RAND_LN2_LO 1.90821492927058770002e-10
+// Bits of sqrt(1/2); squeezeLog scales its argument to within a factor of sqrt(2) of 1
+#define HTW_RAND_SQRT_HALF_BITS 0x3FE6A09E667F3BCDULL
+// 1.5 * 2^52; adding it rounds a double below 2^51 to an integer, which is then in the low bits of the sum
+#define HTW_RAND_ROUNDING_SHIFT 6755399441055744.0
+// e^r for |r| <= ln(2) / 2, to within 3e-10, given r^2 and r^4 as well. Split into independent parts (Estrin's
+// scheme), since the kernels are waiting on it. A macro so that wedgeExp and the kernels evaluate it in the same order
+#define HTW_RAND_EXP_POLYNOMIAL(r, r2, r4) \
+    (((1.0 + (r)) + ((r2) * (1.0 / 2 + ((r) * (1.0 / 6))))) + \
+     ((r4) * (((1.0 / 24 + ((r) * (1.0 / 120))) + ((r2) * (1.0 / 720 + ((r) * (1.0 / 5040))))) + ((r4) * (1.0 / 40320)))))
+// log(m) / s, where s = (m - 1) / (m + 1), for m within a factor of sqrt(2) of 1, to within 1e-11, given s^2 and s^4.
+// Used by squeezeLog and the kernels, in the same order
+#define HTW_RAND_LOG_POLYNOMIAL(s2, s4) \
+    (((2.0 + ((s2) * (2.0 / 3))) + ((s4) * (2.0 / 5 + ((s2) * (2.0 / 7))))) + \
+     (((s4) * (s4)) * (2.0 / 9 + ((s2) * (2.0 / 11)))))
+
+static u32 normalStreams(u64 *streams, float *out, u32 count, float mean, float standardDeviation, u32 *rejected, u64 *rejectedDraws);
+static void uniformStreams(u64 *streams, float *out, u32 count);
+static u32 gammaStreams(u64 *streams, const float *normals, u32 count, double c, double d, double bd, float *out);
+
+/// internal; seeds HTW_RAND_STREAMS generators from [state]. Word w of stream s is at streams[(w * HTW_RAND_STREAMS) + s],
+/// so each word of a vector of streams can be loaded at once
+static void seedStreams(htw_RandState *state, u64 *streams) {
+    for (int s = 0; s < HTW_RAND_STREAMS; s++) {
+        u64 seed = nextRand64(state);
+        for (int w = 0; w < 4; w++) {
+            streams[(w * HTW_RAND_STREAMS) + s] = splitmix64(&seed);
+        }
+    }
+}
+
+/// internal; [bits] (less than 2^52) as the fraction of a double in [0, 1); exact, with no integer conversion
+static inline double unitDouble(u64 bits) {
+    bits |= 0x3FF0000000000000ULL;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value - 1.0;
+}
+
+/// internal; [bits] (less than 2^23) as the fraction of a float in [0, 1)
+static inline float unitFloat(u32 bits) {
+    bits |= 0x3F800000U;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value - 1.0f;
+}
+
+/// internal; e^a for a in [-700, 0], to within 3e-10 relative; plenty for the wedge test of float samples. Plain arithmetic, so that the sampling
+/// kernels can repeat it exactly in each lane
+static inline double wedgeExp(double a) {
+    double shifted = (a * (1.0 / M_LN2)) + HTW_RAND_ROUNDING_SHIFT;
+    double n = shifted - HTW_RAND_ROUNDING_SHIFT;
+    double r = (a - (n * HTW_RAND_LN2_HI)) - (n * HTW_RAND_LN2_LO);
+    // n is in the low bits of shifted; 2^n has it plus the bias as its exponent
+    u64 scaleBits;
+    memcpy(&scaleBits, &shifted, sizeof(scaleBits));
+    scaleBits = (scaleBits + 1023) << 52;
+    double scale;
+    memcpy(&scale, &scaleBits, sizeof(scale));
+    double r2 = r * r;
+    return HTW_RAND_EXP_POLYNOMIAL(r, r2, r2 * r2) * scale;
+}
+
+/// internal; log(a) for normal, positive, finite a, to within 1e-11. Like wedgeExp, plain arithmetic that the kernels
+/// repeat exactly, for the log test of gamma candidates
+static inline double squeezeLog(double a) {
+    u64 bits;
+    memcpy(&bits, &a, sizeof(bits));
+    // a = m * 2^e, with m in [sqrt(1/2), sqrt(2))
+    s64 e = (s64)(bits - HTW_RAND_SQRT_HALF_BITS) >> 52;
+    bits -= (u64)e << 52;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    double s = (m - 1.0) / (m + 1.0);
+    double exponent = e;
+    double s2 = s * s;
+    return ((exponent * HTW_RAND_LN2_HI) + (s * HTW_RAND_LOG_POLYNOMIAL(s2, s2 * s2))) + (exponent * HTW_RAND_LN2_LO);
+}
+
+/// internal; the ziggurat for draw [k], up to the point where it needs another draw: the fast path test, then for a
+/// rejected draw below the base strip, the wedge test against U1 from bits 8 to 39 of [k]. Sets [x] to the (signed)
+/// value of the draw, which is the result unless this returns 0. Those draws are finished by finishNormal
+static inline int tryNormal(u64 k, double *x) {
+    u32 step = k & 0x7F;
+    u32 j = k >> 40;
+    double magnitude = j * wtab[step];
+    *x = (k & 0x80) ? magnitude : -magnitude;
+    if (j < ktab[step]) return 1;
+    if (step == 127) return 0;
+    double y = ytab[step + 1] + ((ytab[step] - ytab[step + 1]) * unitDouble(((k >> 8) & 0xFFFFFFFF) << 20));
+    return y < wedgeExp(-0.5 * magnitude * magnitude);
+}
+
+/// internal; a standard normal value for a draw that tryNormal rejected: the base strip's tail for [k] if it is in the
+/// base strip, otherwise new draws from [state]
+static double finishNormal(htw_RandState *state, u64 k) {
+    double x;
+    if ((k & 0x7F) != 127 || !gsl_ran_gaussian_ziggurat_try(state, k, &x)) {
+        while (!gsl_ran_gaussian_ziggurat_try(state, nextRand64(state), &x));
+    }
+    return x;
+}
+
+/// internal; tryNormal for each draw from [streams]. Fills all of [out], with mean + standardDeviation * x, and returns
+/// how many draws were rejected, with their positions in [rejected] and the draws themselves in [rejectedDraws], in
+/// order. [count] must be a multiple of HTW_RAND_STREAMS
+static u32 normalStreamsScalar(u64 *streams, float *out, u32 count, float mean, float standardDeviation, u32 *rejected, u64 *rejectedDraws) {
+    htw_RandState states[HTW_RAND_STREAMS];
+    for (int s = 0; s < HTW_RAND_STREAMS; s++) {
+        for (int w = 0; w < 4; w++) states[s].s[w] = streams[(w * HTW_RAND_STREAMS) + s];
+    }
+    u32 rejectedCount = 0;
+    for (u32 i = 0; i < count; i++) {
+        u64 k = nextRand64(&states[i % HTW_RAND_STREAMS]);
+        double x;
+        if (!tryNormal(k, &x)) {
+            rejected[rejectedCount] = i;
+            rejectedDraws[rejectedCount] = k;
+            rejectedCount++;
+        }
+        out[i] = (float)(standardDeviation * x) + mean;
+    }
+    for (int s = 0; s < HTW_RAND_STREAMS; s++) {
+        for (int w = 0; w < 4; w++) streams[(w * HTW_RAND_STREAMS) + s] = states[s].s[w];
+    }
+    return rejectedCount;
+}
+
+/// internal; fills [out] with values in [0, 1), from the top 23 bits of each draw from [streams]. [count] must be a
+/// multiple of HTW_RAND_STREAMS
+static void uniformStreamsScalar(u64 *streams, float *out, u32 count) {
+    htw_RandState states[HTW_RAND_STREAMS];
+    for (int s = 0; s < HTW_RAND_STREAMS; s++) {
+        for (int w = 0; w < 4; w++) states[s].s[w] = streams[(w * HTW_RAND_STREAMS) + s];
+    }
+    for (u32 i = 0; i < count; i++) {
+        out[i] = unitFloat(nextRand64(&states[i % HTW_RAND_STREAMS]) >> 41);
+    }
+    for (int s = 0; s < HTW_RAND_STREAMS; s++) {
+        for (int w = 0; w < 4; w++) streams[(w * HTW_RAND_STREAMS) + s] = states[s].s[w];
+    }
+}
+
+/// internal; one Marsaglia-Tsang step for each of [normals], with u drawn from [streams], in (0, 1] so that its log
+/// is finite. Fills [out] with bd * v for the accepted candidates, in order, and returns how many there are. Only
+/// candidates that miss the squeeze need logs. [count] must be a multiple of HTW_RAND_STREAMS
+static u32 gammaStreamsScalar(u64 *streams, const float *normals, u32 count, double c, double d, double bd, float *out) {
+    htw_RandState states[HTW_RAND_STREAMS];
+    for (int s = 0; s < HTW_RAND_STREAMS; s++) {
+        for (int w = 0; w < 4; w++) states[s].s[w] = streams[(w * HTW_RAND_STREAMS) + s];
+    }
+    u32 accepted = 0;
+    for (u32 i = 0; i < count; i++) {
+        double u = 1.0 - unitDouble(nextRand64(&states[i % HTW_RAND_STREAMS]) >> 12);
+        double x = normals[i];
+        double v = 1.0 + (c * x);
+        if (v <= 0) continue;
+
+        double v3 = v * v * v;
+        if (u < 1 - (0.0331 * x * x * x * x) || squeezeLog(u) < 0.5 * x * x + d * (1 - v3 + squeezeLog(v3))) {
+            out[accepted++] = bd * v3;
+        }
+    }
+    for (int s = 0; s < HTW_RAND_STREAMS; s++) {
+        for (int w = 0; w < 4; w++) streams[(w * HTW_RAND_STREAMS) + s] = states[s].s[w];
+    }
+    return accepted;
+}
+
+/// internal; fills [out] with [count] normals from [streams], finishing rejected draws on [state]. [count] must be a
+/// multiple of HTW_RAND_STREAMS, and at most HTW_RAND_BLOCK_SIZE
+static void normalBlock(htw_RandState *state, u64 *streams, float *out, u32 count, float mean, float standardDeviation) {
+    u32 rejected[HTW_RAND_BLOCK_SIZE];
+    u64 rejectedDraws[HTW_RAND_BLOCK_SIZE];
+    // about 1 draw in 80 is rejected by both the fast path and the wedge test
+    u32 rejectedCount = normalStreams(streams, out, count, mean, standardDeviation, rejected, rejectedDraws);
+    // the kernels list rejected draws by stream; put them back in draw order, so the slow path uses [state] the same way
+    // whichever kernel ran. There are only a few per block, so insertion sort is plenty
+    for (u32 r = 1; r < rejectedCount; r++) {
+        u32 index = rejected[r];
+        u64 draw = rejectedDraws[r];
+        u32 position = r;
+        for (; position > 0 && rejected[position - 1] > index; position--) {
+            rejected[position] = rejected[position - 1];
+            rejectedDraws[position] = rejectedDraws[position - 1];
+        }
+        rejected[position] = index;
+        rejectedDraws[position] = draw;
+    }
+    for (u32 r = 0; r < rejectedCount; r++) {
+        out[rejected[r]] = (float)(standardDeviation * finishNormal(state, rejectedDraws[r])) + mean;
+    }
+}
+
+/// internal; Marsaglia-Tsang constants and the accepted values not handed out yet, for one bulk gamma call. Keeping
+/// the leftovers means each block of candidates is used in full, instead of topping up every output block with a
+/// small extra round
+typedef struct {
+    double c;
+    double d;
+    double bd;
+    double boost;
+    size_t remaining;
+    u32 next;
+    u32 available;
+    float values[HTW_RAND_BLOCK_SIZE];
+} htw_GammaSource;
+
+/// internal; sets up [source] for [count] gamma values. Shapes below 1 come from a shape above 1, boosted by a uniform
+static void gammaSourceInit(htw_GammaSource *source, size_t count, float a, float b) {
+    source->boost = a < 1 ? 1.0 / a : 0;
+    double shape = a < 1 ? 1.0 + a : a;
+    source->d = shape - 1.0 / 3.0;
+    source->c = (1.0 / 3.0) / sqrt (source->d);
+    source->bd = b * source->d;
+    source->remaining = count;
+    source->next = 0;
+    source->available = 0;
+}
+
+/// internal; fills [out] with the next [count] values from [source], at most HTW_RAND_BLOCK_SIZE, using [streams]
+/// and [state]
+static void gammaBlock(htw_RandState *state, u64 *streams, htw_GammaSource *source, float *out, u32 count) {
+    float normals[HTW_RAND_BLOCK_SIZE];
+    u32 filled = 0;
+    while (filled < count) {
+        if (source->next == source->available) {
+            // at least 95% of candidates are accepted, so a few more than are still needed is usually enough
+            size_t wanted = source->remaining + (source->remaining / 16) + HTW_RAND_STREAMS;
+            u32 candidates = MIN(HTW_RAND_BLOCK_SIZE, wanted) & ~(HTW_RAND_STREAMS - 1);
+            normalBlock(state, streams, normals, candidates, 0.0, 1.0);
+            source->available = gammaStreams(streams, normals, candidates, source->c, source->d, source->bd, source->values);
+            source->next = 0;
+        }
+        u32 taken = MIN(count - filled, source->available - source->next);
+        memcpy(&out[filled], &source->values[source->next], taken * sizeof(float));
+        source->next += taken;
+        source->remaining -= taken;
+        filled += taken;
+    }
+    if (source->boost != 0) {
+        float uniforms[HTW_RAND_BLOCK_SIZE];
+        uniformStreams(streams, uniforms, (count + HTW_RAND_STREAMS - 1) & ~(HTW_RAND_STREAMS - 1));
+        for (u32 i = 0; i < count; i++) {
+            out[i] = out[i] * pow (uniforms[i], source->boost);
+        }
+    }
+}
+
+void htw_randNormalN(htw_RandState *state, float *out, size_t count, float mean, float standardDeviation) {
+    size_t streamed = 0;
+    if (count >= HTW_RAND_MIN_STREAMED) {
+        u64 streams[4 * HTW_RAND_STREAMS];
+        seedStreams(state, streams);
+        streamed = count - (count % HTW_RAND_STREAMS);
+        for (size_t start = 0; start < streamed; start += HTW_RAND_BLOCK_SIZE) {
+            normalBlock(state, streams, &out[start], MIN(HTW_RAND_BLOCK_SIZE, streamed - start), mean, standardDeviation);
+        }
+    }
+    for (size_t i = streamed; i < count; i++) {
+        out[i] = mean + gsl_ran_gaussian_ziggurat(state, standardDeviation);
+    }
+}
+
+void htw_randGammaN(htw_RandState *state, float *out, size_t count, float a, float b) {
+    u64 streams[4 * HTW_RAND_STREAMS];
+    seedStreams(state, streams);
+    htw_GammaSource source;
+    gammaSourceInit(&source, count, a, b);
+    for (size_t start = 0; start < count; start += HTW_RAND_BLOCK_SIZE) {
+        gammaBlock(state, streams, &source, &out[start], MIN(HTW_RAND_BLOCK_SIZE, count - start));
+    }
+}
+
+void htw_randBetaN(htw_RandState *state, float *out, size_t count, float a, float b) {
+    u64 streams[4 * HTW_RAND_STREAMS];
+    seedStreams(state, streams);
+    htw_GammaSource source1, source2;
+    gammaSourceInit(&source1, count, a, 1.0);
+    gammaSourceInit(&source2, count, b, 1.0);
+    float x2[HTW_RAND_BLOCK_SIZE];
+    for (size_t start = 0; start < count; start += HTW_RAND_BLOCK_SIZE) {
+        u32 blockSize = MIN(HTW_RAND_BLOCK_SIZE, count - start);
+        float *x1 = &out[start];
+        gammaBlock(state, streams, &source1, x1, blockSize);
+        gammaBlock(state, streams, &source2, x2, blockSize);
+        for (u32 i = 0; i < blockSize; i++) {
+            x1[i] = x1[i] / (x1[i] + x2[i]);
+        }
+    }
+}
+
+void htw_randPERTN(htw_RandState *state, float *out, size_t count, float min, float max, float mode) {
     const float LAMBDA = 4.0;
     float ba = mode - min;
     float ca = max - min;
     float cb = max - mode;
     float alpha = fmaf(ba/ca, LAMBDA, 1.0);
     float beta = fmaf(cb/ca, LAMBDA, 1.0);
-    return fmaf(htw_randBeta(alpha, beta), ca, min);
+    htw_randBetaN(state, out, count, alpha, beta);
+    // the product of two floats is exact in a double, so this rounds the same as fmaf in nearly every case, but unlike
+    // fmaf without hardware FMA, it isn't a library call per value
+    for (size_t i = 0; i < count; i++) {
+        out[i] = ((double)out[i] * ca) + min;
+    }
 }
 
 /* Hash functions */
@@ -377,24 +933,148 @@ static inline u32 xxh_rotateLeft(u32 value, s32 count) {
     return (value << count) | (value >> (32 - count));
 }
 
+#define XXH_PRIME64_1  0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2  0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3  0x165667B19E3779F9ULL
+#define XXH_PRIME64_4  0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5  0x27D4EB2F165667C5ULL
+
 /// internal
-static inline u32 xxh_bytesToU32(const u8 *bytes) {
-    u32 value = *bytes;
-    value |= (u32)(*(bytes + 1)) << 8;
-    value |= (u32)(*(bytes + 2)) << 16;
-    value |= (u32)(*(bytes + 3)) << 24;
+static inline u64 xxh_rotateLeft64(u64 value, s32 count) {
+    return (value << count) | (value >> (64 - count));
+}
+
+/// internal; little-endian word load from any alignment
+static inline u32 xxh_readU32(const u8 *bytes) {
+    u32 value;
+    memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
     return value;
 }
 
-/// internal
-static inline u32 xxh_subHash(u32 value, const u8 *bytes) {
-    u32 word = xxh_bytesToU32(bytes);
-    value += word * XXH_PRIME32_2;
-    value = xxh_rotateLeft(value, 13);
-    value *= XXH_PRIME32_1;
+/// internal; little-endian word load from any alignment
+static inline u64 xxh_readU64(const u8 *bytes) {
+    u64 value;
+    memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
     return value;
 }
 
+/// internal
+static inline u32 xxh_round(u32 acc, u32 word) {
+    acc += word * XXH_PRIME32_2;
+    acc = xxh_rotateLeft(acc, 13);
+    acc *= XXH_PRIME32_1;
+    return acc;
+}
+
+/// internal
+static inline u64 xxh64_round(u64 acc, u64 word) {
+    acc += word * XXH_PRIME64_2;
+    acc = xxh_rotateLeft64(acc, 31);
+    acc *= XXH_PRIME64_1;
+    return acc;
+}
+
+/// internal
+static inline u64 xxh64_mergeRound(u64 acc, u64 value) {
+    acc ^= xxh64_round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/// internal; consumes as many whole 16 byte stripes as possible, returns number of bytes consumed
+static size_t xxh_consumeStripes(u32 *v, size_t length, const u8 *bytes) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        v[0] = xxh_round(v[0], xxh_readU32(&bytes[i]));
+        v[1] = xxh_round(v[1], xxh_readU32(&bytes[i + 4]));
+        v[2] = xxh_round(v[2], xxh_readU32(&bytes[i + 8]));
+        v[3] = xxh_round(v[3], xxh_readU32(&bytes[i + 12]));
+    }
+    return i;
+}
+
+/// internal; consumes as many whole 32 byte stripes as possible, returns number of bytes consumed
+static size_t xxh64_consumeStripes(u64 *v, size_t length, const u8 *bytes) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        v[0] = xxh64_round(v[0], xxh_readU64(&bytes[i]));
+        v[1] = xxh64_round(v[1], xxh_readU64(&bytes[i + 8]));
+        v[2] = xxh64_round(v[2], xxh_readU64(&bytes[i + 16]));
+        v[3] = xxh64_round(v[3], xxh_readU64(&bytes[i + 24]));
+    }
+    return i;
+}
+
+/// internal; digest the last (length < 16) bytes of input and avalanche
+static u32 xxh_finalize(u32 hash, size_t length, const u8 *bytes) {
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        hash += xxh_readU32(&bytes[i]) * XXH_PRIME32_3;
+        hash = xxh_rotateLeft(hash, 17) * XXH_PRIME32_4;
+    }
+
+    for (; i < length; i++) {
+        hash += bytes[i] * XXH_PRIME32_5;
+        hash = xxh_rotateLeft(hash, 11) * XXH_PRIME32_1;
+    }
+
+    hash ^= hash >> 15;
+    hash *= XXH_PRIME32_2;
+    hash ^= hash >> 13;
+    hash *= XXH_PRIME32_3;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/// internal; digest the last (length < 32) bytes of input and avalanche
+static u64 xxh64_finalize(u64 hash, size_t length, const u8 *bytes) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        hash ^= xxh64_round(0, xxh_readU64(&bytes[i]));
+        hash = xxh_rotateLeft64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    if (i + 4 <= length) {
+        hash ^= (u64)xxh_readU32(&bytes[i]) * XXH_PRIME64_1;
+        hash = xxh_rotateLeft64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        i += 4;
+    }
+
+    for (; i < length; i++) {
+        hash ^= bytes[i] * XXH_PRIME64_5;
+        hash = xxh_rotateLeft64(hash, 11) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/// internal
+static inline u32 xxh_mergeAccumulators(const u32 *v) {
+    return xxh_rotateLeft(v[0], 1) + xxh_rotateLeft(v[1], 7) + xxh_rotateLeft(v[2], 12) + xxh_rotateLeft(v[3], 18);
+}
+
+/// internal
+static inline u64 xxh64_mergeAccumulators(const u64 *v) {
+    u64 hash = xxh_rotateLeft64(v[0], 1) + xxh_rotateLeft64(v[1], 7) + xxh_rotateLeft64(v[2], 12) + xxh_rotateLeft64(v[3], 18);
+    hash = xxh64_mergeRound(hash, v[0]);
+    hash = xxh64_mergeRound(hash, v[1]);
+    hash = xxh64_mergeRound(hash, v[2]);
+    hash = xxh64_mergeRound(hash, v[3]);
+    return hash;
+}
+
 u32 xxh_hash2d(u32 seed, u32 x, u32 y) {
     u32 hash = seed + XXH_PRIME32_5;
     hash += 2 * 4; // equivalent to adding input bytecount in the original. Unsure if it's needed here
@@ -415,55 +1095,134 @@ u32 xxh_hash2d(u32 seed, u32 x, u32 y) {
     return hash;
 }
 
-u32 xxh_hash(u32 seed, size_t size, const u8 *bytes) {
-    u32 hash = 0;
-    u32 i = 0;
+u32 xxh_hash(u32 seed, size_t length, const u8 *bytes) {
+    u32 hash;
+    size_t i = 0;
+
+    if (length >= 16) {
+        u32 v[4] = {
+            seed + XXH_PRIME32_1 + XXH_PRIME32_2,
+            seed + XXH_PRIME32_2,
+            seed + 0,
+            seed - XXH_PRIME32_1
+        };
+        i = xxh_consumeStripes(v, length, bytes);
+        hash = xxh_mergeAccumulators(v);
+    } else {
+        hash = seed + XXH_PRIME32_5;
+    }
 
-    if (size >= 16) {
-        u32 limit = size - 16;
-        u32 v1 = seed + XXH_PRIME32_1 + XXH_PRIME32_2;
-        u32 v2 = seed + XXH_PRIME32_2;
-        u32 v3 = seed + 0;
-        u32 v4 = seed + XXH_PRIME32_1;
+    hash += (u32)length;
 
-        do {
-            v1 = xxh_subHash(v1, &bytes[i]);
-            i += 4;
-            v2 = xxh_subHash(v2, &bytes[i]);
-            i += 4;
-            v3 = xxh_subHash(v3, &bytes[i]);
-            i += 4;
-            v4 = xxh_subHash(v4, &bytes[i]);
-            i += 4;
-        } while (i <= limit);
-
-        hash = xxh_rotateLeft(v1, 1) + xxh_rotateLeft(v2, 7) + xxh_rotateLeft(v3, 12) + xxh_rotateLeft(v4, 18);
+    return xxh_finalize(hash, length - i, &bytes[i]);
+}
+
+u64 xxh64_hash(u64 seed, size_t length, const u8 *bytes) {
+    u64 hash;
+    size_t i = 0;
+
+    if (length >= 32) {
+        u64 v[4] = {
+            seed + XXH_PRIME64_1 + XXH_PRIME64_2,
+            seed + XXH_PRIME64_2,
+            seed + 0,
+            seed - XXH_PRIME64_1
+        };
+        i = xxh64_consumeStripes(v, length, bytes);
+        hash = xxh64_mergeAccumulators(v);
     } else {
-        hash = seed + XXH_PRIME32_5;
+        hash = seed + XXH_PRIME64_5;
     }
 
-    hash += size;
+    hash += (u64)length;
 
-    while (i <= size - 4) {
-        u32 word = xxh_bytesToU32(&bytes[i]);
-        hash += word * XXH_PRIME32_3;
-        hash = xxh_rotateLeft(hash, 17) * XXH_PRIME32_4;
-        i += 4;
+    return xxh64_finalize(hash, length - i, &bytes[i]);
+}
+
+void xxh_init(xxh_state *state, u32 seed) {
+    *state = (xxh_state){
+        .seed = seed,
+        .v = {
+            seed + XXH_PRIME32_1 + XXH_PRIME32_2,
+            seed + XXH_PRIME32_2,
+            seed + 0,
+            seed - XXH_PRIME32_1
+        }
+    };
+}
+
+void xxh_update(xxh_state *state, size_t length, const u8 *bytes) {
+    state->totalLength += length;
+
+    // top up a partial stripe left over from the last update first
+    if (state->bufferSize > 0) {
+        size_t fill = MIN(length, sizeof(state->buffer) - state->bufferSize);
+        memcpy(&state->buffer[state->bufferSize], bytes, fill);
+        state->bufferSize += fill;
+        bytes += fill;
+        length -= fill;
+        if (state->bufferSize < sizeof(state->buffer)) return;
+        xxh_consumeStripes(state->v, sizeof(state->buffer), state->buffer);
+        state->bufferSize = 0;
     }
 
-    while (i < size) {
-        hash += bytes[i] * XXH_PRIME32_5;
-        hash = xxh_rotateLeft(hash, 11) * XXH_PRIME32_1;
-        i++;
+    size_t consumed = xxh_consumeStripes(state->v, length, bytes);
+    memcpy(state->buffer, &bytes[consumed], length - consumed);
+    state->bufferSize = length - consumed;
+}
+
+u32 xxh_digest(const xxh_state *state) {
+    u32 hash;
+    if (state->totalLength >= 16) {
+        hash = xxh_mergeAccumulators(state->v);
+    } else {
+        hash = state->seed + XXH_PRIME32_5;
     }
+    hash += (u32)state->totalLength;
+    return xxh_finalize(hash, state->bufferSize, state->buffer);
+}
 
-    hash ^= hash >> 15;
-    hash *= XXH_PRIME32_2;
-    hash ^= hash >> 13;
-    hash *= XXH_PRIME32_3;
-    hash ^= hash >> 16;
+void xxh64_init(xxh64_state *state, u64 seed) {
+    *state = (xxh64_state){
+        .seed = seed,
+        .v = {
+            seed + XXH_PRIME64_1 + XXH_PRIME64_2,
+            seed + XXH_PRIME64_2,
+            seed + 0,
+            seed - XXH_PRIME64_1
+        }
+    };
+}
 
-    return hash;
+void xxh64_update(xxh64_state *state, size_t length, const u8 *bytes) {
+    state->totalLength += length;
+
+    // top up a partial stripe left over from the last update first
+    if (state->bufferSize > 0) {
+        size_t fill = MIN(length, sizeof(state->buffer) - state->bufferSize);
+        memcpy(&state->buffer[state->bufferSize], bytes, fill);
+        state->bufferSize += fill;
+        bytes += fill;
+        length -= fill;
+        if (state->bufferSize < sizeof(state->buffer)) return;
+        xxh64_consumeStripes(state->v, sizeof(state->buffer), state->buffer);
+        state->bufferSize = 0;
+    }
+
+    size_t consumed = xxh64_consumeStripes(state->v, length, bytes);
+    memcpy(state->buffer, &bytes[consumed], length - consumed);
+    state->bufferSize = length - consumed;
+}
+
+u64 xxh64_digest(const xxh64_state *state) {
+    u64 hash;
+    if (state->totalLength >= 32) {
+        hash = xxh64_mergeAccumulators(state->v);
+    } else {
+        hash = state->seed + XXH_PRIME64_5;
+    }
+    hash += state->totalLength;
+    return xxh64_finalize(hash, state->bufferSize, state->buffer);
 }
 
 /* 2D Noise */
@@ -589,3 +1348,296 @@ float htw_simplex2dLayered(u32 seed, float sampleX, float sampleY, u32 repeat, u
     }
     return value;
 }
+
+/* Batch hashing and noise
+ * Lane-parallel versions of the hash and noise functions above. Kernels are generated from htw_random_kernels.h once
+ * per instruction set, and the best one available on the running CPU is chosen when the library is loaded. Blocks
+ * which a kernel can't handle exactly, and the remainder after the last full block, go through the scalar functions.
+ * The same kernels step the generator streams of the bulk samplers above.
+ */
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HTW_NOISE_KERNELS_X86
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define HTW_NOISE_KERNELS_NEON
+#endif
+
+// Largest sample coordinate (exclusive) that the kernels handle at any octave
+#define HTW_KERNEL_SAMPLE_LIMIT 1073741824.0f
+
+typedef struct {
+    u32 lanes;
+    void (*hash2d)(u32 seed, const u32 *xs, const u32 *ys, u32 *out);
+    void (*simplex2dLayered)(u32 seed, const float *xs, const float *ys, float *out, u32 repeat, u32 layers);
+    void (*perlin2d)(u32 seed, const float *xs, const float *ys, float *out, u32 octaves);
+    u32 (*normalStreams)(u64 *streams, float *out, u32 count, float mean, float standardDeviation, u32 *rejected, u64 *rejectedDraws);
+    void (*uniformStreams)(u64 *streams, float *out, u32 count);
+    u32 (*gammaStreams)(u64 *streams, const float *normals, u32 count, double c, double d, double bd, float *out);
+} htw_NoiseKernels;
+
+#if defined(HTW_NOISE_KERNELS_X86)
+#include <immintrin.h>
+
+// Double lanes can be wider than the target's registers. The kernels are all static, so the vector ABI never matters.
+// GCC reports this at the end of the file, so it can't be scoped to the kernels with push/pop
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// Same float lanes as AVX2, so every kernel handles the same block sizes, but all of the bulk samplers' generator
+// streams fit in one register. Both read the ziggurat tables with gathers, which SSE4.1 doesn't have
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+#define HTW_KERNEL_LANES 8
+#define HTW_KERNEL_STREAM_LANES 8
+#define HTW_KERNEL_SUFFIX _avx512
+#define HTW_KERNEL_GATHER_F64(table, index) ((htw_vqd_avx512)_mm512_i64gather_pd((__m512i)(index), table, 8))
+#define HTW_KERNEL_GATHER_U64(table, index) ((htw_vq_avx512)_mm512_i64gather_epi64((__m512i)(index), (const long long*)(table), 8))
+#define HTW_KERNEL_MOVEMASK(mask) movemask_avx512((__m512i)(mask))
+#define HTW_KERNEL_APPEND_LANES(lanes, draws, positions, outPositions, outDraws, count) \
+    appendLanes_avx512(lanes, (__m512i)(draws), (__m512i)(positions), outPositions, outDraws, count)
+#define HTW_KERNEL_COMPRESS_STORE(lanes, values, out, count) compressStore_avx512(lanes, (__m256)(values), out, count)
+
+/// internal; same as kernel_compressStore
+static inline u32 compressStore_avx512(u32 lanes, __m256 values, float *out, u32 count) {
+    _mm256_storeu_ps(&out[count], _mm512_castps512_ps256(_mm512_maskz_compress_ps(lanes, _mm512_castps256_ps512(values))));
+    return count + __builtin_popcount(lanes);
+}
+
+/// internal; same as kernel_movemask
+static inline u32 movemask_avx512(__m512i mask) {
+    return _mm512_test_epi64_mask(mask, mask);
+}
+
+/// internal; same as kernel_appendLanes, with full width stores. The kernels only append draws to lists that end before
+/// the ones they came from, so the stores past the new count stay within the block
+static inline u32 appendLanes_avx512(u32 lanes, __m512i draws, __m512i positions, u32 *outPositions, u64 *outDraws, u32 count) {
+    _mm512_storeu_si512(&outDraws[count], _mm512_maskz_compress_epi64(lanes, draws));
+    _mm256_storeu_si256((__m256i*)&outPositions[count], _mm512_cvtepi64_epi32(_mm512_maskz_compress_epi64(lanes, positions)));
+    return count + __builtin_popcount(lanes);
+}
+
+#include "htw_random_kernels.h"
+#undef HTW_KERNEL_GATHER_F64
+#undef HTW_KERNEL_GATHER_U64
+#undef HTW_KERNEL_MOVEMASK
+#undef HTW_KERNEL_APPEND_LANES
+#undef HTW_KERNEL_COMPRESS_STORE
+#undef HTW_KERNEL_LANES
+#undef HTW_KERNEL_STREAM_LANES
+#undef HTW_KERNEL_SUFFIX
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+#define HTW_KERNEL_LANES 8
+#define HTW_KERNEL_STREAM_LANES 4
+#define HTW_KERNEL_SUFFIX _avx2
+#define HTW_KERNEL_GATHER_F64(table, index) ((htw_vqd_avx2)_mm256_i64gather_pd(table, (__m256i)(index), 8))
+#define HTW_KERNEL_GATHER_U64(table, index) ((htw_vq_avx2)_mm256_i64gather_epi64((const long long*)(table), (__m256i)(index), 8))
+#define HTW_KERNEL_MOVEMASK(mask) _mm256_movemask_pd((__m256d)(mask))
+#define HTW_KERNEL_APPEND_LANES(lanes, draws, positions, outPositions, outDraws, count) \
+    appendLanes_avx2(lanes, (__m256i)(draws), (__m256i)(positions), outPositions, outDraws, count)
+#define HTW_KERNEL_COMPRESS_STORE(lanes, values, out, count) compressStore_avx2(lanes, (__m128)(values), out, count)
+
+// Lanes set in each 4 bit mask, in order, then padding; AVX2 has no compress, so it permutes by these instead
+static const u32 compressLanes_avx2[16][4] = {
+    {0, 0, 0, 0}, {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0},
+    {2, 0, 0, 0}, {0, 2, 0, 0}, {1, 2, 0, 0}, {0, 1, 2, 0},
+    {3, 0, 0, 0}, {0, 3, 0, 0}, {1, 3, 0, 0}, {0, 1, 3, 0},
+    {2, 3, 0, 0}, {0, 2, 3, 0}, {1, 2, 3, 0}, {0, 1, 2, 3},
+};
+
+/// internal; same as kernel_compressStore
+static inline u32 compressStore_avx2(u32 lanes, __m128 values, float *out, u32 count) {
+    __m128i order = _mm_loadu_si128((const __m128i*)compressLanes_avx2[lanes]);
+    _mm_storeu_ps(&out[count], _mm_permutevar_ps(values, order));
+    return count + __builtin_popcount(lanes);
+}
+
+/// internal; same as kernel_appendLanes, with full width stores, like appendLanes_avx512
+static inline u32 appendLanes_avx2(u32 lanes, __m256i draws, __m256i positions, u32 *outPositions, u64 *outDraws, u32 count) {
+    // both halves of each 64 bit lane move together
+    __m256i order = _mm256_slli_epi64(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)compressLanes_avx2[lanes])), 1);
+    order = _mm256_or_si256(order, _mm256_slli_epi64(_mm256_add_epi64(order, _mm256_set1_epi64x(1)), 32));
+    _mm256_storeu_si256((__m256i*)&outDraws[count], _mm256_permutevar8x32_epi32(draws, order));
+    __m256i packed = _mm256_permutevar8x32_epi32(_mm256_permutevar8x32_epi32(positions, order), _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+    _mm_storeu_si128((__m128i*)&outPositions[count], _mm256_castsi256_si128(packed));
+    return count + __builtin_popcount(lanes);
+}
+
+#include "htw_random_kernels.h"
+#undef HTW_KERNEL_GATHER_F64
+#undef HTW_KERNEL_GATHER_U64
+#undef HTW_KERNEL_MOVEMASK
+#undef HTW_KERNEL_APPEND_LANES
+#undef HTW_KERNEL_COMPRESS_STORE
+#undef HTW_KERNEL_LANES
+#undef HTW_KERNEL_STREAM_LANES
+#undef HTW_KERNEL_SUFFIX
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+#define HTW_KERNEL_LANES 4
+#define HTW_KERNEL_STREAM_LANES 2
+#define HTW_KERNEL_SUFFIX _sse41
+#include "htw_random_kernels.h"
+#undef HTW_KERNEL_LANES
+#undef HTW_KERNEL_STREAM_LANES
+#undef HTW_KERNEL_SUFFIX
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#elif defined(HTW_NOISE_KERNELS_NEON)
+
+#define HTW_KERNEL_LANES 4
+#define HTW_KERNEL_STREAM_LANES 2
+#define HTW_KERNEL_SUFFIX _neon
+#include "htw_random_kernels.h"
+#undef HTW_KERNEL_LANES
+#undef HTW_KERNEL_STREAM_LANES
+#undef HTW_KERNEL_SUFFIX
+
+#endif
+
+/// NULL if there is no kernel for this CPU
+static const htw_NoiseKernels *noiseKernels = NULL;
+
+#if defined(HTW_NOISE_KERNELS_X86) || defined(HTW_NOISE_KERNELS_NEON)
+/// internal; runs once when the library is loaded, so the choice never races with a caller
+__attribute__((constructor)) static void selectNoiseKernels() {
+#if defined(HTW_NOISE_KERNELS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) noiseKernels = &noiseKernels_avx512;
+    else if (__builtin_cpu_supports("avx2")) noiseKernels = &noiseKernels_avx2;
+    else if (__builtin_cpu_supports("sse4.1")) noiseKernels = &noiseKernels_sse41;
+#else
+    noiseKernels = &noiseKernels_neon;
+#endif
+}
+#endif
+
+/// internal; true if every sample stays within the range the kernels handle exactly, through every octave
+static int isKernelSafe(const float *xs, const float *ys, size_t count, u32 octaves) {
+    float limit = HTW_KERNEL_SAMPLE_LIMIT;
+    if (octaves > 1) {
+        limit = ldexpf(limit, -(int)MIN(octaves - 1, 64));
+    }
+    for (size_t i = 0; i < count; i++) {
+        // also rejects NaN
+        if (!(xs[i] >= 0.0f && xs[i] < limit && ys[i] >= 0.0f && ys[i] < limit)) return 0;
+    }
+    return 1;
+}
+
+/// internal; same as [count] calls to xxh_hash2d, where count is a multiple of every kernel width
+static inline void hash2dLanes(u32 seed, const u32 *xs, const u32 *ys, u32 *out, u32 count) {
+    const htw_NoiseKernels *kernels = noiseKernels;
+    if (kernels != NULL) {
+        for (u32 i = 0; i < count; i += kernels->lanes) {
+            kernels->hash2d(seed, &xs[i], &ys[i], &out[i]);
+        }
+    } else {
+        for (u32 i = 0; i < count; i++) {
+            out[i] = xxh_hash2d(seed, xs[i], ys[i]);
+        }
+    }
+}
+
+/// internal; normalStreamsScalar, with the kernel for this CPU if there is one
+static u32 normalStreams(u64 *streams, float *out, u32 count, float mean, float standardDeviation, u32 *rejected, u64 *rejectedDraws) {
+    const htw_NoiseKernels *kernels = noiseKernels;
+    if (kernels != NULL) {
+        return kernels->normalStreams(streams, out, count, mean, standardDeviation, rejected, rejectedDraws);
+    }
+    return normalStreamsScalar(streams, out, count, mean, standardDeviation, rejected, rejectedDraws);
+}
+
+/// internal; uniformStreamsScalar, with the kernel for this CPU if there is one
+static void uniformStreams(u64 *streams, float *out, u32 count) {
+    const htw_NoiseKernels *kernels = noiseKernels;
+    if (kernels != NULL) {
+        kernels->uniformStreams(streams, out, count);
+    } else {
+        uniformStreamsScalar(streams, out, count);
+    }
+}
+
+/// internal; gammaStreamsScalar, with the kernel for this CPU if there is one
+static u32 gammaStreams(u64 *streams, const float *normals, u32 count, double c, double d, double bd, float *out) {
+    const htw_NoiseKernels *kernels = noiseKernels;
+    if (kernels != NULL) {
+        return kernels->gammaStreams(streams, normals, count, c, d, bd, out);
+    }
+    return gammaStreamsScalar(streams, normals, count, c, d, bd, out);
+}
+
+void xxh_hash2d_x8(u32 seed, const u32 *xs, const u32 *ys, u32 *out) {
+    hash2dLanes(seed, xs, ys, out, 8);
+}
+
+void xxh_hash2d_x16(u32 seed, const u32 *xs, const u32 *ys, u32 *out) {
+    hash2dLanes(seed, xs, ys, out, 16);
+}
+
+void htw_perlin2dBatch(u32 seed, const float *xs, const float *ys, float *out, size_t count, u32 octaves) {
+    const htw_NoiseKernels *kernels = noiseKernels;
+    size_t i = 0;
+    if (kernels != NULL) {
+        for (; i + kernels->lanes <= count; i += kernels->lanes) {
+            if (isKernelSafe(&xs[i], &ys[i], kernels->lanes, octaves)) {
+                kernels->perlin2d(seed, &xs[i], &ys[i], &out[i], octaves);
+            } else {
+                for (size_t l = i; l < i + kernels->lanes; l++) {
+                    out[l] = htw_perlin2d(seed, xs[l], ys[l], octaves);
+                }
+            }
+        }
+    }
+    for (; i < count; i++) {
+        out[i] = htw_perlin2d(seed, xs[i], ys[i], octaves);
+    }
+}
+
+void htw_simplex2dLayeredBatch(u32 seed, const float *xs, const float *ys, float *out, size_t count, u32 repeat, u32 layers) {
+    const htw_NoiseKernels *kernels = noiseKernels;
+    size_t i = 0;
+    if (kernels != NULL) {
+        for (; i + kernels->lanes <= count; i += kernels->lanes) {
+            if (isKernelSafe(&xs[i], &ys[i], kernels->lanes, layers)) {
+                kernels->simplex2dLayered(seed, &xs[i], &ys[i], &out[i], repeat, layers);
+            } else {
+                for (size_t l = i; l < i + kernels->lanes; l++) {
+                    out[l] = htw_simplex2dLayered(seed, xs[l], ys[l], repeat, layers);
+                }
+            }
+        }
+    }
+    for (; i < count; i++) {
+        out[i] = htw_simplex2dLayered(seed, xs[i], ys[i], repeat, layers);
+    }
+}
@@ -0,0 +1,478 @@
+/* Lane-parallel hash, noise, and sampling kernels, used by the batch and bulk functions in htw_random.c
+ *
+ * NOTE: this is a template, not a regular header. htw_random.c includes it once per instruction set, with
+ * HTW_KERNEL_LANES and HTW_KERNEL_SUFFIX defined and the matching target pragmas active, so there is no include guard.
+ *
+ * Every step mirrors the scalar implementation in htw_random.c, including each place where the scalar code promotes to
+ * double, so results are bit for bit identical to calling the scalar functions one sample at a time. To keep that
+ * guarantee without relying on how the platform converts negative floats to u32, lanes are only valid for sample
+ * coordinates in [0, HTW_KERNEL_SAMPLE_LIMIT) at every octave; the caller checks this and falls back to the scalar
+ * functions for any block that doesn't fit. The sampling kernels step the HTW_RAND_STREAMS generators of the bulk
+ * samplers HTW_KERNEL_STREAM_LANES at a time, also defined by htw_random.c, and match the scalar stream functions the
+ * same way.
+ */
+
+#define HTW_KERNEL_CONCAT_(a, b) a##b
+#define HTW_KERNEL_CONCAT(a, b) HTW_KERNEL_CONCAT_(a, b)
+#define HTW_KERNEL_FN(name) HTW_KERNEL_CONCAT(name, HTW_KERNEL_SUFFIX)
+
+#define vf_t HTW_KERNEL_FN(htw_vf)
+#define vd_t HTW_KERNEL_FN(htw_vd)
+#define vs_t HTW_KERNEL_FN(htw_vs)
+#define vu_t HTW_KERNEL_FN(htw_vu)
+#define vu64_t HTW_KERNEL_FN(htw_vu64)
+
+typedef float vf_t __attribute__((vector_size(HTW_KERNEL_LANES * sizeof(float))));
+typedef double vd_t __attribute__((vector_size(HTW_KERNEL_LANES * sizeof(double))));
+typedef s32 vs_t __attribute__((vector_size(HTW_KERNEL_LANES * sizeof(s32))));
+typedef u32 vu_t __attribute__((vector_size(HTW_KERNEL_LANES * sizeof(u32))));
+typedef u64 vu64_t __attribute__((vector_size(HTW_KERNEL_LANES * sizeof(u64))));
+
+// The sampling kernels work on u64 generator state, in vectors of HTW_KERNEL_STREAM_LANES, one register wide
+#define vq_t HTW_KERNEL_FN(htw_vq)
+#define vqd_t HTW_KERNEL_FN(htw_vqd)
+#define vqs_t HTW_KERNEL_FN(htw_vqs)
+#define vqf_t HTW_KERNEL_FN(htw_vqf)
+#define vqi_t HTW_KERNEL_FN(htw_vqi)
+
+typedef u64 vq_t __attribute__((vector_size(HTW_KERNEL_STREAM_LANES * sizeof(u64))));
+typedef s64 vqi_t __attribute__((vector_size(HTW_KERNEL_STREAM_LANES * sizeof(s64))));
+typedef double vqd_t __attribute__((vector_size(HTW_KERNEL_STREAM_LANES * sizeof(double))));
+typedef s32 vqs_t __attribute__((vector_size(HTW_KERNEL_STREAM_LANES * sizeof(s32))));
+typedef float vqf_t __attribute__((vector_size(HTW_KERNEL_STREAM_LANES * sizeof(float))));
+
+/// internal; same steps as xxh_hash2d
+static inline vu_t HTW_KERNEL_FN(kernel_hash2d)(u32 seed, vu_t x, vu_t y) {
+    vu_t hash = (vu_t){0} + (seed + XXH_PRIME32_5 + 2 * 4);
+    hash += x * XXH_PRIME32_3;
+    hash = ((hash << 17) | (hash >> 15)) * XXH_PRIME32_4;
+    hash += y * XXH_PRIME32_3;
+    hash = ((hash << 17) | (hash >> 15)) * XXH_PRIME32_4;
+
+    hash ^= hash >> 15;
+    hash *= XXH_PRIME32_2;
+    hash ^= hash >> 13;
+    hash *= XXH_PRIME32_3;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/// internal; (float)hash, rounded once through an exact u32 -> double conversion
+static inline vf_t HTW_KERNEL_FN(kernel_hashToFloat)(vu_t hash) {
+    vd_t d = __builtin_convertvector((vs_t)(hash ^ 0x80000000U), vd_t) + 2147483648.0;
+    return __builtin_convertvector(d, vf_t);
+}
+
+/// internal; a macro rather than a function, since a double vector argument is wider than the ABI passes in registers
+#define kernel_fabs(v) ((vd_t)((vu64_t)(v) & 0x7FFFFFFFFFFFFFFFULL))
+
+/// internal; v % repeat for v in [0, 2^31). Quotient is exact in double, so truncating it gives the integer quotient
+static inline vs_t HTW_KERNEL_FN(kernel_wrap)(vs_t v, double repeat) {
+    vd_t d = __builtin_convertvector(v, vd_t);
+    vd_t quotient = __builtin_convertvector(__builtin_convertvector(d / repeat, vs_t), vd_t);
+    return __builtin_convertvector(d - (quotient * repeat), vs_t);
+}
+
+/// Same as HTW_KERNEL_LANES calls to xxh_hash2d
+static void HTW_KERNEL_FN(kernel_hash2d_block)(u32 seed, const u32 *xs, const u32 *ys, u32 *out) {
+    vu_t x, y;
+    memcpy(&x, xs, sizeof(vu_t));
+    memcpy(&y, ys, sizeof(vu_t));
+    vu_t hash = HTW_KERNEL_FN(kernel_hash2d)(seed, x, y);
+    memcpy(out, &hash, sizeof(vu_t));
+}
+
+/// Same as HTW_KERNEL_LANES calls to htw_simplex2dLayered
+static void HTW_KERNEL_FN(kernel_simplex2dLayered)(u32 seed, const float *xs, const float *ys, float *out, u32 repeat, u32 layers) {
+    vf_t scaledX, scaledY;
+    memcpy(&scaledX, xs, sizeof(vf_t));
+    memcpy(&scaledY, ys, sizeof(vf_t));
+    vf_t value = {0};
+
+    u32 numerator = pow(2, layers - 1);
+    u32 denominator = pow(2, layers) - 1;
+    for (int i = 0; i < layers; i++) {
+        float weight = (float)numerator / denominator;
+        numerator = numerator >> 1;
+
+        // modff, for non-negative samples
+        vs_t x = __builtin_convertvector(scaledX, vs_t);
+        vs_t y = __builtin_convertvector(scaledY, vs_t);
+        vf_t fractX = scaledX - __builtin_convertvector(x, vf_t);
+        vf_t fractY = scaledY - __builtin_convertvector(y, vf_t);
+
+        // all bits set in lanes where simplex == 1
+        vs_t simplex = (fractX + fractY) >= 1.0f;
+
+        vs_t x0 = HTW_KERNEL_FN(kernel_wrap)(x, repeat);
+        vs_t x1 = HTW_KERNEL_FN(kernel_wrap)(x + 1, repeat);
+        vs_t y0 = HTW_KERNEL_FN(kernel_wrap)(y, repeat);
+        vs_t y1 = HTW_KERNEL_FN(kernel_wrap)(y + 1, repeat);
+        vs_t x3 = (simplex & x1) | (~simplex & x0);
+        vs_t y3 = (simplex & y1) | (~simplex & y0);
+
+        vf_t k1 = HTW_KERNEL_FN(kernel_hashToFloat)(HTW_KERNEL_FN(kernel_hash2d)(seed, (vu_t)x1, (vu_t)y0)) / (float)UINT32_MAX;
+        vf_t k2 = HTW_KERNEL_FN(kernel_hashToFloat)(HTW_KERNEL_FN(kernel_hash2d)(seed, (vu_t)x0, (vu_t)y1)) / (float)UINT32_MAX;
+        vf_t k3 = HTW_KERNEL_FN(kernel_hashToFloat)(HTW_KERNEL_FN(kernel_hash2d)(seed, (vu_t)x3, (vu_t)y3)) / (float)UINT32_MAX;
+
+        vd_t fractXd = __builtin_convertvector(fractX, vd_t);
+        vd_t fractYd = __builtin_convertvector(fractY, vd_t);
+        vd_t fractSumd = __builtin_convertvector(fractX + fractY, vd_t);
+        vf_t simplexf = __builtin_convertvector(-simplex, vf_t);
+
+        vf_t d1 = __builtin_convertvector((kernel_fabs(fractXd - 1.0) + kernel_fabs(fractSumd - 1.0 - 0.0) + kernel_fabs(fractYd - 0.0)) / 2.0, vf_t);
+        vf_t d2 = __builtin_convertvector((kernel_fabs(fractXd - 0.0) + kernel_fabs(fractSumd - 0.0 - 1.0) + kernel_fabs(fractYd - 1.0)) / 2.0, vf_t);
+        vf_t d3 = __builtin_convertvector((
+            kernel_fabs(__builtin_convertvector(fractX - simplexf, vd_t)) +
+            kernel_fabs(__builtin_convertvector(fractX + fractY - simplexf - simplexf, vd_t)) +
+            kernel_fabs(__builtin_convertvector(fractY - simplexf, vd_t))) / 2.0, vf_t);
+
+        vf_t c1 = __builtin_convertvector(__builtin_convertvector(k1, vd_t) * (1.0 - __builtin_convertvector(d1, vd_t)), vf_t);
+        vf_t c2 = __builtin_convertvector(__builtin_convertvector(k2, vd_t) * (1.0 - __builtin_convertvector(d2, vd_t)), vf_t);
+        vf_t c3 = __builtin_convertvector(__builtin_convertvector(k3, vd_t) * (1.0 - __builtin_convertvector(d3, vd_t)), vf_t);
+
+        value += (c1 + c2 + c3) * weight;
+        scaledX = __builtin_convertvector(__builtin_convertvector(scaledX, vd_t) * 2.0, vf_t);
+        scaledY = __builtin_convertvector(__builtin_convertvector(scaledY, vd_t) * 2.0, vf_t);
+        repeat *= 2;
+    }
+
+    memcpy(out, &value, sizeof(vf_t));
+}
+
+/// Same as HTW_KERNEL_LANES calls to htw_perlin2d
+static void HTW_KERNEL_FN(kernel_perlin2d)(u32 seed, const float *xs, const float *ys, float *out, u32 octaves) {
+    vf_t scaledX, scaledY;
+    memcpy(&scaledX, xs, sizeof(vf_t));
+    memcpy(&scaledY, ys, sizeof(vf_t));
+    vf_t value = {0};
+
+    u32 numerator = pow(2, octaves - 1);
+    u32 denominator = pow(2, octaves) - 1;
+    for (int i = 0; i < octaves; i++) {
+        float weight = (float)numerator / denominator;
+        numerator = numerator >> 1;
+
+        // htw_value2d
+        vs_t x = __builtin_convertvector(scaledX, vs_t);
+        vs_t y = __builtin_convertvector(scaledY, vs_t);
+        vd_t fractXd = __builtin_convertvector(scaledX - __builtin_convertvector(x, vf_t), vd_t);
+        vd_t fractYd = __builtin_convertvector(scaledY - __builtin_convertvector(y, vf_t), vd_t);
+
+        vd_t s1 = __builtin_convertvector(HTW_KERNEL_FN(kernel_hashToFloat)(HTW_KERNEL_FN(kernel_hash2d)(seed, (vu_t)x, (vu_t)y)), vd_t);
+        vd_t s2 = __builtin_convertvector(HTW_KERNEL_FN(kernel_hashToFloat)(HTW_KERNEL_FN(kernel_hash2d)(seed, (vu_t)(x + 1), (vu_t)y)), vd_t);
+        vd_t s3 = __builtin_convertvector(HTW_KERNEL_FN(kernel_hashToFloat)(HTW_KERNEL_FN(kernel_hash2d)(seed, (vu_t)x, (vu_t)(y + 1))), vd_t);
+        vd_t s4 = __builtin_convertvector(HTW_KERNEL_FN(kernel_hashToFloat)(HTW_KERNEL_FN(kernel_hash2d)(seed, (vu_t)(x + 1), (vu_t)(y + 1))), vd_t);
+
+        // lerp
+        vd_t l1 = __builtin_convertvector(__builtin_convertvector((s1 * (1.0 - fractXd)) + (s2 * fractXd), vf_t), vd_t);
+        vd_t l2 = __builtin_convertvector(__builtin_convertvector((s3 * (1.0 - fractXd)) + (s4 * fractXd), vf_t), vd_t);
+        vf_t l3 = __builtin_convertvector((l1 * (1.0 - fractYd)) + (l2 * fractYd), vf_t);
+
+        value += (l3 / (float)UINT32_MAX) * weight;
+        scaledX = __builtin_convertvector(__builtin_convertvector(scaledX, vd_t) * 2.0, vf_t);
+        scaledY = __builtin_convertvector(__builtin_convertvector(scaledY, vd_t) * 2.0, vf_t);
+    }
+
+    memcpy(out, &value, sizeof(vf_t));
+}
+
+/// internal; same steps as nextRand64, for one generator per lane, with each word of state in its own vector. There is
+/// no 64 bit vector multiply before AVX-512, so the multiplies by 5 and 9 are shifts and adds
+static inline vq_t HTW_KERNEL_FN(kernel_nextRand64)(vq_t *s0, vq_t *s1, vq_t *s2, vq_t *s3) {
+    vq_t times5 = (*s1 << 2) + *s1;
+    vq_t rotated = (times5 << 7) | (times5 >> 57);
+    vq_t result = (rotated << 3) + rotated;
+    vq_t t = *s1 << 17;
+
+    *s2 ^= *s0;
+    *s3 ^= *s1;
+    *s1 ^= *s2;
+    *s0 ^= *s3;
+
+    *s2 ^= t;
+    *s3 = (*s3 << 45) | (*s3 >> 19);
+
+    return result;
+}
+
+// Loads and stores all HTW_RAND_STREAMS generators, laid out as in seedStreams, as HTW_KERNEL_STREAM_VECTORS vectors
+// per word of state. The kernels step every vector in each iteration, so that their dependency chains overlap
+#define HTW_KERNEL_STREAM_VECTORS (HTW_RAND_STREAMS / HTW_KERNEL_STREAM_LANES)
+// unrolled, so that the state arrays are kept in registers
+#if defined(__clang__)
+#define KERNEL_UNROLL_STREAMS _Pragma("unroll")
+#else
+#define KERNEL_UNROLL_STREAMS _Pragma("GCC unroll 8")
+#endif
+#define KERNEL_LOAD_STREAMS(streams, s0, s1, s2, s3) \
+    memcpy(s0, &streams[0 * HTW_RAND_STREAMS], sizeof(s0)); \
+    memcpy(s1, &streams[1 * HTW_RAND_STREAMS], sizeof(s1)); \
+    memcpy(s2, &streams[2 * HTW_RAND_STREAMS], sizeof(s2)); \
+    memcpy(s3, &streams[3 * HTW_RAND_STREAMS], sizeof(s3))
+#define KERNEL_STORE_STREAMS(streams, s0, s1, s2, s3) \
+    memcpy(&streams[0 * HTW_RAND_STREAMS], s0, sizeof(s0)); \
+    memcpy(&streams[1 * HTW_RAND_STREAMS], s1, sizeof(s1)); \
+    memcpy(&streams[2 * HTW_RAND_STREAMS], s2, sizeof(s2)); \
+    memcpy(&streams[3 * HTW_RAND_STREAMS], s3, sizeof(s3))
+
+// Table lookups and mask tests, one lane at a time unless the instruction set has its own (see htw_random.c)
+#ifndef HTW_KERNEL_GATHER_F64
+/// internal
+static inline vqd_t HTW_KERNEL_FN(kernel_gatherF64)(const double *table, vq_t index) {
+    vqd_t result;
+    for (int l = 0; l < HTW_KERNEL_STREAM_LANES; l++) result[l] = table[index[l]];
+    return result;
+}
+/// internal
+static inline vq_t HTW_KERNEL_FN(kernel_gatherU64)(const u64 *table, vq_t index) {
+    vq_t result;
+    for (int l = 0; l < HTW_KERNEL_STREAM_LANES; l++) result[l] = table[index[l]];
+    return result;
+}
+/// internal; bit l set if lane l of [mask] is
+static inline u32 HTW_KERNEL_FN(kernel_movemask)(vqi_t mask) {
+    u32 bits = 0;
+    for (int l = 0; l < HTW_KERNEL_STREAM_LANES; l++) bits |= (u32)(mask[l] != 0) << l;
+    return bits;
+}
+#define KERNEL_GATHER_F64(table, index) HTW_KERNEL_FN(kernel_gatherF64)(table, index)
+#define KERNEL_GATHER_U64(table, index) HTW_KERNEL_FN(kernel_gatherU64)(table, index)
+#define KERNEL_MOVEMASK(mask) HTW_KERNEL_FN(kernel_movemask)(mask)
+#else
+#define KERNEL_GATHER_F64(table, index) HTW_KERNEL_GATHER_F64(table, index)
+#define KERNEL_GATHER_U64(table, index) HTW_KERNEL_GATHER_U64(table, index)
+#define KERNEL_MOVEMASK(mask) HTW_KERNEL_MOVEMASK(mask)
+#endif
+#ifndef HTW_KERNEL_COMPRESS_STORE
+/// internal; writes the lanes of [values] set in [lanes] to [out], after the [count] already there, and returns the new
+/// count. Can write as far as a whole vector past the count
+static inline u32 HTW_KERNEL_FN(kernel_compressStore)(u32 lanes, vqf_t values, float *out, u32 count) {
+    for (int l = 0; l < HTW_KERNEL_STREAM_LANES; l++) {
+        out[count] = values[l];
+        count += (lanes >> l) & 1;
+    }
+    return count;
+}
+#define KERNEL_COMPRESS_STORE(lanes, values, out, count) HTW_KERNEL_FN(kernel_compressStore)(lanes, values, out, count)
+#else
+#define KERNEL_COMPRESS_STORE(lanes, values, out, count) HTW_KERNEL_COMPRESS_STORE(lanes, values, out, count)
+#endif
+#ifndef HTW_KERNEL_APPEND_LANES
+/// internal; appends the lanes of [draws] and [positions] set in [lanes] to [outDraws] and [outPositions], after the
+/// [count] already there. Returns the new count
+static inline u32 HTW_KERNEL_FN(kernel_appendLanes)(u32 lanes, vq_t draws, vq_t positions, u32 *outPositions, u64 *outDraws, u32 count) {
+    for (; lanes != 0; lanes &= lanes - 1) {
+        int l = __builtin_ctz(lanes);
+        outPositions[count] = positions[l];
+        outDraws[count] = draws[l];
+        count++;
+    }
+    return count;
+}
+#define KERNEL_APPEND_LANES(lanes, draws, positions, outPositions, outDraws, count) HTW_KERNEL_FN(kernel_appendLanes)(lanes, draws, positions, outPositions, outDraws, count)
+#else
+#define KERNEL_APPEND_LANES(lanes, draws, positions, outPositions, outDraws, count) HTW_KERNEL_APPEND_LANES(lanes, draws, positions, outPositions, outDraws, count)
+#endif
+
+/// internal; exact conversion of integers below 2^52: placed in the mantissa of 2^52, which is then subtracted
+#define KERNEL_SMALL_U64_TO_F64(v) ((vqd_t)((v) | 0x4330000000000000ULL) - 4503599627370496.0)
+/// internal; same as unitDouble
+#define KERNEL_UNIT_F64(bits) ((vqd_t)((bits) | 0x3FF0000000000000ULL) - 1.0)
+
+/// internal; same steps as wedgeExp
+static inline vqd_t HTW_KERNEL_FN(kernel_wedgeExp)(vqd_t a) {
+    vqd_t shifted = (a * (1.0 / M_LN2)) + HTW_RAND_ROUNDING_SHIFT;
+    vqd_t n = shifted - HTW_RAND_ROUNDING_SHIFT;
+    vqd_t r = (a - (n * HTW_RAND_LN2_HI)) - (n * HTW_RAND_LN2_LO);
+    vqd_t scale = (vqd_t)(((vq_t)shifted + 1023) << 52);
+    vqd_t r2 = r * r;
+    return HTW_RAND_EXP_POLYNOMIAL(r, r2, r2 * r2) * scale;
+}
+
+/// internal; same steps as squeezeLog
+static inline vqd_t HTW_KERNEL_FN(kernel_squeezeLog)(vqd_t a) {
+    vqi_t e = ((vqi_t)a - (s64)HTW_RAND_SQRT_HALF_BITS) >> 52;
+    vqd_t m = (vqd_t)((vqi_t)a - (e << 52));
+    vqd_t s = (m - 1.0) / (m + 1.0);
+    // exponents are small, so the bias keeps them in range of the exact conversion
+    vqd_t exponent = KERNEL_SMALL_U64_TO_F64((vq_t)(e + 1024)) - 1024.0;
+    vqd_t s2 = s * s;
+    return ((exponent * HTW_RAND_LN2_HI) + (s * HTW_RAND_LOG_POLYNOMIAL(s2, s2 * s2))) + (exponent * HTW_RAND_LN2_LO);
+}
+
+/// Same as normalStreamsScalar, except that rejected draws aren't in order
+static u32 HTW_KERNEL_FN(kernel_normalStreams)(u64 *streams, float *out, u32 count, float mean, float standardDeviation, u32 *rejected, u64 *rejectedDraws) {
+    vqd_t scale = (vqd_t){0} + (double)standardDeviation;
+    vq_t laneOffsets;
+    for (int l = 0; l < HTW_KERNEL_STREAM_LANES; l++) laneOffsets[l] = l;
+    u32 candidateCount = 0;
+    vq_t s0[HTW_KERNEL_STREAM_VECTORS], s1[HTW_KERNEL_STREAM_VECTORS], s2[HTW_KERNEL_STREAM_VECTORS], s3[HTW_KERNEL_STREAM_VECTORS];
+    KERNEL_LOAD_STREAMS(streams, s0, s1, s2, s3);
+    for (u32 block = 0; block < count; block += HTW_RAND_STREAMS) {
+        KERNEL_UNROLL_STREAMS
+        for (int v = 0; v < HTW_KERNEL_STREAM_VECTORS; v++) {
+            u32 i = block + (v * HTW_KERNEL_STREAM_LANES);
+            vq_t k = HTW_KERNEL_FN(kernel_nextRand64)(&s0[v], &s1[v], &s2[v], &s3[v]);
+            vq_t step = k & 0x7F;
+            vq_t j = k >> 40;
+            vqd_t magnitude = KERNEL_SMALL_U64_TO_F64(j) * KERNEL_GATHER_F64(wtab, step);
+            // negative when bit 7 of the draw is clear, the same as the sign in gsl_ran_gaussian_ziggurat_try
+            vqd_t x = (vqd_t)((vq_t)magnitude ^ (((k & 0x80) ^ 0x80) << 56));
+            vqf_t value = __builtin_convertvector(scale * x, vqf_t) + mean;
+            memcpy(&out[i], &value, sizeof(vqf_t));
+
+            // both are below 2^32, so a signed compare is the same
+            u32 outside = KERNEL_MOVEMASK((vqi_t)j >= (vqi_t)KERNEL_GATHER_U64(ktab, step));
+            candidateCount = KERNEL_APPEND_LANES(outside, k, laneOffsets + i, rejected, rejectedDraws, candidateCount);
+        }
+    }
+    KERNEL_STORE_STREAMS(streams, s0, s1, s2, s3);
+
+    // wedge tests for the draws outside their step, as in tryNormal, a vector at a time. Only about 3% of draws get
+    // here, so they are collected first to keep the loop above short. Draws that fail the test are packed down in place.
+    // The base strip has no wedge, and its draws are rejected whatever the test says, so its out of range table entry
+    // is never used. Padding draws fill out the last vector, but are never reported
+    for (u32 c = candidateCount; c % HTW_KERNEL_STREAM_LANES != 0; c++) {
+        rejected[c] = 0;
+        rejectedDraws[c] = 0;
+    }
+    u32 rejectedCount = 0;
+    for (u32 c = 0; c < candidateCount; c += HTW_KERNEL_STREAM_LANES) {
+        vq_t k;
+        memcpy(&k, &rejectedDraws[c], sizeof(vq_t));
+        vqs_t positions;
+        memcpy(&positions, &rejected[c], sizeof(vqs_t));
+        vq_t step = k & 0x7F;
+        vqd_t magnitude = KERNEL_SMALL_U64_TO_F64(k >> 40) * KERNEL_GATHER_F64(wtab, step);
+        vqd_t y1 = KERNEL_GATHER_F64(ytab, (step + 1) & 0x7F);
+        vqd_t y = y1 + ((KERNEL_GATHER_F64(ytab, step) - y1) * KERNEL_UNIT_F64(((k >> 8) & 0xFFFFFFFF) << 20));
+        vqi_t reject = ~(y < HTW_KERNEL_FN(kernel_wedgeExp)(-0.5 * magnitude * magnitude)) | (vqi_t)(step == 127);
+        u32 lanes = KERNEL_MOVEMASK(reject);
+        if (candidateCount - c < HTW_KERNEL_STREAM_LANES) lanes &= (1U << (candidateCount - c)) - 1;
+        rejectedCount = KERNEL_APPEND_LANES(lanes, k, __builtin_convertvector(positions, vq_t), rejected, rejectedDraws, rejectedCount);
+    }
+    return rejectedCount;
+}
+
+/// Same as uniformStreamsScalar
+static void HTW_KERNEL_FN(kernel_uniformStreams)(u64 *streams, float *out, u32 count) {
+    vq_t s0[HTW_KERNEL_STREAM_VECTORS], s1[HTW_KERNEL_STREAM_VECTORS], s2[HTW_KERNEL_STREAM_VECTORS], s3[HTW_KERNEL_STREAM_VECTORS];
+    KERNEL_LOAD_STREAMS(streams, s0, s1, s2, s3);
+    for (u32 block = 0; block < count; block += HTW_RAND_STREAMS) {
+        KERNEL_UNROLL_STREAMS
+        for (int v = 0; v < HTW_KERNEL_STREAM_VECTORS; v++) {
+            u32 i = block + (v * HTW_KERNEL_STREAM_LANES);
+            vq_t k = HTW_KERNEL_FN(kernel_nextRand64)(&s0[v], &s1[v], &s2[v], &s3[v]);
+            vqs_t bits = __builtin_convertvector(k >> 41, vqs_t) | 0x3F800000;
+            vqf_t value = (vqf_t)bits - 1.0f;
+            memcpy(&out[i], &value, sizeof(vqf_t));
+        }
+    }
+    KERNEL_STORE_STREAMS(streams, s0, s1, s2, s3);
+}
+
+/// Same as gammaStreamsScalar. Candidates that miss the squeeze are collected, and their log tests run a vector at a
+/// time afterwards. Values are written to [out] as they're made, then the accepted ones packed down in place
+static u32 HTW_KERNEL_FN(kernel_gammaStreams)(u64 *streams, const float *normals, u32 count, double c, double d, double bd, float *out) {
+    // accepted lanes, as a bit mask per vector
+    u32 accepted[HTW_RAND_BLOCK_SIZE / HTW_KERNEL_STREAM_LANES];
+    u32 misses[HTW_RAND_BLOCK_SIZE];
+    u64 missUniforms[HTW_RAND_BLOCK_SIZE];
+    u32 missCount = 0;
+    vq_t laneOffsets;
+    for (int l = 0; l < HTW_KERNEL_STREAM_LANES; l++) laneOffsets[l] = l;
+    vq_t s0[HTW_KERNEL_STREAM_VECTORS], s1[HTW_KERNEL_STREAM_VECTORS], s2[HTW_KERNEL_STREAM_VECTORS], s3[HTW_KERNEL_STREAM_VECTORS];
+    KERNEL_LOAD_STREAMS(streams, s0, s1, s2, s3);
+    for (u32 block = 0; block < count; block += HTW_RAND_STREAMS) {
+        KERNEL_UNROLL_STREAMS
+        for (int v = 0; v < HTW_KERNEL_STREAM_VECTORS; v++) {
+            u32 i = block + (v * HTW_KERNEL_STREAM_LANES);
+            vq_t k = HTW_KERNEL_FN(kernel_nextRand64)(&s0[v], &s1[v], &s2[v], &s3[v]);
+            vqd_t u = 1.0 - KERNEL_UNIT_F64(k >> 12);
+            vqf_t normal;
+            memcpy(&normal, &normals[i], sizeof(vqf_t));
+            vqd_t x = __builtin_convertvector(normal, vqd_t);
+            vqd_t v = 1.0 + (c * x);
+            vqf_t value = __builtin_convertvector(bd * (v * v * v), vqf_t);
+            memcpy(&out[i], &value, sizeof(vqf_t));
+
+            vqi_t valid = v > 0;
+            vqi_t squeezed = u < 1 - (0.0331 * x * x * x * x);
+            accepted[i / HTW_KERNEL_STREAM_LANES] = KERNEL_MOVEMASK(valid & squeezed);
+            missCount = KERNEL_APPEND_LANES(KERNEL_MOVEMASK(valid & ~squeezed), (vq_t)u, laneOffsets + i, misses, missUniforms, missCount);
+        }
+    }
+    KERNEL_STORE_STREAMS(streams, s0, s1, s2, s3);
+
+    // padding fills out the last vector with a candidate that is never used
+    for (u32 m = missCount; m % HTW_KERNEL_STREAM_LANES != 0; m++) {
+        misses[m] = 0;
+        missUniforms[m] = 0x3FF0000000000000ULL;
+    }
+    // the log tests don't depend on each other, so they all run before any of their lanes are marked; the marking
+    // would otherwise hold up the next test
+    u32 passed[HTW_RAND_BLOCK_SIZE / HTW_KERNEL_STREAM_LANES];
+    for (u32 m = 0; m < missCount; m += HTW_KERNEL_STREAM_LANES) {
+        vqd_t u;
+        memcpy(&u, &missUniforms[m], sizeof(vqd_t));
+        vqd_t x;
+        for (int l = 0; l < HTW_KERNEL_STREAM_LANES; l++) x[l] = normals[misses[m + l]];
+        vqd_t v = 1.0 + (c * x);
+        vqd_t v3 = v * v * v;
+        vqi_t logTest = HTW_KERNEL_FN(kernel_squeezeLog)(u) < 0.5 * x * x + d * (1 - v3 + HTW_KERNEL_FN(kernel_squeezeLog)(v3));
+        passed[m / HTW_KERNEL_STREAM_LANES] = KERNEL_MOVEMASK(logTest);
+    }
+    for (u32 m = 0; m < missCount; m++) {
+        u32 i = misses[m];
+        u32 lane = (passed[m / HTW_KERNEL_STREAM_LANES] >> (m % HTW_KERNEL_STREAM_LANES)) & 1;
+        accepted[i / HTW_KERNEL_STREAM_LANES] |= lane << (i % HTW_KERNEL_STREAM_LANES);
+    }
+
+    u32 acceptedCount = 0;
+    for (u32 i = 0; i < count; i += HTW_KERNEL_STREAM_LANES) {
+        vqf_t value;
+        memcpy(&value, &out[i], sizeof(vqf_t));
+        acceptedCount = KERNEL_COMPRESS_STORE(accepted[i / HTW_KERNEL_STREAM_LANES], value, out, acceptedCount);
+    }
+    return acceptedCount;
+}
+
+#undef KERNEL_LOAD_STREAMS
+#undef KERNEL_GATHER_F64
+#undef KERNEL_GATHER_U64
+#undef KERNEL_MOVEMASK
+#undef KERNEL_APPEND_LANES
+#undef KERNEL_COMPRESS_STORE
+#undef KERNEL_SMALL_U64_TO_F64
+#undef KERNEL_UNIT_F64
+#undef KERNEL_STORE_STREAMS
+#undef HTW_KERNEL_STREAM_VECTORS
+#undef KERNEL_UNROLL_STREAMS
+
+static const htw_NoiseKernels HTW_KERNEL_FN(noiseKernels) = {
+    .lanes = HTW_KERNEL_LANES,
+    .hash2d = HTW_KERNEL_FN(kernel_hash2d_block),
+    .simplex2dLayered = HTW_KERNEL_FN(kernel_simplex2dLayered),
+    .perlin2d = HTW_KERNEL_FN(kernel_perlin2d),
+    .normalStreams = HTW_KERNEL_FN(kernel_normalStreams),
+    .uniformStreams = HTW_KERNEL_FN(kernel_uniformStreams),
+    .gammaStreams = HTW_KERNEL_FN(kernel_gammaStreams),
+};
+
+
+#undef kernel_fabs
+#undef vf_t
+#undef vd_t
+#undef vs_t
+#undef vu_t
+#undef vu64_t
+#undef vq_t
+#undef vqd_t
+#undef vqs_t
+#undef vqf_t
+#undef vqi_t
+#undef HTW_KERNEL_FN
+#undef HTW_KERNEL_CONCAT
+#undef HTW_KERNEL_CONCAT_
@@ -1,7 +1,12 @@
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <math.h>
+#include <limits.h>
+#include <unistd.h>
 #include "htw_core.h"
 #include "htw_random.h"
+#include "htw_geomap.h"
 
 /** TODO: assert macros (or functions, if it works) should display:
  * - a description of the condition that failed
@@ -39,30 +44,232 @@ void printBuckets(int num_buckets, int num_trials, float min, float max, int *bu
     }
 }
 
+// context for test_parallelFor: counts how many times each item was visited
+void countVisits(void *context, u32 start, u32 end) {
+    _Atomic u32 *visits = context;
+    for (u32 i = start; i < end; i++) {
+        visits[i]++;
+    }
+}
+
+// context for test_parallelFor: starts a loop of 10 items for each item, from inside the outer loop's ranges
+void countNestedVisits(void *context, u32 start, u32 end) {
+    _Atomic u32 *visits = context;
+    for (u32 i = start; i < end; i++) {
+        htw_parallelFor(10, 3, countVisits, (void*)&visits[i * 10]);
+    }
+}
+
+int test_parallelFor() {
+    int failures = 0;
+    const u32 counts[] = {0, 1, 7, 1000, 4099};
+    const u32 threadCounts[] = {0, 1, 2, 3, 64};
+    for (int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        for (int t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+            _Atomic u32 *visits = calloc(counts[c] + 1, sizeof(_Atomic u32));
+            htw_parallelFor(counts[c], threadCounts[t], countVisits, (void*)visits);
+            for (u32 i = 0; i < counts[c]; i++) {
+                failures += visits[i] != 1;
+            }
+            free((void*)visits);
+        }
+    }
+    // workers are shared, so loops started from inside a range still finish
+    _Atomic u32 *visits = calloc(40 * 10, sizeof(_Atomic u32));
+    htw_parallelFor(40, 4, countNestedVisits, (void*)visits);
+    for (u32 i = 0; i < 40 * 10; i++) {
+        failures += visits[i] != 1;
+    }
+    free((void*)visits);
+    ASSERT_EQUAL(failures, 0);
+    return failures > 0;
+}
+
+int test_nextPow() {
+    int failures = 0;
+    const unsigned int values[] =   {0, 1, 2, 3, 4, 5, 100, 128, 129, 1u << 31, (1u << 31) + 1, UINT_MAX};
+    const unsigned int expected[] = {1, 1, 2, 4, 4, 8, 128, 128, 256, 1u << 31, 1u << 31, 1u << 31};
+    for (int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        failures += htw_nextPow(values[i]) != expected[i];
+    }
+    ASSERT_EQUAL(failures, 0);
+    return failures > 0;
+}
+
 int test_core() {
-    return 0;
+    int failures = 0;
+    failures += test_nextPow();
+    failures += test_parallelFor();
+    return failures;
+}
+
+int test_randState() {
+    int failures = 0;
+    htw_RandState a, b;
+    htw_randSeed_r(&a, 1234);
+    htw_randSeed_r(&b, 1234);
+    // same seed, same sequence, including through every distribution
+    for (int i = 0; i < 1000; i++) {
+        failures += htw_rand64_r(&a) != htw_rand64_r(&b);
+        failures += htw_randPERT_r(&a, -1, 1, 0) != htw_randPERT_r(&b, -1, 1, 0);
+        failures += htw_rtd_r(&a, 3, 6, NULL) != htw_rtd_r(&b, 3, 6, NULL);
+    }
+
+    // a split stream continues from the parent's old position, while the parent moves on
+    htw_RandState child = htw_randSplit_r(&a);
+    failures += htw_rand64_r(&child) != htw_rand64_r(&b);
+    failures += htw_rand64_r(&a) == htw_rand64_r(&b);
+
+    // reseeding the default state repeats its sequence
+    htw_randSeed(42);
+    float first = htw_randNormal(0, 1);
+    htw_randSeed(42);
+    failures += htw_randNormal(0, 1) != first;
+
+    ASSERT_EQUAL(failures, 0);
+    return failures > 0;
+}
+
+// Pearson's chi-square test of [observed] counts against [expected] counts. Returns 1 if the statistic is above the
+// 99.9th percentile for bins - 1 degrees of freedom (Wilson-Hilferty approximation)
+int checkChiSquare(const char *name, int bins, const int *observed, const double *expected) {
+    double chiSquare = 0.0;
+    for (int i = 0; i < bins; i++) {
+        double diff = observed[i] - expected[i];
+        chiSquare += (diff * diff) / expected[i];
+    }
+    double df = bins - 1;
+    double h = 2.0 / (9.0 * df);
+    double critical = df * pow(1.0 - h + 3.09 * sqrt(h), 3.0);
+
+    int failed = chiSquare > critical;
+    if (failed) fprintf(stderr, "Chi-square check failed: %s: %.2f > %.2f\n", name, chiSquare, critical);
+    return failed;
+}
+
+int checkUniformInts(const char *name, int bins, const int *observed, int num_trials) {
+    double expected[bins];
+    for (int i = 0; i < bins; i++) {
+        expected[i] = (double)num_trials / bins;
+    }
+    return checkChiSquare(name, bins, observed, expected);
 }
 
 int test_randInt() {
-    for (int i = 1; i < 20; i++) {
-        int r = htw_randInt(i);
-        sprintf(testConditions, "range = %i", i);
-        ASSERT_GT(r, -1);
-        ASSERT_LT(r, i + 1);
+    const int num_trials = 1000000;
+    htw_RandState state;
+    htw_randSeed_r(&state, 11);
+    int failures = 0;
+
+    for (int size = 1; size < 40; size++) {
+        int counts[size];
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < num_trials; i++) {
+            int r = htw_randIndex_r(&state, size);
+            sprintf(testConditions, "size = %i", size);
+            ASSERT_GT(r, -1);
+            ASSERT_LT(r, size);
+            counts[r]++;
+        }
+        if (size > 1) {
+            sprintf(testConditions, "htw_randIndex(%i)", size);
+            failures += checkUniformInts(testConditions, size, counts, num_trials);
+        }
+    }
+
+    // a range that doesn't divide the generator's range evenly; with modulo reduction of a 31 bit draw, the first
+    // third is twice as likely as the last
+    int thirds[3] = {0};
+    const int bigSize = 1500000000;
+    for (int i = 0; i < num_trials; i++) {
+        thirds[htw_randIndex_r(&state, bigSize) / (bigSize / 3)]++;
     }
-    return 0;
+    failures += checkUniformInts("htw_randIndex(1500000000)", 3, thirds, num_trials);
+
+    int ends[7] = {0};
+    for (int i = 0; i < num_trials; i++) {
+        int r = htw_randIntRange_r(&state, -3, 3);
+        ASSERT_GT(r, -4);
+        ASSERT_LT(r, 4);
+        ends[r + 3]++;
+    }
+    failures += checkUniformInts("htw_randIntRange(-3, 3)", 7, ends, num_trials);
+
+    // the full int range still works, with no overflow in the range size
+    int halves[2] = {0};
+    for (int i = 0; i < num_trials; i++) {
+        halves[htw_randIntRange_r(&state, INT_MIN, INT_MAX) >= 0]++;
+    }
+    failures += checkUniformInts("htw_randIntRange(INT_MIN, INT_MAX)", 2, halves, num_trials);
+
+    return failures;
 }
 
 int test_rtd() {
-    for (int d = 0; d < 20; d++) {
+    htw_RandState state;
+    htw_randSeed_r(&state, 12);
+    int failures = 0;
+
+    // totals stay in range, and match the individual results
+    for (int d = 0; d < 100; d++) {
         for (int s = 1; s < 20; s++) {
-            int t = htw_rtd(d, s, NULL);
-            //ASSERT(d <= t <= (d * s));
+            int rolls[100];
+            int t = htw_rtd_r(&state, d, s, rolls);
+            int sum = 0;
+            for (int i = 0; i < d; i++) {
+                sum += rolls[i];
+            }
+            sprintf(testConditions, "%id%i", d, s);
             ASSERT_GT(t, d - 1);
             ASSERT_LT(t, (d * s) + 1);
+            ASSERT_EQUAL(t, sum);
+            failures += t != sum;
+        }
+    }
+
+    // each face is equally likely, and neighboring dice (which usually share one draw) are independent
+    const int sides[] = {2, 6, 20, 100, 1000};
+    const int num_rolls = 50000;
+    const int dice = 40;
+    for (int k = 0; k < sizeof(sides) / sizeof(sides[0]); k++) {
+        int s = sides[k];
+        int *faces = calloc(s, sizeof(int));
+        int pairBins = MIN(s, 20);
+        int pairs[pairBins * pairBins];
+        memset(pairs, 0, sizeof(pairs));
+        int rolls[dice];
+        for (int i = 0; i < num_rolls; i++) {
+            htw_rtd_r(&state, dice, s, rolls);
+            for (int r = 0; r < dice; r++) {
+                faces[rolls[r] - 1]++;
+                if (r > 0) {
+                    int a = (rolls[r - 1] - 1) * pairBins / s;
+                    int b = (rolls[r] - 1) * pairBins / s;
+                    pairs[a * pairBins + b]++;
+                }
+            }
         }
+        sprintf(testConditions, "htw_rtd faces, d%i", s);
+        failures += checkUniformInts(testConditions, s, faces, num_rolls * dice);
+        sprintf(testConditions, "htw_rtd neighboring pairs, d%i", s);
+        failures += checkUniformInts(testConditions, pairBins * pairBins, pairs, num_rolls * (dice - 1));
+        free(faces);
+    }
+
+    // totals of 3d6 against the exact distribution: ways to roll each total, out of 6^3
+    const int ways3d6[16] = {1, 3, 6, 10, 15, 21, 25, 27, 27, 25, 21, 15, 10, 6, 3, 1};
+    const int num_trials = 1000000;
+    int totals[16] = {0};
+    double expected[16];
+    for (int i = 0; i < num_trials; i++) {
+        totals[htw_rtd_r(&state, 3, 6, NULL) - 3]++;
+    }
+    for (int i = 0; i < 16; i++) {
+        expected[i] = (double)num_trials * ways3d6[i] / 216.0;
     }
-    return 0;
+    failures += checkChiSquare("htw_rtd totals, 3d6", 16, totals, expected);
+
+    return failures;
 }
 
 void test_rtd_histogram(int d, int s, int n) {
@@ -113,19 +320,2408 @@ void test_randPERT() {
     printBuckets(num_buckets, num_trials, min, max, buckets);
 }
 
+int test_noiseBatch() {
+    const int count = 4099; // not a multiple of any kernel width, to cover the scalar remainder
+    float *xs = malloc(sizeof(float) * count);
+    float *ys = malloc(sizeof(float) * count);
+    float *batch = malloc(sizeof(float) * count);
+    int mismatches = 0;
+
+    for (u32 octaves = 1; octaves < 8; octaves++) {
+        for (int i = 0; i < count; i++) {
+            // mostly in range of the SIMD kernels, with some negative and huge samples mixed in
+            xs[i] = htw_randRange(-8.0, 1000.0);
+            ys[i] = i % 1000 == 0 ? 3e9 : htw_randRange(0.0, 1000.0);
+        }
+
+        htw_simplex2dLayeredBatch(octaves, xs, ys, batch, count, 16, octaves);
+        for (int i = 0; i < count; i++) {
+            float scalar = htw_simplex2dLayered(octaves, xs[i], ys[i], 16, octaves);
+            if (memcmp(&scalar, &batch[i], sizeof(float)) != 0) mismatches++;
+        }
+
+        htw_perlin2dBatch(octaves, xs, ys, batch, count, octaves);
+        for (int i = 0; i < count; i++) {
+            float scalar = htw_perlin2d(octaves, xs[i], ys[i], octaves);
+            if (memcmp(&scalar, &batch[i], sizeof(float)) != 0) mismatches++;
+        }
+    }
+
+    free(xs);
+    free(ys);
+    free(batch);
+    ASSERT_EQUAL(mismatches, 0);
+    return mismatches > 0;
+}
+
+int test_hash2dLanes() {
+    u32 xs[16], ys[16], hashes[16];
+    int mismatches = 0;
+    for (u32 seed = 0; seed < 64; seed++) {
+        for (int l = 0; l < 16; l++) {
+            xs[l] = xxh_hash2d(seed, l, 0);
+            ys[l] = xxh_hash2d(seed, l, 1);
+        }
+        xxh_hash2d_x8(seed, xs, ys, hashes);
+        for (int l = 0; l < 8; l++) {
+            if (hashes[l] != xxh_hash2d(seed, xs[l], ys[l])) mismatches++;
+        }
+        xxh_hash2d_x16(seed, xs, ys, hashes);
+        for (int l = 0; l < 16; l++) {
+            if (hashes[l] != xxh_hash2d(seed, xs[l], ys[l])) mismatches++;
+        }
+    }
+    ASSERT_EQUAL(mismatches, 0);
+    return mismatches > 0;
+}
+
+int test_xxhash() {
+    int failures = 0;
+    const char *text = "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs.";
+    size_t length = strlen(text);
+
+    // reference XXH32 and XXH64 results
+    failures += xxh_hash(0, 0, (const u8*)"") != 0x02CC5D05;
+    failures += xxh64_hash(0, 0, (const u8*)"") != 0xEF46DB3751D8E999;
+    failures += xxh_hash(0, 3, (const u8*)"abc") != 0x32D153FF;
+    failures += xxh64_hash(0, 3, (const u8*)"abc") != 0x44BC2CF5AD770999;
+    failures += xxh_hash(0, length, (const u8*)text) != 0xE9C84F9A;
+    failures += xxh64_hash(0, length, (const u8*)text) != 0xBA70006822CEB306;
+    failures += xxh_hash(0x12345678, length, (const u8*)text) != 0x3D716CDE;
+    failures += xxh64_hash(0x123456789ABCDEF, length, (const u8*)text) != 0x70B6C77A845706AB;
+
+    // streaming in uneven pieces must match hashing all at once, for every input length
+    for (size_t l = 0; l <= length; l++) {
+        xxh_state state;
+        xxh64_state state64;
+        xxh_init(&state, l);
+        xxh64_init(&state64, l);
+        for (size_t i = 0, piece = 1; i < l; i += piece, piece = (piece * 3) % 7 + 1) {
+            size_t pieceLength = MIN(piece, l - i);
+            xxh_update(&state, pieceLength, (const u8*)&text[i]);
+            xxh64_update(&state64, pieceLength, (const u8*)&text[i]);
+        }
+        failures += xxh_digest(&state) != xxh_hash(l, l, (const u8*)text);
+        failures += xxh64_digest(&state64) != xxh64_hash(l, l, (const u8*)text);
+    }
+
+    ASSERT_EQUAL(failures, 0);
+    return failures > 0;
+}
+
+void bench_fillNoise() {
+    const u32 size = 4096;
+    htw_ValueMap *map = htw_geo_createValueMap(size, size, 256);
+    printf("Hash noise, %ux%u map:\n", size, size);
+    HTW_STOPWATCH(
+        for (u32 y = 0; y < size; y++) {
+            for (u32 x = 0; x < size; x++) {
+                map->values[x + y * size] = xxh_hash2d(0, x, y) % map->maxMagnitude;
+            }
+        }
+    );
+    HTW_STOPWATCH(htw_geo_fillNoise(map, 0));
+    free(map);
+}
+
+void bench_noiseBatch() {
+    const u32 width = 1024, height = 1024, octaves = 6, repeat = 8;
+    const float scale = (float)repeat / width;
+    float *xs = malloc(sizeof(float) * width * height);
+    float *ys = malloc(sizeof(float) * width * height);
+    float *out = malloc(sizeof(float) * width * height);
+    for (u32 y = 0; y < height; y++) {
+        for (u32 x = 0; x < width; x++) {
+            xs[x + y * width] = x * scale;
+            ys[x + y * width] = y * scale;
+        }
+    }
+
+    printf("Simplex noise, %ux%u samples, %u octaves:\n", width, height, octaves);
+    HTW_STOPWATCH(
+        for (u32 i = 0; i < width * height; i++) {
+            out[i] = htw_simplex2dLayered(0, xs[i], ys[i], repeat, octaves);
+        }
+    );
+    HTW_STOPWATCH(htw_simplex2dLayeredBatch(0, xs, ys, out, width * height, repeat, octaves));
+
+    printf("Perlin noise, %ux%u samples, %u octaves:\n", width, height, octaves);
+    HTW_STOPWATCH(
+        for (u32 i = 0; i < width * height; i++) {
+            out[i] = htw_perlin2d(0, xs[i], ys[i], octaves);
+        }
+    );
+    HTW_STOPWATCH(htw_perlin2dBatch(0, xs, ys, out, width * height, octaves));
+
+    free(xs);
+    free(ys);
+    free(out);
+}
+
+// Histogram of [values], printed like test_randPERT. Returns 1 if the sample mean or variance is off by more than 1%
+int checkDistribution(const char *name, const float *values, int num_trials, float min, float max, double expectedMean, double expectedVariance) {
+    const int num_buckets = 12;
+    int buckets[num_buckets];
+    for (int i = 0; i < num_buckets; i++) {
+        buckets[i] = 0;
+    }
+
+    double sum = 0.0, sumSquares = 0.0;
+    for (int i = 0; i < num_trials; i++) {
+        sum += values[i];
+        sumSquares += (double)values[i] * values[i];
+        int bucket_index = floorf(remap(values[i], min, max, 0, num_buckets));
+        ++buckets[CLAMP(bucket_index, 0, num_buckets - 1)];
+    }
+    double mean = sum / num_trials;
+    double variance = (sumSquares / num_trials) - (mean * mean);
+
+    printf("%s: mean %.4f (expected %.4f), variance %.4f (expected %.4f)\n", name, mean, expectedMean, variance, expectedVariance);
+    printBuckets(num_buckets, num_trials, min, max, buckets);
+
+    int failed = fabs(mean - expectedMean) > 0.01 * MAX(fabs(expectedMean), sqrt(expectedVariance))
+              || fabs(variance - expectedVariance) > 0.01 * expectedVariance;
+    if (failed) fprintf(stderr, "Distribution check failed: %s\n", name);
+    return failed;
+}
+
+int test_randBulk() {
+    const int num_trials = 1000000;
+    float *values = malloc(sizeof(float) * num_trials);
+    htw_RandState state;
+    htw_randSeed_r(&state, 5);
+    int failures = 0;
+
+    htw_randNormalN(&state, values, num_trials, 10.0, 2.0);
+    failures += checkDistribution("htw_randNormalN(10, 2)", values, num_trials, 4.0, 16.0, 10.0, 4.0);
+
+    htw_randGammaN(&state, values, num_trials, 2.0, 1.5);
+    failures += checkDistribution("htw_randGammaN(2, 1.5)", values, num_trials, 0.0, 12.0, 3.0, 4.5);
+
+    htw_randGammaN(&state, values, num_trials, 0.5, 1.0);
+    failures += checkDistribution("htw_randGammaN(0.5, 1)", values, num_trials, 0.0, 3.0, 0.5, 0.5);
+
+    htw_randBetaN(&state, values, num_trials, 2.0, 5.0);
+    failures += checkDistribution("htw_randBetaN(2, 5)", values, num_trials, 0.0, 1.0, 2.0 / 7.0, 10.0 / (49.0 * 8.0));
+
+    // same parameters as test_randPERT; mean = (min + 4 * mode + max) / 6, variance = (mean - min) * (max - mean) / 7
+    htw_randPERTN(&state, values, num_trials, -50, 50, -25);
+    double pertMean = (-50.0 + (4.0 * -25.0) + 50.0) / 6.0;
+    failures += checkDistribution("htw_randPERTN(-50, 50, -25)", values, num_trials, -50, 50, pertMean, (pertMean + 50.0) * (50.0 - pertMean) / 7.0);
+
+    free(values);
+    return failures;
+}
+
+void bench_randBulk() {
+    const int count = 1000000;
+    float *values = malloc(sizeof(float) * count);
+    htw_RandState state;
+    htw_randSeed_r(&state, 0);
+
+    printf("%i normal values:\n", count);
+    HTW_STOPWATCH(for (int i = 0; i < count; i++) values[i] = htw_randNormal_r(&state, 0, 1));
+    HTW_STOPWATCH(htw_randNormalN(&state, values, count, 0, 1));
+    printf("%i gamma values:\n", count);
+    HTW_STOPWATCH(for (int i = 0; i < count; i++) values[i] = htw_randGamma_r(&state, 2, 1));
+    HTW_STOPWATCH(htw_randGammaN(&state, values, count, 2, 1));
+    printf("%i PERT values:\n", count);
+    HTW_STOPWATCH(for (int i = 0; i < count; i++) values[i] = htw_randPERT_r(&state, -50, 50, -25));
+    HTW_STOPWATCH(htw_randPERTN(&state, values, count, -50, 50, -25));
+
+    free(values);
+}
+
 int test_random() {
     int failures = 0;
+    failures += test_randState();
     failures += test_randInt();
     failures += test_rtd();
     //test_rtd_histogram(3, 6, 10000000);
     //test_rtd_histogram(1, 20, 10000000);
     test_randPERT();
+    failures += test_randBulk();
+    failures += test_xxhash();
+    failures += test_hash2dLanes();
+    failures += test_noiseBatch();
     return failures;
 }
 
-int main(int argc, char* argv[]) {
+int test_parallelGenerators() {
+    // odd sizes, so bands and lanes don't divide evenly
+    const u32 width = 301, height = 203;
+    htw_ValueMap *single = htw_geo_createValueMap(width, height, 1000);
+    htw_ValueMap *parallel = htw_geo_createValueMap(width, height, 1000);
     int failures = 0;
-    failures += test_core();
-    failures += test_random();
-    printf("All tests completed. Failures: %i\n", failures);
+
+    for (int g = 0; g < 5; g++) {
+        for (u32 threads = 0; threads < 5; threads += 2) {
+            switch (g) {
+                case 0:
+                    htw_geo_fillCircularGradient(single, (htw_geo_GridCoord){150, 100}, 1000, 0, 120);
+                    htw_geo_fillCircularGradientParallel(parallel, threads, (htw_geo_GridCoord){150, 100}, 1000, 0, 120);
+                    break;
+                case 1:
+                    htw_geo_fillNoise(single, 3);
+                    htw_geo_fillNoiseParallel(parallel, threads, 3);
+                    break;
+                case 2:
+                    htw_geo_fillSmoothNoise(single, 3, 0.1);
+                    htw_geo_fillSmoothNoiseParallel(parallel, threads, 3, 0.1);
+                    break;
+                case 3:
+                    htw_geo_fillPerlin(single, 3, 4, 10, -20, 0.05, 64, 64);
+                    htw_geo_fillPerlinParallel(parallel, threads, 3, 4, 10, -20, 0.05, 64, 64);
+                    break;
+                case 4:
+                    htw_geo_fillSimplex(single, 3, 4, 10, 20, 256, 8);
+                    htw_geo_fillSimplexParallel(parallel, threads, 3, 4, 10, 20, 256, 8);
+                    break;
+            }
+            int different = memcmp(single->values, parallel->values, sizeof(s32) * width * height) != 0;
+            if (different) fprintf(stderr, "Generator %i with %u threads differs from single threaded result\n", g, threads);
+            failures += different;
+        }
+    }
+
+    free(single);
+    free(parallel);
+    return failures;
+}
+
+typedef struct {
+    u8 tag;
+    s32 gradient;
+    float simplex;
+} TestCell;
+
+int test_chunkMapFills() {
+    const u32 chunkSize = 24, chunksX = 5, chunksY = 3;
+    const htw_geo_GridCoord center = {40, 30};
+    int failures = 0;
+
+    for (u32 threads = 1; threads < 4; threads += 2) {
+        htw_ChunkMap *chunkMap = htw_geo_createChunkMap(chunkSize, chunksX, chunksY, sizeof(TestCell));
+        htw_geo_fillChunkMapCircularGradientParallel(chunkMap, threads, HTW_GEO_CELL_FIELD(TestCell, gradient), NULL, 0, center, 100, 0, 50);
+        htw_geo_fillChunkMapSimplexParallel(chunkMap, threads, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 7, 4, 4);
+
+        // matches the single cell functions everywhere, and leaves other fields alone
+        for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+            for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                htw_geo_GridCoord coord = {x, y};
+                TestCell *cell = htw_geo_getCell(chunkMap, coord);
+                failures += cell->gradient != htw_geo_circularGradientByGridCoord(chunkMap, coord, center, 100, 0, 50);
+                failures += cell->simplex != htw_geo_simplex(chunkMap, coord, 7, 4, 4);
+                failures += cell->tag != 0;
+            }
+        }
+
+        // only the listed chunks are filled
+        const u32 newChunks[] = {1, 12, 6};
+        htw_geo_fillChunkMapCircularGradientParallel(chunkMap, threads, HTW_GEO_CELL_FIELD(TestCell, gradient), newChunks, 3, center, -100, 0, 50);
+        for (u32 c = 0; c < chunksX * chunksY; c++) {
+            int listed = c == 1 || c == 12 || c == 6;
+            for (u32 i = 0; i < chunkMap->cellsPerChunk; i++) {
+                htw_geo_GridCoord coord = htw_geo_chunkAndCellToGridCoordinates(chunkMap, c, i);
+                TestCell *cell = htw_geo_getCell(chunkMap, coord);
+                s32 expected = htw_geo_circularGradientByGridCoord(chunkMap, coord, center, listed ? -100 : 100, 0, 50);
+                failures += cell->gradient != expected;
+            }
+        }
+        htw_geo_destroyChunkMap(chunkMap);
+    }
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Backing store for test_lazyChunkMap: keeps a copy of every stored chunk, and counts callback use
+typedef struct {
+    size_t chunkBytes;
+    void **copies;
+    u32 generated, loaded, stored;
+} TestChunkStore;
+
+void testGenerateChunk(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData) {
+    TestChunkStore *store = context;
+    s32 *cells = cellData;
+    for (u32 i = 0; i < chunkMap->cellsPerChunk; i++) {
+        cells[i] = chunkIndex;
+    }
+    store->generated++;
+}
+
+int testLoadChunk(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData) {
+    TestChunkStore *store = context;
+    if (store->copies[chunkIndex] == NULL) return 0;
+    memcpy(cellData, store->copies[chunkIndex], store->chunkBytes);
+    store->loaded++;
+    return 1;
+}
+
+void testStoreChunk(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, const void *cellData) {
+    TestChunkStore *store = context;
+    if (store->copies[chunkIndex] == NULL) store->copies[chunkIndex] = malloc(store->chunkBytes);
+    memcpy(store->copies[chunkIndex], cellData, store->chunkBytes);
+    store->stored++;
+}
+
+typedef struct {
+    const htw_ChunkMap *chunkMap;
+    _Atomic u32 wrong;
+} LazyReadPass;
+
+// Reads rows of a lazy map from testGenerateChunk, counting cells that don't hold their chunk index
+void readLazyRows(void *context, u32 startRow, u32 endRow) {
+    LazyReadPass *pass = context;
+    for (s32 y = startRow; y < endRow; y++) {
+        for (s32 x = 0; x < pass->chunkMap->mapWidth; x++) {
+            htw_geo_GridCoord coord = {x, y};
+            s32 expected = htw_geo_getChunkIndexByGridCoordinates(pass->chunkMap, coord);
+            if (*(s32*)htw_geo_getCell(pass->chunkMap, coord) != expected) {
+                pass->wrong++;
+            }
+        }
+    }
+}
+
+int test_lazyChunkMap() {
+    const u32 chunkSize = 16, chunks = 8;
+    int failures = 0;
+    TestChunkStore store = {
+        .chunkBytes = chunkSize * chunkSize * sizeof(s32),
+        .copies = calloc(chunks * chunks, sizeof(void*)),
+    };
+    htw_geo_ChunkSource source = {testGenerateChunk, testLoadChunk, testStoreChunk, &store};
+    htw_ChunkMap *chunkMap = htw_geo_createLazyChunkMap(chunkSize, chunks, chunks, sizeof(s32), source);
+
+    // nothing exists until it is used
+    for (u32 c = 0; c < chunks * chunks; c++) {
+        failures += htw_geo_isChunkResident(chunkMap, c);
+    }
+
+    // reading generates; each chunk once
+    for (u32 c = 0; c < 10; c++) {
+        htw_geo_GridCoord coord = htw_geo_chunkAndCellToGridCoordinates(chunkMap, c, 5);
+        failures += *(s32*)htw_geo_getCell(chunkMap, coord) != c;
+        failures += *(s32*)htw_geo_getCell(chunkMap, coord) != c;
+    }
+    failures += store.generated != 10;
+
+    // least recently used chunks go first: chunk 3 was just written, and chunk 0 read after it
+    htw_geo_GridCoord written = htw_geo_chunkAndCellToGridCoordinates(chunkMap, 3, 7);
+    *(s32*)htw_geo_getCellForWrite(chunkMap, written) = -1;
+    htw_geo_getChunk(chunkMap, 0);
+    failures += htw_geo_evictChunks(chunkMap, 4) != 6;
+    for (u32 c = 0; c < 10; c++) {
+        int kept = c == 0 || c == 3 || c == 8 || c == 9;
+        failures += htw_geo_isChunkResident(chunkMap, c) != kept;
+    }
+    // unmodified chunks aren't stored
+    failures += store.stored != 0;
+
+    // writes survive eviction
+    htw_geo_evictChunks(chunkMap, 0);
+    for (u32 c = 0; c < chunks * chunks; c++) {
+        failures += htw_geo_isChunkResident(chunkMap, c);
+    }
+    failures += store.stored != 1;
+    failures += *(s32*)htw_geo_getCell(chunkMap, written) != -1;
+    failures += store.loaded != 1;
+    failures += store.generated != 10;
+    htw_geo_evictChunks(chunkMap, 0);
+
+    // bulk fills create and keep the chunks they write
+    const u32 visible[] = {20, 21, 28};
+    htw_geo_fillChunkMapCircularGradient(chunkMap, (htw_geo_CellField){0, sizeof(s32)}, visible, 3, (htw_geo_GridCoord){0, 0}, 100, 0, 50);
+    failures += !htw_geo_isChunkResident(chunkMap, 21);
+    htw_geo_evictChunks(chunkMap, 0);
+    failures += store.copies[21] == NULL;
+
+    htw_geo_destroyChunkMap(chunkMap);
+    for (u32 c = 0; c < chunks * chunks; c++) {
+        free(store.copies[c]);
+    }
+    free(store.copies);
+
+    // concurrent reads create each chunk exactly once, and see it fully generated
+    memset(&store, 0, sizeof(store));
+    store.chunkBytes = chunkSize * chunkSize * sizeof(s32);
+    store.copies = calloc(chunks * chunks, sizeof(void*));
+    chunkMap = htw_geo_createLazyChunkMap(chunkSize, chunks, chunks, sizeof(s32), source);
+    LazyReadPass pass = {chunkMap};
+    htw_parallelFor(chunkMap->mapHeight, 4, readLazyRows, &pass);
+    failures += pass.wrong;
+    failures += store.generated != chunks * chunks;
+    htw_geo_destroyChunkMap(chunkMap);
+    free(store.copies);
+
+    // without a source, reads see zeroes and create nothing, and writes create chunks
+    chunkMap = htw_geo_createLazyChunkMap(chunkSize, chunks, chunks, sizeof(s32), (htw_geo_ChunkSource){0});
+    failures += *(s32*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){40, 40}) != 0;
+    failures += htw_geo_isChunkResident(chunkMap, htw_geo_getChunkIndexByGridCoordinates(chunkMap, (htw_geo_GridCoord){40, 40}));
+    *(s32*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){40, 40}) = 9;
+    failures += *(s32*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){40, 40}) != 9;
+    failures += *(s32*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){41, 40}) != 0;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+int test_chunkMapSlab() {
+    const u32 chunkSize = 10, chunksX = 4, chunksY = 3;
+    const u32 flagSets[] = {HTW_GEO_CHUNKMAP_SLAB, HTW_GEO_CHUNKMAP_CACHE_ALIGNED, HTW_GEO_CHUNKMAP_SLAB | HTW_GEO_CHUNKMAP_HUGE_PAGES};
+    int failures = 0;
+
+    for (int f = 0; f < sizeof(flagSets) / sizeof(flagSets[0]); f++) {
+        u32 flags = flagSets[f];
+        htw_ChunkMap *chunkMap = htw_geo_createChunkMapWithFlags(chunkSize, chunksX, chunksY, sizeof(TestCell), flags);
+        failures += chunkMap->slab == NULL;
+        if (chunkMap->slab == NULL) continue;
+
+        // chunks are laid out back to back in the slab, and start zeroed
+        size_t chunkBytes = chunkSize * chunkSize * sizeof(TestCell);
+        failures += chunkMap->chunkStride < chunkBytes;
+        failures += chunkMap->slabSize != chunkMap->chunkStride * chunksX * chunksY;
+        for (u32 c = 0; c < chunksX * chunksY; c++) {
+            u8 *cellData = chunkMap->chunks[c].cellData;
+            failures += cellData != (u8*)chunkMap->slab + (c * chunkMap->chunkStride);
+            if (flags & HTW_GEO_CHUNKMAP_CACHE_ALIGNED) failures += ((uintptr_t)cellData % HTW_GEO_CACHE_LINE_SIZE) != 0;
+            for (size_t b = 0; b < chunkBytes; b++) failures += cellData[b] != 0;
+        }
+        if (flags & HTW_GEO_CHUNKMAP_HUGE_PAGES) failures += ((uintptr_t)chunkMap->slab % (2 * 1024 * 1024)) != 0;
+
+        // cell access and fills work the same, and one copy of the slab has every chunk
+        htw_geo_fillChunkMapSimplex(chunkMap, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 1, 2, 4);
+        u8 *copy = malloc(chunkMap->slabSize);
+        memcpy(copy, chunkMap->slab, chunkMap->slabSize);
+        for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+            for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                htw_geo_GridCoord coord = {x, y};
+                u32 chunkIndex, cellIndex;
+                htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, coord, &chunkIndex, &cellIndex);
+                TestCell *copied = (TestCell*)(copy + (chunkIndex * chunkMap->chunkStride)) + cellIndex;
+                TestCell *cell = htw_geo_getCell(chunkMap, coord);
+                failures += cell->simplex != htw_geo_simplex(chunkMap, coord, 1, 2, 4);
+                failures += copied->simplex != cell->simplex;
+            }
+        }
+        free(copy);
+        htw_geo_destroyChunkMap(chunkMap);
+    }
+
+    // without slab flags, there is no slab
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMapWithFlags(chunkSize, chunksX, chunksY, sizeof(TestCell), 0);
+    failures += chunkMap->slab != NULL;
+    failures += chunkMap->chunkStride != chunkSize * chunkSize * sizeof(TestCell);
+    htw_geo_destroyChunkMap(chunkMap);
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+int test_chunkMapFile() {
+    const char *path = "htw_test_chunkmap.bin";
+    const u32 chunkSize = 12, chunksX = 3, chunksY = 4;
+    int failures = 0;
+
+    htw_ChunkMap *original = htw_geo_createChunkMap(chunkSize, chunksX, chunksY, sizeof(TestCell));
+    htw_geo_fillChunkMapSimplex(original, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 2, 3, 4);
+    htw_geo_fillChunkMapCircularGradient(original, HTW_GEO_CELL_FIELD(TestCell, gradient), NULL, 0, (htw_geo_GridCoord){5, 5}, 100, 0, 20);
+    failures += htw_geo_saveChunkMap(original, path) != 0;
+
+    // same dimensions and cells, with page aligned chunks inside the file mapping
+    htw_ChunkMap *opened = htw_geo_openChunkMap(path, 0);
+    failures += opened == NULL;
+    if (opened == NULL) return failures;
+    failures += opened->chunkSize != chunkSize || opened->chunkCountX != chunksX || opened->chunkCountY != chunksY;
+    failures += opened->cellDataSize != sizeof(TestCell) || opened->mapWidth != original->mapWidth;
+    for (u32 c = 0; c < chunksX * chunksY; c++) {
+        failures += ((uintptr_t)opened->chunks[c].cellData % HTW_GEO_CHUNKMAP_FILE_ALIGNMENT) != 0;
+        failures += memcmp(opened->chunks[c].cellData, original->chunks[c].cellData, original->cellsPerChunk * sizeof(TestCell)) != 0;
+    }
+
+    // changes to a private mapping don't reach the file
+    htw_geo_GridCoord changed = {20, 30};
+    ((TestCell*)htw_geo_getCellForWrite(opened, changed))->gradient = -5;
+    htw_geo_destroyChunkMap(opened);
+    opened = htw_geo_openChunkMap(path, 1);
+    failures += ((TestCell*)htw_geo_getCell(opened, changed))->gradient == -5;
+
+    // but do with write back
+    ((TestCell*)htw_geo_getCellForWrite(opened, changed))->gradient = -5;
+    htw_geo_destroyChunkMap(opened);
+    opened = htw_geo_openChunkMap(path, 0);
+    failures += ((TestCell*)htw_geo_getCell(opened, changed))->gradient != -5;
+    htw_geo_destroyChunkMap(opened);
+
+    // a truncated file is rejected
+    FILE *fp = fopen(path, "r+b");
+    ftruncate(fileno(fp), HTW_GEO_CHUNKMAP_FILE_ALIGNMENT * 2);
+    fclose(fp);
+    printf("Expecting an error about a truncated file:\n");
+    failures += htw_geo_openChunkMap(path, 0) != NULL;
+
+    // and headers with sizes that overflow, or chunks that aren't aligned. Offsets are those of the file header's fields
+    const struct {
+        long offset;
+        u64 value;
+        int size;
+        const char *error;
+    } corruptions[] = {
+        {24, 0x10000, 4, "dimensions out of range (chunk count past u32)"},
+        {20, 0x10000, 4, "dimensions out of range (cells per chunk past u32)"},
+        {32, 1ull << 62, 8, "sizes out of range (chunk bytes overflow)"},
+        {40, 1ull << 62, 8, "sizes out of range (payload size overflow)"},
+        {40, HTW_GEO_CHUNKMAP_FILE_ALIGNMENT + 8, 8, "misaligned chunks"},
+        {48, 100, 8, "misaligned chunks"},
+        {56, 7, 4, "an unknown cell schema"},
+        {60, 1, 4, "cell schema field 0 out of range"},
+        {576, 3, 4, "an unknown cell order"},
+        {576, HTW_GEO_CELL_ORDER_MORTON, 4, "a cell order that needs a chunk size that is a power of 2"},
+    };
+    for (int i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); i++) {
+        failures += htw_geo_saveChunkMap(original, path) != 0;
+        fp = fopen(path, "r+b");
+        fseek(fp, corruptions[i].offset, SEEK_SET);
+        fwrite(&corruptions[i].value, corruptions[i].size, 1, fp);
+        fclose(fp);
+        printf("Expecting an error about %s:\n", corruptions[i].error);
+        failures += htw_geo_openChunkMap(path, 0) != NULL;
+    }
+
+    // so is anything else
+    fp = fopen(path, "wb");
+    fprintf(fp, "definitely not a chunkmap, but long enough to have a header");
+    fclose(fp);
+    printf("Expecting an error about a file that isn't a chunkmap:\n");
+    failures += htw_geo_openChunkMap(path, 0) != NULL;
+
+    remove(path);
+    htw_geo_destroyChunkMap(original);
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Layers of a typical game map, for test_compressedChunkStore
+typedef struct {
+    u32 biome; // repeats, like RLE
+    u32 band; // few distinct values, like bitpacking
+    s32 elevation; // smooth, like delta encoding
+    float detail; // random, has to stay raw
+} LayeredCell;
+
+void generateLayeredChunk(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData) {
+    u32 *generated = context;
+    LayeredCell *cells = cellData;
+    for (u32 i = 0; i < chunkMap->cellsPerChunk; i++) {
+        htw_geo_GridCoord coord = htw_geo_chunkAndCellToGridCoordinates(chunkMap, chunkIndex, i);
+        cells[i] = (LayeredCell){
+            .biome = ((coord.y / 8) * 37) % 200,
+            .band = xxh_hash2d(1, coord.x, coord.y) % 5,
+            .elevation = (coord.x * 7) - (coord.y * 3) - 50,
+            .detail = (float)xxh_hash2d(2, coord.x, coord.y),
+        };
+    }
+    (*generated)++;
+}
+
+// round trip of arbitrary bytes, for cell sizes that aren't a multiple of 4
+void generateBytes(void *context, const htw_ChunkMap *chunkMap, u32 chunkIndex, void *cellData) {
+    u8 *bytes = cellData;
+    for (u32 i = 0; i < chunkMap->cellsPerChunk * chunkMap->cellDataSize; i++) {
+        bytes[i] = i % 7 == 0 ? xxh_hash2d(chunkIndex, i, 0) : i / 20;
+    }
+}
+
+int test_compressedChunkStore() {
+    const u32 chunkSize = 32, chunks = 4;
+    int failures = 0;
+    u32 generated = 0;
+
+    htw_geo_CompressedChunkStore *store = htw_geo_createCompressedChunkStore(chunks * chunks, chunkSize * chunkSize, sizeof(LayeredCell));
+    htw_geo_ChunkSource source = htw_geo_getCompressedChunkSource(store, generateLayeredChunk, &generated);
+    htw_ChunkMap *chunkMap = htw_geo_createLazyChunkMap(chunkSize, chunks, chunks, sizeof(LayeredCell), source);
+    htw_ChunkMap *expected = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(LayeredCell));
+    u32 expectedGenerated = 0;
+    for (u32 c = 0; c < chunks * chunks; c++) {
+        generateLayeredChunk(&expectedGenerated, expected, c, expected->chunks[c].cellData);
+    }
+
+    // generated once, compressed on eviction, then decompressed on access with the same contents
+    for (int pass = 0; pass < 3; pass++) {
+        for (u32 c = 0; c < chunks * chunks; c++) {
+            failures += memcmp(htw_geo_getChunk(chunkMap, c), expected->chunks[c].cellData, chunkSize * chunkSize * sizeof(LayeredCell)) != 0;
+        }
+        htw_geo_evictChunks(chunkMap, 0);
+    }
+    failures += generated != chunks * chunks;
+
+    htw_geo_CompressedChunkStats stats;
+    htw_geo_getCompressedStoreStats(store, &stats);
+    printf("Compressed chunk store: %zu bytes to %zu (ratio %.2f), mean decode %.1f us, codecs used raw %u, rle %u, bitpack %u, delta %u\n",
+           stats.rawBytes, stats.compressedBytes, stats.compressionRatio, stats.lastDecodeSeconds * 1e6,
+           stats.columnsByCodec[HTW_GEO_CODEC_RAW], stats.columnsByCodec[HTW_GEO_CODEC_RLE],
+           stats.columnsByCodec[HTW_GEO_CODEC_BITPACK], stats.columnsByCodec[HTW_GEO_CODEC_DELTA]);
+    failures += stats.compressionRatio < 1.2;
+    failures += stats.decodeCount != chunks * chunks * 2;
+    // each layer picks its own codec; detail is noise, but floats of similar magnitude still share their top bits
+    failures += stats.columnsByCodec[HTW_GEO_CODEC_RLE] != chunks * chunks;
+    failures += stats.columnsByCodec[HTW_GEO_CODEC_BITPACK] < chunks * chunks;
+    failures += stats.columnsByCodec[HTW_GEO_CODEC_DELTA] != chunks * chunks;
+    failures += !htw_geo_getCompressedChunkStats(store, 5, &stats);
+    failures += stats.rawBytes != chunkSize * chunkSize * sizeof(LayeredCell) || stats.lastDecodeSeconds <= 0;
+
+    // writes are compressed on the next eviction
+    htw_geo_GridCoord changed = {40, 70};
+    ((LayeredCell*)htw_geo_getCellForWrite(chunkMap, changed))->elevation = 12345;
+    htw_geo_evictChunks(chunkMap, 0);
+    failures += ((LayeredCell*)htw_geo_getCell(chunkMap, changed))->elevation != 12345;
+
+    htw_geo_destroyChunkMap(chunkMap);
+    htw_geo_destroyChunkMap(expected);
+    htw_geo_destroyCompressedChunkStore(store);
+
+    // 2 and 1 byte columns
+    for (size_t cellSize = 3; cellSize < 7; cellSize += 3) {
+        store = htw_geo_createCompressedChunkStore(4, 16 * 16, cellSize);
+        chunkMap = htw_geo_createLazyChunkMap(16, 2, 2, cellSize, htw_geo_getCompressedChunkSource(store, generateBytes, NULL));
+        u8 *original = malloc(16 * 16 * cellSize);
+        generateBytes(NULL, chunkMap, 3, original);
+        htw_geo_getChunk(chunkMap, 3);
+        htw_geo_evictChunks(chunkMap, 0);
+        failures += memcmp(htw_geo_getChunk(chunkMap, 3), original, 16 * 16 * cellSize) != 0;
+        free(original);
+        htw_geo_destroyChunkMap(chunkMap);
+        htw_geo_destroyCompressedChunkStore(store);
+    }
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+int test_pow2CellAccess() {
+    int failures = 0;
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(16, 8, 4, sizeof(s32));
+    failures += !chunkMap->isPow2;
+    // same cell as the general path, for coordinates inside, outside, and far outside the map
+    for (s32 y = -300; y < 300; y += 7) {
+        for (s32 x = -300; x < 300; x += 3) {
+            u32 chunkIndex, cellIndex;
+            htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, (htw_geo_GridCoord){x, y}, &chunkIndex, &cellIndex);
+            s32 *expected = (s32*)chunkMap->chunks[chunkIndex].cellData + cellIndex;
+            failures += htw_geo_getCellPow2(chunkMap, (htw_geo_GridCoord){x, y}) != expected;
+            failures += htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y}) != expected;
+            failures += htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){x, y}) != expected;
+        }
+    }
+    htw_geo_destroyChunkMap(chunkMap);
+
+    // writes to a double buffered map, with halos, land in the same back buffer cell as the general path
+    chunkMap = htw_geo_createChunkMapWithHalo(16, 4, 2, sizeof(s32), HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED, 1);
+    failures += !chunkMap->isPow2;
+    for (s32 y = -40; y < 40; y += 3) {
+        for (s32 x = -70; x < 70; x += 5) {
+            u32 chunkIndex, cellIndex;
+            htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, (htw_geo_GridCoord){x, y}, &chunkIndex, &cellIndex);
+            u8 *expected = (u8*)htw_geo_getChunkForWrite(chunkMap, chunkIndex) + htw_geo_getCellOffset(chunkMap, cellIndex);
+            failures += htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){x, y}) != expected;
+        }
+    }
+    htw_geo_destroyChunkMap(chunkMap);
+
+    chunkMap = htw_geo_createChunkMap(16, 6, 4, sizeof(s32));
+    failures += chunkMap->isPow2;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    // lazy maps still create chunks through the fast path
+    chunkMap = htw_geo_createLazyChunkMap(16, 4, 4, sizeof(s32), (htw_geo_ChunkSource){0});
+    *(s32*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){-1, -1}) = 3;
+    failures += *(s32*)htw_geo_getCellPow2(chunkMap, (htw_geo_GridCoord){63, 63}) != 3;
+    failures += *(s32*)htw_geo_getCellPow2(chunkMap, (htw_geo_GridCoord){0, 0}) != 0;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+typedef struct {
+    s32 value;
+    s32 neighborSum;
+} StencilCell;
+
+void sumNeighbors(void *context, const htw_geo_StencilIterator *stencil) {
+    StencilCell *cell = htw_geo_getStencilWriteCell(stencil);
+    s32 sum = 0;
+    for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+        sum += ((StencilCell*)stencil->neighbors[d])->value;
+    }
+    cell->neighborSum = sum;
+}
+
+// Same as sumNeighbors, but only for cells in the chunk at *context
+void sumNeighborsInChunk(void *context, const htw_geo_StencilIterator *stencil) {
+    if (stencil->chunkIndex == *(u32*)context) {
+        sumNeighbors(NULL, stencil);
+    }
+}
+
+// Reference for sumNeighbors, through the general cell lookup
+s32 sumNeighborsByCoord(htw_ChunkMap *chunkMap, htw_geo_GridCoord coord) {
+    s32 sum = 0;
+    for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+        sum += ((StencilCell*)htw_geo_getCell(chunkMap, POSITION_IN_DIRECTION(coord, d)))->value;
+    }
+    return sum;
+}
+
+int test_stencil() {
+    int failures = 0;
+    // non power of 2, single chunk wide (chunk is its own neighbor), 1 cell chunks (no interior), power of 2
+    const u32 shapes[][3] = {{5, 3, 4}, {4, 1, 2}, {1, 3, 3}, {16, 4, 4}};
+    for (int s = 0; s < 4; s++) {
+        htw_ChunkMap *chunkMap = htw_geo_createChunkMap(shapes[s][0], shapes[s][1], shapes[s][2], sizeof(StencilCell));
+        for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+            for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y}))->value = xxh_hash2d(s, x, y) % 1000;
+            }
+        }
+
+        // same cells as POSITION_IN_DIRECTION and htw_geo_getCell
+        for (u32 c = 0; c < chunkMap->chunkCountX * chunkMap->chunkCountY; c++) {
+            htw_geo_StencilIterator iter;
+            htw_geo_beginChunkStencil(&iter, chunkMap, c);
+            u32 visited = 0;
+            while (htw_geo_nextStencilCell(&iter)) {
+                htw_geo_GridCoord expectedCoord = htw_geo_chunkAndCellToGridCoordinates(chunkMap, c, visited);
+                failures += iter.cellIndex != visited || iter.coord.x != expectedCoord.x || iter.coord.y != expectedCoord.y;
+                failures += iter.cell != htw_geo_getCell(chunkMap, iter.coord);
+                for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+                    failures += iter.neighbors[d] != htw_geo_getCell(chunkMap, POSITION_IN_DIRECTION(iter.coord, d));
+                }
+                visited++;
+            }
+            failures += visited != chunkMap->cellsPerChunk;
+        }
+
+        for (u32 threads = 0; threads < 3; threads++) {
+            htw_geo_forEachCellStencil(chunkMap, threads, sumNeighbors, NULL);
+            for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+                for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                    StencilCell *cell = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+                    failures += cell->neighborSum != sumNeighborsByCoord(chunkMap, (htw_geo_GridCoord){x, y});
+                    cell->neighborSum = 0;
+                }
+            }
+        }
+        htw_geo_destroyChunkMap(chunkMap);
+    }
+
+    // lazy map; neighbors in chunks that were never written read as zero
+    htw_ChunkMap *chunkMap = htw_geo_createLazyChunkMap(8, 4, 4, sizeof(StencilCell), (htw_geo_ChunkSource){0});
+    ((StencilCell*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){8, 8}))->value = 5;
+    htw_geo_forEachCellStencil(chunkMap, 0, sumNeighbors, NULL);
+    failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){7, 8}))->neighborSum != 5;
+    failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){8, 7}))->neighborSum != 5;
+    failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){7, 7}))->neighborSum != 0;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Every chunk's cells are the ones htw_geo_getCell returns, and its halo holds copies of the cells htw_geo_getCell
+// returns for the grid coordinates the halo covers
+int checkHalos(htw_ChunkMap *chunkMap) {
+    int failures = 0;
+    s32 halo = chunkMap->haloWidth, chunkSize = chunkMap->chunkSize;
+    for (u32 c = 0; c < chunkMap->chunkCountX * chunkMap->chunkCountY; c++) {
+        htw_geo_GridCoord root = htw_geo_chunkAndCellToGridCoordinates(chunkMap, c, 0);
+        StencilCell *cells = htw_geo_getChunk(chunkMap, c);
+        for (s32 y = -halo; y < chunkSize + halo; y++) {
+            for (s32 x = -halo; x < chunkSize + halo; x++) {
+                StencilCell *expected = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){root.x + x, root.y + y});
+                StencilCell *cell = &cells[(y * (s32)chunkMap->chunkPitch) + x];
+                int inside = x >= 0 && x < chunkSize && y >= 0 && y < chunkSize;
+                failures += inside ? cell != expected : cell->value != expected->value;
+            }
+        }
+    }
+    return failures;
+}
+
+int test_chunkHalos() {
+    int failures = 0;
+    const u32 haloWidths[] = {1, 2, 6};
+    const u32 flagSets[] = {0, HTW_GEO_CHUNKMAP_SLAB, HTW_GEO_CHUNKMAP_CACHE_ALIGNED};
+    for (int h = 0; h < 3; h++) {
+        for (int f = 0; f < 3; f++) {
+            // 2 chunks wide, so a chunk's left and right neighbors are the same chunk
+            htw_ChunkMap *chunkMap = htw_geo_createChunkMapWithHalo(6, 2, 3, sizeof(StencilCell), flagSets[f], haloWidths[h]);
+            for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+                for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                    ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y}))->value = xxh_hash2d(h, x, y) % 1000;
+                }
+            }
+            htw_geo_syncHalos(chunkMap, NULL, 0);
+            failures += checkHalos(chunkMap);
+
+            // only the written chunk needs to be synced
+            ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){11, 0}))->value = -1;
+            u32 dirty = htw_geo_getChunkIndexByGridCoordinates(chunkMap, (htw_geo_GridCoord){11, 0});
+            htw_geo_syncHalos(chunkMap, &dirty, 1);
+            failures += checkHalos(chunkMap);
+
+            // stencils read neighbors from the halo, and get the same sums
+            htw_geo_forEachCellStencil(chunkMap, 0, sumNeighbors, NULL);
+            for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+                for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                    StencilCell *cell = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+                    failures += cell->neighborSum != sumNeighborsByCoord(chunkMap, (htw_geo_GridCoord){x, y});
+                }
+            }
+            htw_geo_destroyChunkMap(chunkMap);
+        }
+    }
+
+    // fills and files skip over the halo
+    htw_ChunkMap *plain = htw_geo_createChunkMap(8, 3, 2, sizeof(TestCell));
+    htw_ChunkMap *haloed = htw_geo_createChunkMapWithHalo(8, 3, 2, sizeof(TestCell), 0, 2);
+    htw_geo_fillChunkMapSimplex(plain, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 1, 3, 4);
+    htw_geo_fillChunkMapSimplex(haloed, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 1, 3, 4);
+    const char *path = "htw_test_halo_chunkmap.bin";
+    htw_geo_saveChunkMap(haloed, path);
+    htw_ChunkMap *opened = htw_geo_openChunkMap(path, 0);
+    failures += opened == NULL || opened->haloWidth != 0;
+    for (s32 y = 0; opened != NULL && y < plain->mapHeight; y++) {
+        for (s32 x = 0; x < plain->mapWidth; x++) {
+            float expected = ((TestCell*)htw_geo_getCell(plain, (htw_geo_GridCoord){x, y}))->simplex;
+            failures += ((TestCell*)htw_geo_getCell(haloed, (htw_geo_GridCoord){x, y}))->simplex != expected;
+            failures += ((TestCell*)htw_geo_getCell(opened, (htw_geo_GridCoord){x, y}))->simplex != expected;
+        }
+    }
+    if (opened != NULL) htw_geo_destroyChunkMap(opened);
+    remove(path);
+    htw_geo_destroyChunkMap(plain);
+    htw_geo_destroyChunkMap(haloed);
+
+    printf("Expecting an error about a halo wider than its chunks:\n");
+    failures += htw_geo_createChunkMapWithHalo(4, 2, 2, sizeof(s32), 0, 5) != NULL;
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+int test_doubleBufferedChunkMap() {
+    int failures = 0;
+    for (u32 halo = 0; halo < 2; halo++) {
+        htw_ChunkMap *chunkMap = htw_geo_createChunkMapWithHalo(8, 3, 2, sizeof(StencilCell), HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED, halo);
+        for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+            for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                ((StencilCell*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){x, y}))->value = x + (y * 100);
+            }
+        }
+        // nothing written is visible until the swap
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){5, 5}))->value != 0;
+        failures += htw_geo_swapChunkMap(chunkMap) != 6;
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){5, 5}))->value != 505;
+        htw_geo_syncHalos(chunkMap, NULL, 0);
+
+        // a partial write keeps the rest of the chunk, and chunks that weren't written keep their buffer
+        void *fronts[6];
+        for (u32 c = 0; c < 6; c++) fronts[c] = chunkMap->chunks[c].cellData;
+        ((StencilCell*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){1, 1}))->value = -1;
+        failures += htw_geo_swapChunkMap(chunkMap) != 1;
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){1, 1}))->value != -1;
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){2, 1}))->value != 102;
+        failures += chunkMap->chunks[0].cellData == fronts[0];
+        for (u32 c = 1; c < 6; c++) failures += chunkMap->chunks[c].cellData != fronts[c];
+
+        // the buffer retired by the last swap is reused, and a tick without writes changes nothing
+        failures += htw_geo_getChunkForWrite(chunkMap, 4) != fronts[0];
+        htw_geo_swapChunkMap(chunkMap);
+        failures += htw_geo_swapChunkMap(chunkMap) != 0;
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){1, 1}))->value != -1;
+        htw_geo_syncHalos(chunkMap, NULL, 0);
+
+        // a stencil pass reads the front and writes the back, so writing neighborSum doesn't disturb other cells
+        htw_geo_forEachCellStencil(chunkMap, 0, sumNeighbors, NULL);
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){3, 3}))->neighborSum != 0;
+        htw_geo_swapChunkMap(chunkMap);
+        for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+            for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                StencilCell *cell = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+                failures += cell->neighborSum != sumNeighborsByCoord(chunkMap, (htw_geo_GridCoord){x, y});
+            }
+        }
+
+        // only chunks a stencil kernel writes get a back buffer
+        htw_geo_forEachCellStencil(chunkMap, 0, sumNeighborsInChunk, &(u32){4});
+        failures += chunkMap->backChunks[4].cellData == NULL;
+        failures += htw_geo_swapChunkMap(chunkMap) != 1;
+
+        // fills write to the back buffer too
+        htw_geo_fillChunkMapCircularGradient(chunkMap, HTW_GEO_CELL_FIELD(StencilCell, value), NULL, 0, (htw_geo_GridCoord){0, 0}, 100, 0, 8);
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){0, 0}))->value != 0;
+        htw_geo_swapChunkMap(chunkMap);
+        failures += ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){0, 0}))->value != 100;
+        htw_geo_destroyChunkMap(chunkMap);
+    }
+
+    printf("Expecting an error about a double buffered slab:\n");
+    failures += htw_geo_createChunkMapWithFlags(8, 3, 2, sizeof(StencilCell), HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED | HTW_GEO_CHUNKMAP_SLAB) != NULL;
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Collects the chunks changed since [sinceGeneration] into a bitmask; enough for maps of up to 32 chunks
+u32 changedChunkMask(htw_ChunkMap *chunkMap, u32 sinceGeneration, int *duplicates) {
+    u32 mask = 0;
+    u32 chunkIndex;
+    htw_geo_ChangedChunkIterator iter;
+    htw_geo_beginChangedChunks(&iter, chunkMap, sinceGeneration);
+    while (htw_geo_nextChangedChunk(&iter, &chunkIndex)) {
+        *duplicates += (mask >> chunkIndex) & 1;
+        mask |= 1U << chunkIndex;
+    }
+    return mask;
+}
+
+void readNeighbors(void *context, const htw_geo_StencilIterator *stencil) {}
+
+// Adds up every cell into the _Atomic s64 at [context]
+void sumCells(void *context, const htw_geo_StencilIterator *stencil) {
+    _Atomic s64 *total = context;
+    *total += *(s32*)stencil->cell;
+}
+
+// Writes to odd chunks only
+void writeChunkIndex(void *context, const htw_geo_StencilIterator *stencil) {
+    if (stencil->chunkIndex % 2 == 1) {
+        *(s32*)htw_geo_getStencilWriteCell(stencil) = stencil->chunkIndex;
+    }
+}
+
+void writeCellsInRange(void *context, u32 start, u32 end) {
+    htw_ChunkMap *chunkMap = context;
+    for (u32 i = start; i < end; i++) {
+        htw_geo_GridCoord coord = {i % chunkMap->mapWidth, i / chunkMap->mapWidth};
+        *(s32*)htw_geo_getCellForWrite(chunkMap, coord) = i;
+    }
+}
+
+int test_changeTracking() {
+    int failures = 0;
+    int duplicates = 0;
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(8, 4, 4, sizeof(s32));
+    failures += changedChunkMask(chunkMap, 0, &duplicates) != 0;
+
+    // chunks are listed once no matter how often they are written; reads don't count
+    *(s32*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){8, 8}) = 1;
+    *(s32*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){9, 8}) = 1;
+    *(s32*)htw_geo_getCellForWrite(chunkMap, (htw_geo_GridCoord){16, 0}) = 1;
+    htw_geo_getCell(chunkMap, (htw_geo_GridCoord){0, 0});
+    failures += changedChunkMask(chunkMap, 0, &duplicates) != ((1 << 5) | (1 << 2));
+    u32 firstGeneration = htw_geo_newChangeGeneration(chunkMap);
+    failures += firstGeneration != 1 || htw_geo_getChunkGeneration(chunkMap, 5) != 1 || htw_geo_getChunkGeneration(chunkMap, 0) != 0;
+
+    // a consumer that is one generation behind reads the list, an older one scans every chunk
+    htw_geo_getChunkForWrite(chunkMap, 7);
+    failures += changedChunkMask(chunkMap, firstGeneration, &duplicates) != (1 << 7);
+    failures += changedChunkMask(chunkMap, 0, &duplicates) != ((1 << 7) | (1 << 5) | (1 << 2));
+    u32 secondGeneration = htw_geo_newChangeGeneration(chunkMap);
+
+    // fills record the chunks they fill, stencil passes only the chunks their kernels write
+    const u32 filled[] = {3, 9};
+    htw_geo_fillChunkMapCircularGradient(chunkMap, (htw_geo_CellField){0, sizeof(s32)}, filled, 2, (htw_geo_GridCoord){0, 0}, 10, 0, 5);
+    failures += changedChunkMask(chunkMap, secondGeneration, &duplicates) != ((1 << 3) | (1 << 9));
+    failures += changedChunkMask(chunkMap, firstGeneration, &duplicates) != ((1 << 3) | (1 << 7) | (1 << 9));
+    u32 thirdGeneration = htw_geo_newChangeGeneration(chunkMap);
+    htw_geo_forEachCellStencil(chunkMap, 1, readNeighbors, NULL);
+    failures += changedChunkMask(chunkMap, thirdGeneration, &duplicates) != 0;
+    _Atomic s64 total = 0;
+    htw_geo_forEachCellStencilRead(chunkMap, 0, sumCells, (void*)&total);
+    failures += changedChunkMask(chunkMap, thirdGeneration, &duplicates) != 0;
+    s64 expectedTotal = 0;
+    for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+        for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+            expectedTotal += *(s32*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+        }
+    }
+    failures += total != expectedTotal;
+    htw_geo_forEachCellStencil(chunkMap, 0, writeChunkIndex, NULL);
+    failures += changedChunkMask(chunkMap, thirdGeneration, &duplicates) != 0xaaaa;
+    u32 fourthGeneration = htw_geo_newChangeGeneration(chunkMap);
+
+    // writes from many threads at once still list each chunk once
+    htw_parallelFor(chunkMap->mapWidth * chunkMap->mapHeight, 0, writeCellsInRange, chunkMap);
+    failures += changedChunkMask(chunkMap, fourthGeneration, &duplicates) != 0xffff;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    // setting dimensions allocates nothing, so it can be called again; maps built by hand track changes once asked to
+    htw_ChunkMap *built = calloc(1, sizeof(htw_ChunkMap));
+    htw_geo_setChunkMapDimensions(built, 8, 2, 2, sizeof(s32));
+    htw_geo_setChunkMapDimensions(built, 8, 4, 4, sizeof(s32));
+    built->chunks = calloc(16, sizeof(htw_Chunk));
+    failures += built->changes != NULL || htw_geo_newChangeGeneration(built) != 0;
+    htw_geo_initChangeTracking(built);
+    failures += htw_geo_newChangeGeneration(built) != 1 || changedChunkMask(built, 0, &duplicates) != 0;
+    htw_geo_destroyChunkMap(built);
+
+    failures += duplicates;
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Fields of different sizes and alignments, for test_cellSchema
+typedef struct {
+    u8 tag;
+    double moisture;
+    u16 owner;
+    float elevation;
+    u8 flags[3];
+} MixedCell;
+
+enum {MIXED_TAG, MIXED_MOISTURE, MIXED_OWNER, MIXED_ELEVATION, MIXED_FLAGS, MIXED_FIELD_COUNT};
+
+static const htw_geo_SchemaField mixedCellSchema[] = {
+    [MIXED_TAG] = HTW_GEO_SCHEMA_FIELD(MixedCell, tag),
+    [MIXED_MOISTURE] = HTW_GEO_SCHEMA_FIELD(MixedCell, moisture),
+    [MIXED_OWNER] = HTW_GEO_SCHEMA_FIELD(MixedCell, owner),
+    [MIXED_ELEVATION] = HTW_GEO_SCHEMA_FIELD(MixedCell, elevation),
+    [MIXED_FLAGS] = HTW_GEO_SCHEMA_FIELD(MixedCell, flags),
+};
+
+MixedCell mixedCellAt(htw_geo_GridCoord coord) {
+    u32 hash = xxh_hash2d(7, coord.x, coord.y);
+    return (MixedCell){
+        .tag = hash,
+        .moisture = hash * 0.25,
+        .owner = hash >> 8,
+        .elevation = coord.x - (coord.y * 0.5f),
+        .flags = {hash >> 16, hash >> 24, 3},
+    };
+}
+
+int test_cellSchema() {
+    int failures = 0;
+    // odd sized chunks, so columns can't rely on the cell count for alignment
+    const u32 chunkSizes[] = {5, 8};
+    for (int s = 0; s < 2; s++) {
+        htw_ChunkMap *cells = htw_geo_createChunkMap(chunkSizes[s], 3, 2, sizeof(MixedCell));
+        htw_ChunkMap *columns = htw_geo_createChunkMap(chunkSizes[s], 3, 2, sizeof(MixedCell));
+        failures += htw_geo_setCellSchema(cells, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_CELLS) != 0;
+        failures += htw_geo_setCellSchema(columns, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_COLUMNS) != 0;
+
+        // columns are aligned, don't overlap, and fit in the chunk
+        size_t chunkBytes = columns->cellsPerChunk * columns->cellDataSize;
+        for (u32 f = 0; f < MIXED_FIELD_COUNT; f++) {
+            htw_geo_CellField column = htw_geo_getSchemaField(columns, f);
+            size_t alignment = mixedCellSchema[f].size == 3 ? 1 : mixedCellSchema[f].size;
+            failures += column.stride != mixedCellSchema[f].size || column.offset % alignment != 0;
+            failures += column.offset + (column.stride * columns->cellsPerChunk) > chunkBytes;
+            for (u32 g = 0; g < f; g++) {
+                htw_geo_CellField other = htw_geo_getSchemaField(columns, g);
+                failures += column.offset < other.offset + (other.stride * columns->cellsPerChunk) && other.offset < column.offset + (column.stride * columns->cellsPerChunk);
+            }
+            failures += htw_geo_getSchemaField(cells, f).offset != mixedCellSchema[f].offset || htw_geo_getSchemaField(cells, f).stride != sizeof(MixedCell);
+        }
+
+        // every field written one at a time reads back the same on either layout
+        for (s32 y = 0; y < cells->mapHeight; y++) {
+            for (s32 x = 0; x < cells->mapWidth; x++) {
+                MixedCell cell = mixedCellAt((htw_geo_GridCoord){x, y});
+                for (u32 f = 0; f < MIXED_FIELD_COUNT; f++) {
+                    memcpy(htw_geo_getCellValueForWrite(cells, (htw_geo_GridCoord){x, y}, f), (u8*)&cell + mixedCellSchema[f].offset, mixedCellSchema[f].size);
+                    memcpy(htw_geo_getCellValueForWrite(columns, (htw_geo_GridCoord){x, y}, f), (u8*)&cell + mixedCellSchema[f].offset, mixedCellSchema[f].size);
+                }
+            }
+        }
+        for (s32 y = -3; y < (s32)cells->mapHeight + 3; y++) {
+            for (s32 x = -3; x < (s32)cells->mapWidth + 3; x++) {
+                MixedCell *expected = htw_geo_getCell(cells, (htw_geo_GridCoord){x, y});
+                failures += *(float*)htw_geo_getCellValue(cells, (htw_geo_GridCoord){x, y}, MIXED_ELEVATION) != expected->elevation;
+                for (u32 f = 0; f < MIXED_FIELD_COUNT; f++) {
+                    failures += memcmp(htw_geo_getCellValue(columns, (htw_geo_GridCoord){x, y}, f), (u8*)expected + mixedCellSchema[f].offset, mixedCellSchema[f].size) != 0;
+                }
+            }
+        }
+
+        // a column is a dense array in cellIndex order
+        for (u32 c = 0; c < 6; c++) {
+            const double *moisture = HTW_GEO_CHUNK_COLUMN(double, columns, c, MIXED_MOISTURE);
+            const MixedCell *expected = htw_geo_getChunk(cells, c);
+            for (u32 i = 0; i < cells->cellsPerChunk; i++) {
+                failures += moisture[i] != expected[i].moisture;
+            }
+        }
+
+        // fills take the column's field descriptor
+        htw_geo_fillChunkMapSimplex(cells, htw_geo_getSchemaField(cells, MIXED_ELEVATION), NULL, 0, 3, 2, 4);
+        htw_geo_fillChunkMapSimplex(columns, htw_geo_getSchemaField(columns, MIXED_ELEVATION), NULL, 0, 3, 2, 4);
+        for (u32 c = 0; c < 6; c++) {
+            const float *elevation = HTW_GEO_CHUNK_COLUMN(float, columns, c, MIXED_ELEVATION);
+            const MixedCell *expected = htw_geo_getChunk(cells, c);
+            for (u32 i = 0; i < cells->cellsPerChunk; i++) {
+                failures += elevation[i] != expected[i].elevation;
+            }
+        }
+
+        // a saved map reads back with the same schema, and only accepts that one again
+        const char *path = "htw_test_schema_chunkmap.bin";
+        htw_geo_saveChunkMap(columns, path);
+        htw_ChunkMap *opened = htw_geo_openChunkMap(path, 0);
+        failures += opened->layout != HTW_GEO_LAYOUT_COLUMNS || opened->fieldCount != MIXED_FIELD_COUNT;
+        failures += memcmp(opened->fields, columns->fields, sizeof(columns->fields)) != 0;
+        failures += *(u16*)htw_geo_getCellValue(opened, (htw_geo_GridCoord){4, 7}, MIXED_OWNER) != mixedCellAt((htw_geo_GridCoord){4, 7}).owner;
+        failures += htw_geo_setCellSchema(opened, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_COLUMNS) != 0;
+        printf("Expecting an error about a schema that doesn't match the file:\n");
+        failures += htw_geo_setCellSchema(opened, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_CELLS) != -1;
+        htw_geo_destroyChunkMap(opened);
+        remove(path);
+
+        htw_geo_destroyChunkMap(cells);
+        htw_geo_destroyChunkMap(columns);
+    }
+
+    printf("Expecting errors about a field that doesn't fit, and columns with halos:\n");
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMapWithHalo(4, 2, 2, sizeof(MixedCell), 0, 1);
+    failures += htw_geo_setCellSchema(chunkMap, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_CELLS) != 0;
+    *(u16*)htw_geo_getCellValueForWrite(chunkMap, (htw_geo_GridCoord){6, 5}, MIXED_OWNER) = 9;
+    failures += ((MixedCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){6, 5}))->owner != 9;
+    failures += htw_geo_setCellSchema(chunkMap, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_COLUMNS) != -1;
+    htw_geo_destroyChunkMap(chunkMap);
+    chunkMap = htw_geo_createChunkMap(4, 2, 2, sizeof(u32));
+    failures += htw_geo_setCellSchema(chunkMap, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_COLUMNS) != -1;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+HTW_CHUNKMAP_DEFINE(TestCellMap, TestCell)
+HTW_CHUNKMAP_DEFINE_POW2(TestCellMap16, TestCell, 4)
+
+void markTestCell(void *context, TestCell *cell, htw_geo_GridCoord cellCoord) {
+    const htw_ChunkMap *chunkMap = context;
+    // the coordinate is the one the cell is found at
+    cell->tag += (TestCell*)htw_geo_getCell(chunkMap, cellCoord) == cell;
+    cell->gradient = cellCoord.x;
+    cell->simplex = cellCoord.y;
+}
+
+int typedCellsMatch(htw_ChunkMap *chunkMap, int pow2Typed) {
+    int failures = 0;
+    for (s32 y = -70; y < 90; y += 3) {
+        for (s32 x = -70; x < 90; x += 5) {
+            htw_geo_GridCoord coord = {x, y};
+            TestCell *expected = htw_geo_getCell(chunkMap, coord);
+            TestCell *typed = pow2Typed ? TestCellMap16_getCell(chunkMap, coord) : TestCellMap_getCell(chunkMap, coord);
+            TestCell *typedWrite = pow2Typed ? TestCellMap16_getCellForWrite(chunkMap, coord) : TestCellMap_getCellForWrite(chunkMap, coord);
+            failures += typed != expected || typedWrite != expected;
+        }
+    }
+    return failures;
+}
+
+int test_typedChunkMap() {
+    int failures = 0;
+    // same cells as the void * functions, with and without the shift and mask path, and with halos
+    htw_ChunkMap *chunkMap = TestCellMap_create(16, 4, 2, 0);
+    failures += chunkMap->cellDataSize != sizeof(TestCell) || !chunkMap->isPow2;
+    failures += typedCellsMatch(chunkMap, 0);
+    htw_geo_destroyChunkMap(chunkMap);
+    chunkMap = TestCellMap_create(12, 3, 2, HTW_GEO_CHUNKMAP_SLAB);
+    failures += typedCellsMatch(chunkMap, 0);
+    htw_geo_destroyChunkMap(chunkMap);
+    chunkMap = htw_geo_createChunkMapWithHalo(16, 4, 4, sizeof(TestCell), 0, 2);
+    failures += typedCellsMatch(chunkMap, 0);
+    failures += typedCellsMatch(chunkMap, 1);
+    htw_geo_destroyChunkMap(chunkMap);
+
+    printf("Expecting an error about chunk counts that aren't powers of 2:\n");
+    failures += TestCellMap16_create(4, 3, 0) != NULL;
+    chunkMap = TestCellMap16_create(4, 2, 0);
+    failures += chunkMap->chunkSize != 16;
+    failures += typedCellsMatch(chunkMap, 1);
+
+    // fills only the listed chunks
+    const u32 listed[] = {1, 6};
+    TestCellMap16_fill(chunkMap, listed, 2, (TestCell){.tag = 3, .gradient = -5, .simplex = 0.5f});
+    for (u32 c = 0; c < chunkMap->chunkCountX * chunkMap->chunkCountY; c++) {
+        const TestCell *cells = TestCellMap16_getChunk(chunkMap, c);
+        int isListed = c == 1 || c == 6;
+        for (u32 i = 0; i < chunkMap->cellsPerChunk; i++) {
+            failures += cells[i].gradient != (isListed ? -5 : 0) || cells[i].tag != (isListed ? 3 : 0);
+        }
+    }
+
+    // visits every cell once, with its coordinate, and records writes
+    u32 generation = htw_geo_newChangeGeneration(chunkMap);
+    TestCellMap16_forEachCell(chunkMap, NULL, 0, markTestCell, chunkMap);
+    for (u32 c = 0; c < chunkMap->chunkCountX * chunkMap->chunkCountY; c++) {
+        failures += htw_geo_getChunkGeneration(chunkMap, c) <= generation;
+        const TestCell *cells = TestCellMap16_getChunk(chunkMap, c);
+        for (u32 i = 0; i < chunkMap->cellsPerChunk; i++) {
+            htw_geo_GridCoord coord = htw_geo_chunkAndCellToGridCoordinates(chunkMap, c, i);
+            u8 expectedTag = (c == 1 || c == 6 ? 3 : 0) + 1;
+            failures += cells[i].tag != expectedTag || cells[i].gradient != coord.x || cells[i].simplex != coord.y;
+        }
+    }
+    htw_geo_destroyChunkMap(chunkMap);
+
+    // row by row on a map with halos, without touching the halo
+    chunkMap = htw_geo_createChunkMapWithHalo(8, 2, 2, sizeof(TestCell), 0, 1);
+    TestCellMap_fill(chunkMap, NULL, 0, (TestCell){.gradient = 9});
+    for (u32 c = 0; c < 4; c++) {
+        TestCell *cells = TestCellMap_getChunk(chunkMap, c);
+        for (s32 y = -1; y <= 8; y++) {
+            const TestCell *row = TestCellMap_getChunkRow(chunkMap, cells, 0) + (y * (s32)chunkMap->chunkPitch);
+            for (s32 x = -1; x <= 8; x++) {
+                int inside = x >= 0 && x < 8 && y >= 0 && y < 8;
+                failures += row[x].gradient != (inside ? 9 : 0);
+            }
+        }
+    }
+    htw_geo_destroyChunkMap(chunkMap);
+
+    // lazy maps create chunks through the typed functions too
+    chunkMap = htw_geo_createLazyChunkMap(16, 2, 2, sizeof(TestCell), (htw_geo_ChunkSource){0});
+    TestCellMap_getCellForWrite(chunkMap, (htw_geo_GridCoord){-1, -1})->gradient = 4;
+    failures += TestCellMap_getCell(chunkMap, (htw_geo_GridCoord){31, 31})->gradient != 4;
+    failures += TestCellMap_getCell(chunkMap, (htw_geo_GridCoord){0, 0})->gradient != 0;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Reference Morton index, one bit at a time
+u32 mortonByBits(u32 x, u32 y) {
+    u32 index = 0;
+    for (u32 bit = 0; bit < 16; bit++) {
+        index |= ((x >> bit) & 1) << (2 * bit);
+        index |= ((y >> bit) & 1) << ((2 * bit) + 1);
+    }
+    return index;
+}
+
+int test_cellOrder() {
+    int failures = 0;
+    const htw_geo_CellOrder orders[] = {HTW_GEO_CELL_ORDER_ROWS, HTW_GEO_CELL_ORDER_MORTON, HTW_GEO_CELL_ORDER_HILBERT};
+    // chunk counts that are and aren't powers of 2, so both the shift and mask and the general path are covered
+    const u32 shapes[][3] = {{16, 4, 2}, {8, 3, 5}, {1, 2, 2}};
+    for (int o = 0; o < 3; o++) {
+        for (int s = 0; s < 3; s++) {
+            htw_ChunkMap *chunkMap = htw_geo_createChunkMap(shapes[s][0], shapes[s][1], shapes[s][2], sizeof(StencilCell));
+            failures += htw_geo_setCellOrder(chunkMap, orders[o]) != 0;
+
+            // every cell in a chunk has its own cellIndex, and converts back to the same position
+            u8 *seen = calloc(chunkMap->cellsPerChunk, 1);
+            for (u32 y = 0; y < chunkMap->chunkSize; y++) {
+                for (u32 x = 0; x < chunkMap->chunkSize; x++) {
+                    u32 cellIndex = htw_geo_cellCoordToCellIndex(chunkMap, x, y);
+                    htw_geo_GridCoord back = htw_geo_cellIndexToCellCoord(chunkMap, cellIndex);
+                    failures += cellIndex >= chunkMap->cellsPerChunk || seen[cellIndex]++ != 0;
+                    failures += back.x != x || back.y != y;
+                    if (orders[o] == HTW_GEO_CELL_ORDER_MORTON) failures += cellIndex != mortonByBits(x, y);
+                }
+            }
+            free(seen);
+            // each cell on a Hilbert curve is next to the one before it
+            for (u32 i = 1; orders[o] == HTW_GEO_CELL_ORDER_HILBERT && i < chunkMap->cellsPerChunk; i++) {
+                htw_geo_GridCoord a = htw_geo_cellIndexToCellCoord(chunkMap, i - 1);
+                htw_geo_GridCoord b = htw_geo_cellIndexToCellCoord(chunkMap, i);
+                failures += abs(a.x - b.x) + abs(a.y - b.y) != 1;
+            }
+
+            // coordinate conversions and cell lookups agree, including wrapping
+            for (s32 y = -20; y < (s32)chunkMap->mapHeight + 20; y++) {
+                for (s32 x = -20; x < (s32)chunkMap->mapWidth + 20; x++) {
+                    htw_geo_GridCoord coord = {x, y};
+                    u32 chunkIndex, cellIndex;
+                    htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, coord, &chunkIndex, &cellIndex);
+                    htw_geo_GridCoord wrapped = htw_geo_wrapGridCoordOnChunkMap(chunkMap, coord);
+                    htw_geo_GridCoord back = htw_geo_chunkAndCellToGridCoordinates(chunkMap, chunkIndex, cellIndex);
+                    failures += back.x != wrapped.x || back.y != wrapped.y;
+                    StencilCell *expected = (StencilCell*)chunkMap->chunks[chunkIndex].cellData + cellIndex;
+                    failures += htw_geo_getCell(chunkMap, coord) != expected;
+                    failures += htw_geo_getCellForWrite(chunkMap, coord) != expected;
+                }
+            }
+
+            // stencils find the same neighbors as the coordinate lookup
+            for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+                for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                    ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y}))->value = xxh_hash2d(s, x, y) % 1000;
+                }
+            }
+            for (u32 c = 0; c < chunkMap->chunkCountX * chunkMap->chunkCountY; c++) {
+                htw_geo_StencilIterator iter;
+                htw_geo_beginChunkStencil(&iter, chunkMap, c);
+                u32 visited = 0;
+                while (htw_geo_nextStencilCell(&iter)) {
+                    htw_geo_GridCoord expectedCoord = htw_geo_chunkAndCellToGridCoordinates(chunkMap, c, visited);
+                    failures += iter.cellIndex != visited || iter.coord.x != expectedCoord.x || iter.coord.y != expectedCoord.y;
+                    failures += iter.cell != htw_geo_getCell(chunkMap, iter.coord);
+                    for (int d = 0; d < HEX_DIRECTION_COUNT; d++) {
+                        failures += iter.neighbors[d] != htw_geo_getCell(chunkMap, POSITION_IN_DIRECTION(iter.coord, d));
+                    }
+                    visited++;
+                }
+                failures += visited != chunkMap->cellsPerChunk;
+            }
+            htw_geo_forEachCellStencil(chunkMap, 1, sumNeighbors, NULL);
+            for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+                for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                    StencilCell *cell = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+                    failures += cell->neighborSum != sumNeighborsByCoord(chunkMap, (htw_geo_GridCoord){x, y});
+                }
+            }
+            htw_geo_destroyChunkMap(chunkMap);
+
+            // fills write the same values to the same coordinates as with rows
+            htw_ChunkMap *filled = htw_geo_createChunkMap(shapes[s][0], shapes[s][1], shapes[s][2], sizeof(TestCell));
+            htw_geo_setCellOrder(filled, orders[o]);
+            htw_geo_fillChunkMapCircularGradient(filled, HTW_GEO_CELL_FIELD(TestCell, gradient), NULL, 0, (htw_geo_GridCoord){5, 6}, 100, 0, 20);
+            htw_geo_fillChunkMapSimplex(filled, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 3, 2, 4);
+            for (s32 y = 0; y < filled->mapHeight; y++) {
+                for (s32 x = 0; x < filled->mapWidth; x++) {
+                    htw_geo_GridCoord coord = {x, y};
+                    TestCell *cell = htw_geo_getCell(filled, coord);
+                    failures += cell->gradient != htw_geo_circularGradientByGridCoord(filled, coord, (htw_geo_GridCoord){5, 6}, 100, 0, 20);
+                    failures += cell->simplex != htw_geo_simplex(filled, coord, 3, 2, 4);
+                }
+            }
+            // typed walks pass each cell's own coordinate
+            TestCellMap_forEachCell(filled, NULL, 0, markTestCell, filled);
+            for (s32 y = 0; y < filled->mapHeight; y++) {
+                for (s32 x = 0; x < filled->mapWidth; x++) {
+                    TestCell *cell = htw_geo_getCell(filled, (htw_geo_GridCoord){x, y});
+                    failures += cell->tag != 1 || cell->gradient != x || cell->simplex != y;
+                    failures += TestCellMap_getCell(filled, (htw_geo_GridCoord){x, y}) != cell;
+                }
+            }
+
+            // a saved map keeps its order, and every cell is found at the same coordinate
+            const char *path = "htw_test_order_chunkmap.bin";
+            failures += htw_geo_saveChunkMap(filled, path) != 0;
+            htw_ChunkMap *opened = htw_geo_openChunkMap(path, 0);
+            failures += opened->cellOrder != orders[o];
+            for (s32 y = 0; y < filled->mapHeight; y++) {
+                for (s32 x = 0; x < filled->mapWidth; x++) {
+                    failures += memcmp(htw_geo_getCell(opened, (htw_geo_GridCoord){x, y}), htw_geo_getCell(filled, (htw_geo_GridCoord){x, y}), sizeof(TestCell)) != 0;
+                }
+            }
+            failures += htw_geo_setCellOrder(opened, orders[o]) != 0;
+            if (orders[o] == HTW_GEO_CELL_ORDER_HILBERT && s == 0) {
+                printf("Expecting an error about an order that doesn't match the file:\n");
+                failures += htw_geo_setCellOrder(opened, HTW_GEO_CELL_ORDER_ROWS) != -1;
+            }
+            htw_geo_destroyChunkMap(opened);
+            remove(path);
+            htw_geo_destroyChunkMap(filled);
+        }
+    }
+
+    printf("Expecting errors about a chunk size that isn't a power of 2, and a map with halos:\n");
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(12, 2, 2, sizeof(s32));
+    failures += htw_geo_setCellOrder(chunkMap, HTW_GEO_CELL_ORDER_MORTON) != -1;
+    failures += htw_geo_setCellOrder(chunkMap, HTW_GEO_CELL_ORDER_ROWS) != 0;
+    htw_geo_destroyChunkMap(chunkMap);
+    chunkMap = htw_geo_createChunkMapWithHalo(16, 2, 2, sizeof(s32), 0, 1);
+    failures += htw_geo_setCellOrder(chunkMap, HTW_GEO_CELL_ORDER_HILBERT) != -1;
+    htw_geo_destroyChunkMap(chunkMap);
+
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Number of mismatches between a spatial storage and the coordinates its items should be at, over a square [area] wide
+int checkSpatialItems(htw_SpatialStorage *ss, const htw_geo_GridCoord *coords, u32 itemCount, s32 area) {
+    int failures = 0;
+    u32 found = 0;
+    for (s32 y = 0; y < area; y++) {
+        for (s32 x = 0; x < area; x++) {
+            htw_geo_GridCoord coord = {x, y};
+            for (size_t i = htw_geo_spatialFirstIndex(ss, coord); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) {
+                failures += !htw_geo_isEqualGridCoords(coords[i], coord);
+                found++;
+            }
+        }
+    }
+    return failures + (found != itemCount);
+}
+
+int test_spatialStorage() {
+    int failures = 0;
+    const u32 itemCount = 64;
+    // room for a single item, so the links and table both grow while inserting
+    htw_SpatialStorage *ss = htw_geo_createSpatialStorage(1);
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * itemCount);
+    for (u32 i = 0; i < itemCount; i++) {
+        coords[i] = (htw_geo_GridCoord){i % 5, i % 3};
+        htw_geo_spatialInsert(ss, coords[i], i);
+    }
+    failures += htw_geo_spatialFirstIndex(ss, (htw_geo_GridCoord){7, 7}) != HTW_GEO_SPATIAL_NO_ITEM;
+    failures += htw_geo_spatialItemCountAt(ss, (htw_geo_GridCoord){7, 7}) != 0;
+
+    // every item at a coordinate, and nothing else, newest first
+    for (s32 y = 0; y < 3; y++) {
+        for (s32 x = 0; x < 5; x++) {
+            htw_geo_GridCoord coord = {x, y};
+            size_t expectedCount = 0;
+            for (u32 i = 0; i < itemCount; i++) expectedCount += htw_geo_isEqualGridCoords(coords[i], coord);
+            failures += htw_geo_spatialItemCountAt(ss, coord) != expectedCount;
+            size_t visited = 0;
+            size_t previous = itemCount;
+            for (size_t i = htw_geo_spatialFirstIndex(ss, coord); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) {
+                failures += !htw_geo_isEqualGridCoords(coords[i], coord) || i >= previous;
+                previous = i;
+                visited++;
+            }
+            failures += visited != expectedCount;
+        }
+    }
+
+    // moved and removed items are only found at their new coordinate
+    htw_geo_spatialMove(ss, coords[10], (htw_geo_GridCoord){-4, 9}, 10);
+    htw_geo_spatialRemove(ss, coords[11], 11);
+    failures += htw_geo_spatialFirstIndex(ss, (htw_geo_GridCoord){-4, 9}) != 10;
+    failures += htw_geo_spatialNextIndex(ss, 10) != HTW_GEO_SPATIAL_NO_ITEM;
+    for (size_t i = htw_geo_spatialFirstIndex(ss, coords[10]); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) {
+        failures += i == 10;
+    }
+    for (size_t i = htw_geo_spatialFirstIndex(ss, coords[11]); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) {
+        failures += i == 11;
+    }
+    failures += htw_geo_spatialItemCountAt(ss, coords[11]) != 3;
+
+    // removing twice, or moving with the wrong old coordinate, still leaves every item in one place
+    htw_geo_spatialRemove(ss, coords[11], 11);
+    htw_geo_spatialMove(ss, (htw_geo_GridCoord){50, 50}, coords[11], 11);
+    htw_geo_spatialMove(ss, coords[12], coords[12], 12);
+    coords[10] = (htw_geo_GridCoord){-4, 9};
+    failures += htw_geo_spatialItemCountAt(ss, coords[11]) != 4;
+    failures += htw_geo_spatialItemCountAt(ss, coords[12]) != 4;
+
+    // a batch of moves ends the same as moving one at a time, with or without collisions. The larger table has more
+    // slot bits than one radix sort pass covers
+    for (int round = 0; round < 4; round++) {
+        if (round == 2) {
+            htw_geo_destroySpatialStorage(ss);
+            ss = htw_geo_createSpatialStorage(4096);
+            for (u32 i = 0; i < itemCount; i++) htw_geo_spatialInsert(ss, coords[i], i);
+        }
+        htw_geo_SpatialMove moves[40];
+        for (u32 m = 0; m < 40; m++) {
+            u32 item = (m * 7 + round) % itemCount; // each item once per batch
+            moves[m] = (htw_geo_SpatialMove){item, {xxh_hash2d(round, m, 0) % 6, xxh_hash2d(round, m, 1) % 6}};
+            coords[item] = moves[m].newCoord;
+        }
+        htw_geo_spatialMoveMany(ss, moves, 40);
+        failures += checkSpatialItems(ss, coords, itemCount, 64);
+    }
+
+    free(coords);
+    htw_geo_destroySpatialStorage(ss);
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Mismatches between the items a range query found and every item within [radius] (or exactly [radius], for rings)
+int checkRangeQuery(htw_SpatialStorage *ss, const htw_ChunkMap *wrapMap, const htw_geo_GridCoord *coords, u32 itemCount, htw_geo_GridCoord center, u32 radius, int ring) {
+    int failures = 0;
+    size_t *found = malloc(sizeof(size_t) * itemCount);
+    u8 *seen = calloc(itemCount, 1);
+    size_t foundCount = ring ? htw_geo_spatialQueryRing(ss, wrapMap, center, radius, found, itemCount)
+                             : htw_geo_spatialQueryRadius(ss, wrapMap, center, radius, found, itemCount);
+    for (size_t f = 0; f < foundCount; f++) seen[found[f]]++;
+    for (u32 i = 0; i < itemCount; i++) {
+        u32 distance = wrapMap == NULL ? htw_geo_hexGridDistance(center, coords[i]) : htw_geo_getChunkMapHexDistance(wrapMap, center, coords[i]);
+        int inRange = ring ? distance == radius : distance <= radius;
+        failures += seen[i] != inRange;
+    }
+    free(found);
+    free(seen);
+    return failures;
+}
+
+int test_spatialRangeQueries() {
+    int failures = 0;
+    const u32 itemCount = 500;
+    htw_ChunkMap *wrapMap = htw_geo_createChunkMap(16, 4, 3, sizeof(u8));
+    htw_SpatialStorage *ss = htw_geo_createSpatialStorage(1024);
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * itemCount);
+    // a dense corner and scattered items elsewhere, so some strips are empty and some are crowded
+    for (u32 i = 0; i < itemCount; i++) {
+        u32 spread = i % 2 ? 8 : wrapMap->mapWidth;
+        coords[i] = (htw_geo_GridCoord){xxh_hash2d(4, i, 0) % spread, xxh_hash2d(5, i, 0) % MIN(spread, wrapMap->mapHeight)};
+        htw_geo_spatialInsert(ss, coords[i], i);
+    }
+
+    // centers inside, on the edges, and outside the map; radii up to just under half the map height
+    for (u32 q = 0; q < 40; q++) {
+        htw_geo_GridCoord center = {(s32)(xxh_hash2d(6, q, 0) % 100) - 18, (s32)(xxh_hash2d(7, q, 0) % 80) - 16};
+        u32 radius = q % 24;
+        failures += checkRangeQuery(ss, wrapMap, coords, itemCount, center, radius, 0);
+        failures += checkRangeQuery(ss, wrapMap, coords, itemCount, center, radius, 1);
+        // without a map, nothing wraps
+        failures += checkRangeQuery(ss, NULL, coords, itemCount, center, radius, 0);
+        failures += checkRangeQuery(ss, NULL, coords, itemCount, center, radius, 1);
+    }
+
+    // still right after items move between strips
+    htw_geo_SpatialMove moves[100];
+    for (u32 m = 0; m < 100; m++) {
+        moves[m] = (htw_geo_SpatialMove){m * 5, {xxh_hash2d(8, m, 0) % wrapMap->mapWidth, xxh_hash2d(9, m, 0) % wrapMap->mapHeight}};
+        coords[m * 5] = moves[m].newCoord;
+    }
+    htw_geo_spatialMoveMany(ss, moves, 100);
+    for (u32 i = 1; i < itemCount; i += 5) {
+        coords[i] = POSITION_IN_DIRECTION(coords[i], HEX_DIRECTION_EAST);
+        coords[i] = htw_geo_wrapGridCoordOnChunkMap(wrapMap, coords[i]);
+        htw_geo_spatialMove(ss, (htw_geo_GridCoord){0, 0}, coords[i], i);
+    }
+    for (u32 q = 0; q < 20; q++) {
+        htw_geo_GridCoord center = {xxh_hash2d(10, q, 0) % 64, xxh_hash2d(11, q, 0) % 48};
+        failures += checkRangeQuery(ss, wrapMap, coords, itemCount, center, q, 0);
+    }
+
+    // the count includes items that didn't fit
+    size_t few[3] = {0};
+    size_t total = htw_geo_spatialQueryRadius(ss, wrapMap, (htw_geo_GridCoord){4, 4}, 20, few, 3);
+    failures += total <= 3;
+    for (int i = 0; i < 3; i++) failures += htw_geo_getChunkMapHexDistance(wrapMap, (htw_geo_GridCoord){4, 4}, coords[few[i]]) > 20;
+
+    // removing everything leaves every strip empty
+    for (u32 i = 0; i < itemCount; i++) htw_geo_spatialRemove(ss, coords[i], i);
+    for (u32 i = 0; i <= ss->table.stripMask; i++) failures += ss->table.stripCounts[i] != 0;
+
+    free(coords);
+    htw_geo_destroySpatialStorage(ss);
+    htw_geo_destroyChunkMap(wrapMap);
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+int test_spatialStorageGrowth() {
+    int failures = 0;
+    const u32 itemCount = 5000;
+    const s32 area = 40;
+    htw_SpatialStorage *ss = htw_geo_createSpatialStorage(16);
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * itemCount);
+    // checked between inserts, so some checks land while the old table's slots are only partly moved
+    int checksDuringMigration = 0;
+    for (u32 n = 0; n < itemCount; n++) {
+        coords[n] = (htw_geo_GridCoord){xxh_hash2d(12, n, 0) % area, xxh_hash2d(13, n, 0) % area};
+        htw_geo_spatialInsert(ss, coords[n], n);
+        if (n % 97 != 0) continue;
+        checksDuringMigration += ss->oldTable.slots != NULL;
+        failures += checkSpatialItems(ss, coords, n + 1, area);
+        failures += ss->itemCount != n + 1;
+        // growing keeps the newest first order
+        for (s32 y = 0; y < area; y += 7) {
+            size_t previous = n + 1;
+            for (size_t i = htw_geo_spatialFirstIndex(ss, (htw_geo_GridCoord){3, y}); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) {
+                failures += i >= previous;
+                previous = i;
+            }
+        }
+        htw_geo_GridCoord center = {xxh_hash2d(14, n, 0) % area, xxh_hash2d(15, n, 0) % area};
+        failures += checkRangeQuery(ss, NULL, coords, n + 1, center, n % 9, 0);
+    }
+    failures += checksDuringMigration == 0;
+    failures += ss->table.slotMask + 1 < itemCount * 2;
+
+    // moves and removes with a migration in progress; the last doubling started at item 4097
+    failures += ss->oldTable.slots == NULL;
+    size_t totalSlots = ss->table.slotMask + 1;
+    htw_geo_SpatialMove moves[300];
+    for (u32 m = 0; m < 300; m++) {
+        u32 item = m * 13;
+        moves[m] = (htw_geo_SpatialMove){item, {xxh_hash2d(16, m, 0) % area, xxh_hash2d(17, m, 0) % area}};
+        coords[item] = moves[m].newCoord;
+    }
+    htw_geo_spatialMoveMany(ss, moves, 300);
+    for (u32 i = 1; i < itemCount; i += 11) {
+        coords[i] = POSITION_IN_DIRECTION(coords[i], HEX_DIRECTION_NORTH_EAST);
+        coords[i].y = MOD(coords[i].y, area);
+        htw_geo_spatialMove(ss, coords[i], coords[i], i);
+    }
+    failures += checkSpatialItems(ss, coords, itemCount, area);
+    failures += checkRangeQuery(ss, NULL, coords, itemCount, (htw_geo_GridCoord){20, 20}, 6, 0);
+    failures += ss->table.slotMask + 1 != totalSlots;
+
+    // an item index past the end grows the links to fit
+    htw_geo_spatialInsert(ss, (htw_geo_GridCoord){-5, -5}, 100000);
+    failures += ss->maxItemCount <= 100000;
+    failures += htw_geo_spatialFirstIndex(ss, (htw_geo_GridCoord){-5, -5}) != 100000;
+    failures += htw_geo_spatialFirstIndex(ss, (htw_geo_GridCoord){-5, -4}) != HTW_GEO_SPATIAL_NO_ITEM;
+    failures += checkSpatialItems(ss, coords, itemCount, area);
+    htw_geo_spatialRemove(ss, (htw_geo_GridCoord){-5, -5}, 100000);
+    // the largest index only allocates links near it; indices skipped over aren't in the storage
+    htw_geo_spatialInsert(ss, (htw_geo_GridCoord){-5, -5}, HTW_GEO_SPATIAL_MAX_ITEM_INDEX);
+    failures += ss->maxItemCount != (size_t)HTW_GEO_SPATIAL_MAX_ITEM_INDEX + 1;
+    failures += htw_geo_spatialFirstIndex(ss, (htw_geo_GridCoord){-5, -5}) != HTW_GEO_SPATIAL_MAX_ITEM_INDEX;
+    failures += ss->linkSegments[1000000000 >> HTW_GEO_SPATIAL_LINK_SEGMENT_SHIFT] != NULL;
+    htw_geo_spatialRemove(ss, (htw_geo_GridCoord){-5, -5}, 1000000000);
+    htw_geo_spatialInsert(ss, (htw_geo_GridCoord){-5, -6}, 1000000000);
+    failures += htw_geo_spatialFirstIndex(ss, (htw_geo_GridCoord){-5, -6}) != 1000000000;
+    htw_geo_spatialRemove(ss, (htw_geo_GridCoord){-5, -6}, 1000000000);
+    htw_geo_spatialRemove(ss, (htw_geo_GridCoord){-5, -5}, HTW_GEO_SPATIAL_MAX_ITEM_INDEX);
+    failures += checkSpatialItems(ss, coords, itemCount, area);
+    printf("Expecting an error about an item index that is too large:\n");
+    htw_geo_spatialInsert(ss, (htw_geo_GridCoord){0, 0}, (size_t)HTW_GEO_SPATIAL_MAX_ITEM_INDEX + 1);
+
+    // removing everything empties both tables
+    for (u32 i = 0; i < itemCount; i++) htw_geo_spatialRemove(ss, coords[i], i);
+    failures += ss->itemCount != 0;
+    failures += ss->oldTable.slots != NULL;
+    for (u32 i = 0; i <= ss->table.slotMask; i++) failures += ss->table.slots[i] != 0;
+    for (u32 i = 0; i <= ss->table.stripMask; i++) failures += ss->table.stripCounts[i] != 0;
+
+    free(coords);
+    htw_geo_destroySpatialStorage(ss);
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+// Shared by the writer and readers of test_concurrentSpatialStorage. Even items stay at their home coordinate; the writer
+// moves odd items between home and away, and sometimes removes and reinserts them
+typedef struct {
+    htw_ConcurrentSpatialStorage *cs;
+    u32 itemCount;
+    s32 area;
+    htw_geo_GridCoord *homes;
+    htw_geo_GridCoord *aways;
+    u8 *isAway; // only touched by the writer until every thread is done
+    u32 *staticCounts; // number of even items at each cell
+    u32 writes;
+    u32 reads;
+    _Atomic u32 failures;
+} ConcurrentSpatialTest;
+
+// Mismatches between items a concurrent read found and what any moment of the writer's changes could have shown: every
+// item found could be there, no item is found twice, and every item that never moves is found
+u32 checkConcurrentItems(ConcurrentSpatialTest *test, const size_t *found, size_t foundCount, htw_geo_GridCoord center, u32 radius, u32 expectedStatic) {
+    u32 failures = 0;
+    u32 staticFound = 0;
+    for (size_t f = 0; f < foundCount; f++) {
+        size_t i = found[f];
+        if (i >= test->itemCount) return failures + 1;
+        u32 homeDistance = htw_geo_hexGridDistance(center, test->homes[i]);
+        u32 awayDistance = htw_geo_hexGridDistance(center, test->aways[i]);
+        failures += homeDistance > radius && (i % 2 == 0 || awayDistance > radius);
+        staticFound += i % 2 == 0;
+        // a moving item may show up at both of its coordinates in a range query, but never twice in one cell
+        for (size_t other = 0; other < f; other++) {
+            failures += found[other] == i && (radius == 0 || i % 2 == 0);
+        }
+    }
+    return failures + (staticFound != expectedStatic);
+}
+
+void runConcurrentSpatialRole(void *context, u32 start, u32 end) {
+    ConcurrentSpatialTest *test = context;
+    for (u32 role = start; role < end; role++) {
+        if (role == 0) {
+            for (u32 w = 0; w < test->writes; w++) {
+                u32 item = ((xxh_hash2d(20, w, 0) % (test->itemCount / 2)) * 2) + 1;
+                if (w % 16 == 0) {
+                    htw_geo_concurrentSpatialRemove(test->cs, test->homes[item], item);
+                    htw_geo_concurrentSpatialInsert(test->cs, test->homes[item], item);
+                    test->isAway[item] = 0;
+                    continue;
+                }
+                test->isAway[item] = !test->isAway[item];
+                htw_geo_concurrentSpatialMove(test->cs, test->homes[item], test->isAway[item] ? test->aways[item] : test->homes[item], item);
+            }
+            continue;
+        }
+        u32 failures = 0;
+        size_t found[256];
+        for (u32 r = 0; r < test->reads; r++) {
+            htw_geo_GridCoord coord = {xxh_hash2d(21, r, role) % test->area, xxh_hash2d(22, r, role) % test->area};
+            size_t foundCount = htw_geo_concurrentSpatialItemsAt(test->cs, coord, found, 256);
+            failures += foundCount > 256;
+            failures += checkConcurrentItems(test, found, MIN(foundCount, 256), coord, 0, test->staticCounts[(coord.y * test->area) + coord.x]);
+            if (r % 64 == 0) {
+                // a range query costs more to check, so there are fewer of them
+                u32 radius = r % 3;
+                u32 expectedStatic = 0;
+                for (u32 i = 0; i < test->itemCount; i += 2) expectedStatic += htw_geo_hexGridDistance(coord, test->homes[i]) <= radius;
+                foundCount = htw_geo_concurrentSpatialQueryRadius(test->cs, NULL, coord, radius, found, 256);
+                failures += foundCount > 256;
+                failures += checkConcurrentItems(test, found, MIN(foundCount, 256), coord, radius, expectedStatic);
+            }
+        }
+        test->failures += failures;
+    }
+}
+
+int test_concurrentSpatialStorage() {
+    int failures = 0;
+    // few cells for the number of items, so readers and the writer keep landing on the same slots
+    ConcurrentSpatialTest test = {
+        .itemCount = 2000,
+        .area = 24,
+        .writes = 200000,
+        .reads = 20000,
+    };
+    test.cs = htw_geo_createConcurrentSpatialStorage(test.itemCount);
+    test.homes = malloc(sizeof(htw_geo_GridCoord) * test.itemCount);
+    test.aways = malloc(sizeof(htw_geo_GridCoord) * test.itemCount);
+    test.isAway = calloc(test.itemCount, 1);
+    test.staticCounts = calloc(test.area * test.area, sizeof(u32));
+    for (u32 i = 0; i < test.itemCount; i++) {
+        test.homes[i] = (htw_geo_GridCoord){xxh_hash2d(18, i, 0) % test.area, xxh_hash2d(18, i, 1) % test.area};
+        test.aways[i] = (htw_geo_GridCoord){xxh_hash2d(19, i, 0) % test.area, xxh_hash2d(19, i, 1) % test.area};
+        if (i % 2 == 0) test.staticCounts[(test.homes[i].y * test.area) + test.homes[i].x]++;
+        htw_geo_concurrentSpatialInsert(test.cs, test.homes[i], i);
+    }
+
+    // one writer and three readers
+    htw_parallelFor(4, 4, runConcurrentSpatialRole, &test);
+    failures += test.failures;
+
+    // once the writer is done, every item is exactly where it was left
+    size_t found[256];
+    for (s32 y = 0; y < test.area; y++) {
+        for (s32 x = 0; x < test.area; x++) {
+            htw_geo_GridCoord coord = {x, y};
+            size_t foundCount = htw_geo_concurrentSpatialItemsAt(test.cs, coord, found, 256);
+            u32 expectedCount = 0;
+            for (u32 i = 0; i < test.itemCount; i++) {
+                expectedCount += htw_geo_isEqualGridCoords(test.isAway[i] ? test.aways[i] : test.homes[i], coord);
+            }
+            failures += foundCount != expectedCount;
+            for (size_t f = 0; f < MIN(foundCount, 256); f++) {
+                size_t i = found[f];
+                failures += !htw_geo_isEqualGridCoords(test.isAway[i] ? test.aways[i] : test.homes[i], coord);
+            }
+        }
+    }
+    // and the range query agrees with the plain storage
+    htw_SpatialStorage *ss = htw_geo_createSpatialStorage(test.itemCount);
+    for (u32 i = 0; i < test.itemCount; i++) htw_geo_spatialInsert(ss, test.isAway[i] ? test.aways[i] : test.homes[i], i);
+    size_t expected[test.itemCount];
+    size_t all[test.itemCount];
+    size_t expectedCount = htw_geo_spatialQueryRing(ss, NULL, (htw_geo_GridCoord){12, 12}, 7, expected, test.itemCount);
+    size_t foundCount = htw_geo_concurrentSpatialQueryRing(test.cs, NULL, (htw_geo_GridCoord){12, 12}, 7, all, test.itemCount);
+    failures += foundCount != expectedCount;
+    u32 *seen = calloc(test.itemCount, sizeof(u32));
+    for (size_t f = 0; f < MIN(expectedCount, foundCount); f++) {
+        seen[expected[f]]++;
+        seen[all[f]]--;
+    }
+    for (u32 i = 0; i < test.itemCount; i++) failures += seen[i] != 0;
+
+    printf("Expecting an error about an item index past the end:\n");
+    htw_geo_concurrentSpatialInsert(test.cs, (htw_geo_GridCoord){0, 0}, test.itemCount);
+
+    free(seen);
+    htw_geo_destroySpatialStorage(ss);
+    free(test.homes);
+    free(test.aways);
+    free(test.isAway);
+    free(test.staticCounts);
+    htw_geo_destroyConcurrentSpatialStorage(test.cs);
+    ASSERT_EQUAL(failures, 0);
+    return failures;
+}
+
+int test_geomap() {
+    int failures = 0;
+    failures += test_parallelGenerators();
+    failures += test_chunkMapFills();
+    failures += test_lazyChunkMap();
+    failures += test_chunkMapSlab();
+    failures += test_chunkMapFile();
+    failures += test_compressedChunkStore();
+    failures += test_pow2CellAccess();
+    failures += test_stencil();
+    failures += test_chunkHalos();
+    failures += test_doubleBufferedChunkMap();
+    failures += test_changeTracking();
+    failures += test_cellSchema();
+    failures += test_typedChunkMap();
+    failures += test_cellOrder();
+    failures += test_spatialStorage();
+    failures += test_spatialRangeQueries();
+    failures += test_spatialStorageGrowth();
+    failures += test_concurrentSpatialStorage();
+    return failures;
+}
+
+void bench_parallelGenerators() {
+    const u32 size = 2048;
+    htw_ValueMap *map = htw_geo_createValueMap(size, size, 1000);
+    printf("Perlin and simplex, %ux%u map, 1 thread then %u:\n", size, size, htw_cpuCount());
+    HTW_STOPWATCH_WALL(htw_geo_fillPerlin(map, 0, 4, 0, 0, 0.01, 256, 256));
+    HTW_STOPWATCH_WALL(htw_geo_fillSimplex(map, 0, 4, 0, 0, 4096, 16));
+    HTW_STOPWATCH_WALL(htw_geo_fillPerlinParallel(map, 0, 0, 4, 0, 0, 0.01, 256, 256));
+    HTW_STOPWATCH_WALL(htw_geo_fillSimplexParallel(map, 0, 0, 4, 0, 0, 4096, 16));
+    free(map);
+}
+
+void bench_chunkMapFills() {
+    const u32 chunkSize = 64, chunks = 16;
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(TestCell));
+    printf("Simplex for a %ux%u chunkmap, one cell at a time then bulk:\n", chunkSize * chunks, chunkSize * chunks);
+    HTW_STOPWATCH(
+        for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+            for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                TestCell *cell = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+                cell->simplex = htw_geo_simplex(chunkMap, (htw_geo_GridCoord){x, y}, 0, 4, 4);
+            }
+        }
+    );
+    HTW_STOPWATCH(htw_geo_fillChunkMapSimplex(chunkMap, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 0, 4, 4));
+    htw_geo_destroyChunkMap(chunkMap);
+}
+
+// Visits every cell in map order, crossing chunk boundaries like a renderer or pathfinder would
+float sumChunkMapCells(htw_ChunkMap *chunkMap) {
+    float sum = 0;
+    for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+        for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+            TestCell *cell = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+            sum += cell->simplex;
+        }
+    }
+    return sum;
+}
+
+void bench_chunkMapSlab() {
+    const u32 chunkSize = 32, chunks = 64;
+    const u32 flagSets[] = {0, HTW_GEO_CHUNKMAP_SLAB, HTW_GEO_CHUNKMAP_CACHE_ALIGNED | HTW_GEO_CHUNKMAP_HUGE_PAGES};
+    const char *names[] = {"one allocation per chunk", "slab", "cache aligned slab with huge pages"};
+    for (int f = 0; f < 3; f++) {
+        htw_ChunkMap *chunkMap = htw_geo_createChunkMapWithFlags(chunkSize, chunks, chunks, sizeof(TestCell), flagSets[f]);
+        htw_geo_fillChunkMapSimplex(chunkMap, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 0, 1, 4);
+        printf("Reading every cell of a %ux%u chunkmap, %s:\n", chunkSize * chunks, chunkSize * chunks, names[f]);
+        float sum;
+        HTW_STOPWATCH(sum = sumChunkMapCells(chunkMap));
+        printf("checksum %g\n", sum);
+        htw_geo_destroyChunkMap(chunkMap);
+    }
+}
+
+void bench_chunkMapFile() {
+    const char *path = "htw_bench_chunkmap.bin";
+    const u32 chunkSize = 64, chunks = 32;
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(TestCell));
+    printf("Generating a %ux%u chunkmap, then opening a saved copy and reading one cell:\n", chunkSize * chunks, chunkSize * chunks);
+    HTW_STOPWATCH_WALL(htw_geo_fillChunkMapSimplex(chunkMap, HTW_GEO_CELL_FIELD(TestCell, simplex), NULL, 0, 0, 6, 4));
+    htw_geo_saveChunkMap(chunkMap, path);
+    htw_geo_destroyChunkMap(chunkMap);
+    float value;
+    HTW_STOPWATCH_WALL(
+        chunkMap = htw_geo_openChunkMap(path, 0);
+        value = ((TestCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){100, 100}))->simplex
+    );
+    printf("checksum %g\n", value);
+    htw_geo_destroyChunkMap(chunkMap);
+    remove(path);
+}
+
+void bench_cellAccess() {
+    const u32 lookups = 1 << 22;
+    // small enough to stay in cache, so this measures finding the cell rather than waiting on memory
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(32, 8, 8, sizeof(s32));
+    // random coordinates, some outside the map, so every lookup wraps and lands in an unpredictable chunk
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * lookups);
+    for (u32 i = 0; i < lookups; i++) {
+        coords[i] = (htw_geo_GridCoord){(s32)(xxh_hash2d(0, i, 0) % 1000) - 300, (s32)(xxh_hash2d(1, i, 0) % 1000) - 300};
+    }
+
+    s32 sum = 0;
+    printf("%u random cell lookups on a %ux%u chunkmap; divide and modulo, htw_geo_getCell, htw_geo_getCellPow2:\n", lookups, chunkMap->mapWidth, chunkMap->mapHeight);
+    HTW_STOPWATCH(
+        for (u32 i = 0; i < lookups; i++) {
+            u32 chunkIndex;
+            u32 cellIndex;
+            htw_geo_gridCoordinateToChunkAndCellIndex(chunkMap, coords[i], &chunkIndex, &cellIndex);
+            sum += ((s32*)chunkMap->chunks[chunkIndex].cellData)[cellIndex];
+        }
+    );
+    HTW_STOPWATCH(for (u32 i = 0; i < lookups; i++) sum += *(s32*)htw_geo_getCell(chunkMap, coords[i]));
+    HTW_STOPWATCH(for (u32 i = 0; i < lookups; i++) sum += *(s32*)htw_geo_getCellPow2(chunkMap, coords[i]));
+    printf("checksum %d\n", sum);
+
+    free(coords);
+    htw_geo_destroyChunkMap(chunkMap);
+}
+
+void bench_stencil() {
+    const u32 chunkSize = 64, chunks = 16;
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(StencilCell));
+    for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+        for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+            ((StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y}))->value = xxh_hash2d(0, x, y) % 1000;
+        }
+    }
+    printf("Summing the 6 neighbors of every cell of a %ux%u chunkmap; htw_geo_getCell, stencil on 1 thread, stencil on %u:\n", chunkMap->mapWidth, chunkMap->mapHeight, htw_cpuCount());
+    HTW_STOPWATCH_WALL(
+        for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+            for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+                StencilCell *cell = htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+                cell->neighborSum = sumNeighborsByCoord(chunkMap, (htw_geo_GridCoord){x, y});
+            }
+        }
+    );
+    HTW_STOPWATCH_WALL(htw_geo_forEachCellStencil(chunkMap, 1, sumNeighbors, NULL));
+    HTW_STOPWATCH_WALL(htw_geo_forEachCellStencil(chunkMap, 0, sumNeighbors, NULL));
+
+    // same map with a 1 cell halo; every neighbor is read from the chunk's own memory, after a sync
+    htw_ChunkMap *haloed = htw_geo_createChunkMapWithHalo(chunkSize, chunks, chunks, sizeof(StencilCell), 0, 1);
+    for (s32 y = 0; y < chunkMap->mapHeight; y++) {
+        for (s32 x = 0; x < chunkMap->mapWidth; x++) {
+            *(StencilCell*)htw_geo_getCell(haloed, (htw_geo_GridCoord){x, y}) = *(StencilCell*)htw_geo_getCell(chunkMap, (htw_geo_GridCoord){x, y});
+        }
+    }
+    printf("Same, with 1 cell halos; halo sync, then stencil on 1 thread:\n");
+    HTW_STOPWATCH_WALL(htw_geo_syncHalos(haloed, NULL, 0));
+    HTW_STOPWATCH_WALL(htw_geo_forEachCellStencil(haloed, 1, sumNeighbors, NULL));
+    htw_geo_destroyChunkMap(haloed);
+    htw_geo_destroyChunkMap(chunkMap);
+}
+
+void bench_doubleBuffer() {
+    const u32 chunkSize = 64, chunks = 16, ticks = 100;
+    // each tick changes one cell in every 10th chunk, like a simulation where most of the map is at rest
+    htw_ChunkMap *current = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(StencilCell));
+    htw_ChunkMap *next = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(StencilCell));
+    htw_ChunkMap *buffered = htw_geo_createChunkMapWithFlags(chunkSize, chunks, chunks, sizeof(StencilCell), HTW_GEO_CHUNKMAP_DOUBLE_BUFFERED);
+    size_t chunkBytes = (size_t)current->cellsPerChunk * current->cellDataSize;
+    printf("%u ticks on a %ux%u chunkmap writing 10%% of chunks; copying the whole map each tick, then double buffered:\n", ticks, current->mapWidth, current->mapHeight);
+    HTW_STOPWATCH_WALL(
+        for (u32 t = 0; t < ticks; t++) {
+            for (u32 c = 0; c < chunks * chunks; c++) {
+                memcpy(next->chunks[c].cellData, current->chunks[c].cellData, chunkBytes);
+            }
+            for (u32 c = t % 10; c < chunks * chunks; c += 10) {
+                ((StencilCell*)next->chunks[c].cellData)->value++;
+            }
+            htw_ChunkMap *swap = current;
+            current = next;
+            next = swap;
+        }
+    );
+    HTW_STOPWATCH_WALL(
+        for (u32 t = 0; t < ticks; t++) {
+            for (u32 c = t % 10; c < chunks * chunks; c += 10) {
+                ((StencilCell*)htw_geo_getChunkForWrite(buffered, c))->value++;
+            }
+            htw_geo_swapChunkMap(buffered);
+        }
+    );
+    htw_geo_destroyChunkMap(current);
+    htw_geo_destroyChunkMap(next);
+    htw_geo_destroyChunkMap(buffered);
+}
+
+// Copies chunks into [staging] like an upload to the GPU would
+u32 stageChangedChunks(htw_ChunkMap *chunkMap, u32 sinceGeneration, u8 *staging) {
+    size_t chunkBytes = (size_t)chunkMap->cellsPerChunk * chunkMap->cellDataSize;
+    htw_geo_ChangedChunkIterator iter;
+    htw_geo_beginChangedChunks(&iter, chunkMap, sinceGeneration);
+    u32 chunkIndex, staged = 0;
+    while (htw_geo_nextChangedChunk(&iter, &chunkIndex)) {
+        memcpy(staging + (chunkIndex * chunkBytes), htw_geo_getChunk(chunkMap, chunkIndex), chunkBytes);
+        staged++;
+    }
+    return staged;
+}
+
+void bench_changeTracking() {
+    const u32 chunkSize = 32, chunks = 64, frames = 100;
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(TestCell));
+    size_t chunkBytes = (size_t)chunkMap->cellsPerChunk * chunkMap->cellDataSize;
+    u8 *staging = malloc(chunkBytes * chunks * chunks);
+    printf("%u frames of a %ux%u chunkmap with 1%% of chunks written per frame; staging every chunk, changed chunks from the list, changed chunks by scanning:\n", frames, chunkMap->mapWidth, chunkMap->mapHeight);
+    u32 staged = 0;
+    u32 uploaded = htw_geo_newChangeGeneration(chunkMap);
+    HTW_STOPWATCH_WALL(
+        for (u32 f = 0; f < frames; f++) {
+            for (u32 c = f % 100; c < chunks * chunks; c += 100) htw_geo_getChunkForWrite(chunkMap, c);
+            for (u32 c = 0; c < chunks * chunks; c++) {
+                memcpy(staging + (c * chunkBytes), htw_geo_getChunk(chunkMap, c), chunkBytes);
+            }
+            uploaded = htw_geo_newChangeGeneration(chunkMap);
+        }
+    );
+    HTW_STOPWATCH_WALL(
+        for (u32 f = 0; f < frames; f++) {
+            for (u32 c = f % 100; c < chunks * chunks; c += 100) htw_geo_getChunkForWrite(chunkMap, c);
+            staged += stageChangedChunks(chunkMap, uploaded, staging);
+            uploaded = htw_geo_newChangeGeneration(chunkMap);
+        }
+    );
+    HTW_STOPWATCH_WALL(
+        for (u32 f = 0; f < frames; f++) {
+            for (u32 c = f % 100; c < chunks * chunks; c += 100) htw_geo_getChunkForWrite(chunkMap, c);
+            // one generation further behind than the list covers
+            staged += stageChangedChunks(chunkMap, uploaded - 1, staging);
+            uploaded = htw_geo_newChangeGeneration(chunkMap);
+        }
+    );
+    free(staging);
+    htw_geo_destroyChunkMap(chunkMap);
+}
+
+void bench_cellSchema() {
+    const u32 chunkSize = 64, chunks = 32;
+    htw_ChunkMap *cells = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(MixedCell));
+    htw_ChunkMap *columns = htw_geo_createChunkMap(chunkSize, chunks, chunks, sizeof(MixedCell));
+    htw_geo_setCellSchema(cells, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_CELLS);
+    htw_geo_setCellSchema(columns, mixedCellSchema, MIXED_FIELD_COUNT, HTW_GEO_LAYOUT_COLUMNS);
+    u32 chunkCount = chunks * chunks;
+    printf("Elevation of a %ux%u chunkmap with %zu byte cells; simplex fill then sum, cell structs then columns:\n", cells->mapWidth, cells->mapHeight, sizeof(MixedCell));
+    HTW_STOPWATCH(htw_geo_fillChunkMapSimplex(cells, htw_geo_getSchemaField(cells, MIXED_ELEVATION), NULL, 0, 0, 2, 4));
+    HTW_STOPWATCH(htw_geo_fillChunkMapSimplex(columns, htw_geo_getSchemaField(columns, MIXED_ELEVATION), NULL, 0, 0, 2, 4));
+    float sum = 0;
+    HTW_STOPWATCH(
+        for (u32 c = 0; c < chunkCount; c++) {
+            const MixedCell *chunk = htw_geo_getChunk(cells, c);
+            for (u32 i = 0; i < cells->cellsPerChunk; i++) sum += chunk[i].elevation;
+        }
+    );
+    HTW_STOPWATCH(
+        for (u32 c = 0; c < chunkCount; c++) {
+            const float *elevation = HTW_GEO_CHUNK_COLUMN(float, columns, c, MIXED_ELEVATION);
+            for (u32 i = 0; i < columns->cellsPerChunk; i++) sum += elevation[i];
+        }
+    );
+    printf("checksum %g\n", sum);
+    htw_geo_destroyChunkMap(cells);
+    htw_geo_destroyChunkMap(columns);
+}
+
+void addToGradient(void *context, TestCell *cell, htw_geo_GridCoord cellCoord) {
+    cell->gradient += cellCoord.x;
+}
+
+void bench_typedChunkMap() {
+    const u32 lookups = 1 << 22;
+    htw_ChunkMap *chunkMap = TestCellMap16_create(8, 8, 0);
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * lookups);
+    for (u32 i = 0; i < lookups; i++) {
+        coords[i] = (htw_geo_GridCoord){(s32)(xxh_hash2d(0, i, 0) % 1000) - 300, (s32)(xxh_hash2d(1, i, 0) % 1000) - 300};
+    }
+    s32 sum = 0;
+    printf("%u random cell lookups on a %ux%u chunkmap; htw_geo_getCell, htw_geo_getCellPow2, typed, typed with constant chunk size:\n", lookups, chunkMap->mapWidth, chunkMap->mapHeight);
+    HTW_STOPWATCH(for (u32 i = 0; i < lookups; i++) sum += ((TestCell*)htw_geo_getCell(chunkMap, coords[i]))->gradient);
+    HTW_STOPWATCH(for (u32 i = 0; i < lookups; i++) sum += ((TestCell*)htw_geo_getCellPow2(chunkMap, coords[i]))->gradient);
+    HTW_STOPWATCH(for (u32 i = 0; i < lookups; i++) sum += TestCellMap_getCell(chunkMap, coords[i])->gradient);
+    HTW_STOPWATCH(for (u32 i = 0; i < lookups; i++) sum += TestCellMap16_getCell(chunkMap, coords[i])->gradient);
+    free(coords);
+    htw_geo_destroyChunkMap(chunkMap);
+
+    const u32 passes = 16;
+    chunkMap = TestCellMap16_create(64, 64, 0);
+    u32 chunkCount = chunkMap->chunkCountX * chunkMap->chunkCountY;
+    printf("%u passes adding each cell's x to it over a %ux%u chunkmap; void * cells by index, typed forEachCell:\n", passes, chunkMap->mapWidth, chunkMap->mapHeight);
+    HTW_STOPWATCH(
+        for (u32 p = 0; p < passes; p++) {
+            for (u32 c = 0; c < chunkCount; c++) {
+                void *cellData = htw_geo_getChunkForWrite(chunkMap, c);
+                for (u32 i = 0; i < chunkMap->cellsPerChunk; i++) {
+                    TestCell *cell = (TestCell*)((u8*)cellData + htw_geo_getCellOffset(chunkMap, i));
+                    cell->gradient += htw_geo_chunkAndCellToGridCoordinates(chunkMap, c, i).x;
+                }
+            }
+        }
+    );
+    HTW_STOPWATCH(for (u32 p = 0; p < passes; p++) TestCellMap16_forEachCell(chunkMap, NULL, 0, addToGradient, NULL));
+    sum += TestCellMap16_getCell(chunkMap, (htw_geo_GridCoord){5, 5})->gradient;
+    printf("checksum %d\n", sum);
+    htw_geo_destroyChunkMap(chunkMap);
+}
+
+// Sum of a cell's value and every value within [radius] of it, walking the hex spiral out from the center
+s32 sumHexArea(const htw_ChunkMap *chunkMap, htw_geo_GridCoord center, u32 radius) {
+    s32 sum = 0;
+    htw_geo_CubeCoord offset = {0, 0, 0};
+    u32 area = htw_geo_getHexArea(radius + 1);
+    for (u32 i = 0; i < area; i++) {
+        htw_geo_GridCoord coord = htw_geo_addGridCoords(center, htw_geo_cubeToGridCoord(offset));
+        sum += ((StencilCell*)htw_geo_getCell(chunkMap, coord))->value;
+        htw_geo_getNextHexSpiralCoord(&offset);
+    }
+    return sum;
+}
+
+void bench_cellOrder() {
+    const u32 queries = 1 << 15;
+    const char *orderNames[] = {"rows", "Morton", "Hilbert"};
+    // larger than the cache, so each query mostly waits on memory
+    htw_ChunkMap *chunkMap = htw_geo_createChunkMap(64, 32, 32, sizeof(StencilCell));
+    htw_geo_GridCoord *centers = malloc(sizeof(htw_geo_GridCoord) * queries);
+    for (u32 i = 0; i < queries; i++) {
+        centers[i] = (htw_geo_GridCoord){xxh_hash2d(0, i, 0) % chunkMap->mapWidth, xxh_hash2d(1, i, 0) % chunkMap->mapHeight};
+    }
+    s32 sum = 0;
+    for (u32 radius = 4; radius <= 16; radius *= 2) {
+        printf("%u hex radius %u queries on a %ux%u chunkmap with %zu byte cells:\n", queries, radius, chunkMap->mapWidth, chunkMap->mapHeight, sizeof(StencilCell));
+        for (int o = HTW_GEO_CELL_ORDER_ROWS; o <= HTW_GEO_CELL_ORDER_HILBERT; o++) {
+            htw_geo_setCellOrder(chunkMap, o);
+            printf("%s: ", orderNames[o]);
+            HTW_STOPWATCH(for (u32 i = 0; i < queries; i++) sum += sumHexArea(chunkMap, centers[i], radius));
+        }
+    }
+    printf("checksum %d\n", sum);
+    free(centers);
+    htw_geo_destroyChunkMap(chunkMap);
+}
+
+void bench_spatialStorage() {
+    const u32 maxItems = 1 << 20, queries = 1 << 20;
+    const s32 worldSize = 1024;
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * maxItems);
+    htw_geo_GridCoord *queryCoords = malloc(sizeof(htw_geo_GridCoord) * queries);
+    htw_geo_SpatialMove *moves = malloc(sizeof(htw_geo_SpatialMove) * maxItems);
+    for (u32 i = 0; i < queries; i++) {
+        queryCoords[i] = (htw_geo_GridCoord){xxh_hash2d(2, i, 0) % worldSize, xxh_hash2d(3, i, 0) % worldSize};
+    }
+    size_t found = 0;
+    // the table is sized for maxItems, so load grows with the number of items in it
+    for (u32 itemCount = maxItems / 4; itemCount <= maxItems; itemCount *= 2) {
+        htw_SpatialStorage *ss = htw_geo_createSpatialStorage(maxItems);
+        printf("%u items on a %ix%i area, in a table for %u; insert all, %u queries, move all one step, move all with htw_geo_spatialMoveMany:\n", itemCount, worldSize, worldSize, maxItems, queries);
+        for (u32 i = 0; i < itemCount; i++) {
+            coords[i] = (htw_geo_GridCoord){xxh_hash2d(0, i, 0) % worldSize, xxh_hash2d(1, i, 0) % worldSize};
+        }
+        HTW_STOPWATCH(for (u32 i = 0; i < itemCount; i++) htw_geo_spatialInsert(ss, coords[i], i));
+        HTW_STOPWATCH(
+            for (u32 q = 0; q < queries; q++) {
+                for (size_t i = htw_geo_spatialFirstIndex(ss, queryCoords[q]); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) found += i;
+            }
+        );
+        for (u32 i = 0; i < itemCount; i++) {
+            moves[i] = (htw_geo_SpatialMove){i, POSITION_IN_DIRECTION(coords[i], i % HEX_DIRECTION_COUNT)};
+        }
+        HTW_STOPWATCH(
+            for (u32 i = 0; i < itemCount; i++) {
+                htw_geo_spatialMove(ss, coords[i], moves[i].newCoord, i);
+                coords[i] = moves[i].newCoord;
+            }
+        );
+        for (u32 i = 0; i < itemCount; i++) {
+            moves[i] = (htw_geo_SpatialMove){i, POSITION_IN_DIRECTION(coords[i], i % HEX_DIRECTION_COUNT)};
+            coords[i] = moves[i].newCoord;
+        }
+        HTW_STOPWATCH(htw_geo_spatialMoveMany(ss, moves, itemCount));
+        htw_geo_destroySpatialStorage(ss);
+    }
+    // every item at one coordinate; inserts used to walk to the end of the slot first
+    htw_SpatialStorage *ss = htw_geo_createSpatialStorage(maxItems);
+    printf("%u items inserted at the same coordinate:\n", maxItems);
+    HTW_STOPWATCH(for (u32 i = 0; i < maxItems; i++) htw_geo_spatialInsert(ss, (htw_geo_GridCoord){3, 3}, i));
+    htw_geo_destroySpatialStorage(ss);
+    printf("checksum %zu\n", found);
+    free(coords);
+    free(queryCoords);
+    free(moves);
+}
+
+/// Seconds since an arbitrary point, for timing single calls
+double wallSeconds() {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + (now.tv_nsec * 1e-9);
+}
+
+void bench_spatialStorageGrowth() {
+    const u32 itemCount = 1 << 22;
+    const s32 worldSize = 2048;
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * itemCount);
+    for (u32 i = 0; i < itemCount; i++) {
+        coords[i] = (htw_geo_GridCoord){xxh_hash2d(0, i, 0) % worldSize, xxh_hash2d(1, i, 0) % worldSize};
+    }
+    printf("%zu bytes per link, %zu per hash slot\n", sizeof(htw_Link), sizeof(u32));
+    const size_t initialSizes[] = {itemCount, 1024};
+    for (int s = 0; s < 2; s++) {
+        htw_SpatialStorage *ss = htw_geo_createSpatialStorage(initialSizes[s]);
+        printf("%u items inserted into a storage created for %zu; all, then the slowest single insert:\n", itemCount, initialSizes[s]);
+        double slowest = 0;
+        HTW_STOPWATCH(
+            for (u32 i = 0; i < itemCount; i++) {
+                double start = wallSeconds();
+                htw_geo_spatialInsert(ss, coords[i], i);
+                slowest = MAX(slowest, wallSeconds() - start);
+            }
+        );
+        printf("slowest insert: %.3f ms, final table %u slots\n", slowest * 1000.0, ss->table.slotMask + 1);
+        htw_geo_destroySpatialStorage(ss);
+    }
+    free(coords);
+}
+
+// Shared by the threads of bench_concurrentSpatialStorage
+typedef struct {
+    htw_ConcurrentSpatialStorage *cs;
+    const htw_ChunkMap *wrapMap;
+    htw_geo_GridCoord *coords; // only used by the writer
+    u32 itemCount;
+    u32 queriesPerReader;
+    int hasWriter;
+    _Atomic u32 readersLeft;
+    _Atomic size_t moves;
+    _Atomic size_t found;
+} ConcurrentSpatialBench;
+
+void runConcurrentSpatialBenchRole(void *context, u32 start, u32 end) {
+    ConcurrentSpatialBench *bench = context;
+    for (u32 role = start; role < end; role++) {
+        if (role == 0 && bench->hasWriter) {
+            // keeps moving items until every reader is done; the limit only matters if the readers can't get a thread
+            size_t moves = 0;
+            for (u32 i = 0; bench->readersLeft > 0 && moves < (size_t)bench->itemCount * 64; i = (i + 1) % bench->itemCount, moves++) {
+                htw_geo_GridCoord next = htw_geo_wrapGridCoordOnChunkMap(bench->wrapMap, POSITION_IN_DIRECTION(bench->coords[i], moves % HEX_DIRECTION_COUNT));
+                htw_geo_concurrentSpatialMove(bench->cs, bench->coords[i], next, i);
+                bench->coords[i] = next;
+            }
+            bench->moves += moves;
+            continue;
+        }
+        size_t *found = malloc(sizeof(size_t) * 1024);
+        size_t total = 0;
+        for (u32 q = 0; q < bench->queriesPerReader; q++) {
+            htw_geo_GridCoord center = {xxh_hash2d(2, q, role) % bench->wrapMap->mapWidth, xxh_hash2d(3, q, role) % bench->wrapMap->mapHeight};
+            total += htw_geo_concurrentSpatialQueryRadius(bench->cs, bench->wrapMap, center, 4, found, 1024);
+        }
+        free(found);
+        bench->found += total;
+        bench->readersLeft--;
+    }
+}
+
+void bench_concurrentSpatialStorage() {
+    const u32 itemCount = 1 << 18, queriesPerReader = 1 << 15;
+    htw_ChunkMap *wrapMap = htw_geo_createChunkMap(64, 16, 16, sizeof(u8));
+    htw_geo_GridCoord *coords = malloc(sizeof(htw_geo_GridCoord) * itemCount);
+    htw_SpatialStorage *ss = htw_geo_createSpatialStorage(itemCount);
+    htw_ConcurrentSpatialStorage *cs = htw_geo_createConcurrentSpatialStorage(itemCount);
+    for (u32 i = 0; i < itemCount; i++) {
+        coords[i] = (htw_geo_GridCoord){xxh_hash2d(0, i, 0) % wrapMap->mapWidth, xxh_hash2d(1, i, 0) % wrapMap->mapHeight};
+        htw_geo_spatialInsert(ss, coords[i], i);
+        htw_geo_concurrentSpatialInsert(cs, coords[i], i);
+    }
+    printf("%u items on a %ux%u map, %u radius 4 queries per reader (%u cores)\n", itemCount, wrapMap->mapWidth, wrapMap->mapHeight, queriesPerReader, htw_cpuCount());
+
+    // what the sequence checks cost a single reader
+    size_t *found = malloc(sizeof(size_t) * 1024);
+    size_t total = 0;
+    double start = wallSeconds();
+    for (u32 q = 0; q < queriesPerReader; q++) {
+        total += htw_geo_spatialQueryRadius(ss, wrapMap, (htw_geo_GridCoord){xxh_hash2d(2, q, 0) % wrapMap->mapWidth, xxh_hash2d(3, q, 0) % wrapMap->mapHeight}, 4, found, 1024);
+    }
+    printf("htw_SpatialStorage, 1 reader: %.0f queries/s\n", queriesPerReader / (wallSeconds() - start));
+
+    for (int hasWriter = 0; hasWriter <= 1; hasWriter++) {
+        for (u32 readers = 1; readers <= 8; readers *= 2) {
+            ConcurrentSpatialBench bench = {
+                .cs = cs,
+                .wrapMap = wrapMap,
+                .coords = coords,
+                .itemCount = itemCount,
+                .queriesPerReader = queriesPerReader,
+                .hasWriter = hasWriter,
+                .readersLeft = readers,
+            };
+            start = wallSeconds();
+            htw_parallelFor(readers + hasWriter, readers + hasWriter, runConcurrentSpatialBenchRole, &bench);
+            double seconds = wallSeconds() - start;
+            printf("htw_ConcurrentSpatialStorage, %u readers, %s: %.0f queries/s", readers, hasWriter ? "1 writer" : "no writer", (readers * queriesPerReader) / seconds);
+            if (hasWriter) printf(", %.0f moves/s", bench.moves / seconds);
+            printf("\n");
+            total += bench.found;
+        }
+    }
+    printf("checksum %zu\n", total);
+    free(found);
+    free(coords);
+    htw_geo_destroySpatialStorage(ss);
+    htw_geo_destroyConcurrentSpatialStorage(cs);
+    htw_geo_destroyChunkMap(wrapMap);
+}
+
+// Range query the way it was done before htw_geo_spatialQueryRadius: look up every cell of the area
+size_t spiralQuery(htw_SpatialStorage *ss, const htw_ChunkMap *wrapMap, htw_geo_GridCoord center, u32 radius, size_t *outIndices) {
+    size_t count = 0;
+    htw_geo_CubeCoord offset = {0, 0, 0};
+    u32 area = htw_geo_getHexArea(radius + 1);
+    for (u32 c = 0; c < area; c++) {
+        htw_geo_GridCoord coord = htw_geo_addGridCoordsWrapped(wrapMap, center, htw_geo_cubeToGridCoord(offset));
+        for (size_t i = htw_geo_spatialFirstIndex(ss, coord); i != HTW_GEO_SPATIAL_NO_ITEM; i = htw_geo_spatialNextIndex(ss, i)) {
+            outIndices[count++] = i;
+        }
+        htw_geo_getNextHexSpiralCoord(&offset);
+    }
+    return count;
+}
+
+void bench_spatialRangeQueries() {
+    const u32 maxItems = 1 << 20, queries = 1 << 14;
+    htw_ChunkMap *wrapMap = htw_geo_createChunkMap(64, 16, 16, sizeof(u8));
+    htw_geo_GridCoord *centers = malloc(sizeof(htw_geo_GridCoord) * queries);
+    for (u32 q = 0; q < queries; q++) {
+        centers[q] = (htw_geo_GridCoord){xxh_hash2d(2, q, 0) % wrapMap->mapWidth, xxh_hash2d(3, q, 0) % wrapMap->mapHeight};
+    }
+    size_t *found = malloc(sizeof(size_t) * maxItems);
+    size_t total = 0;
+    for (u32 itemCount = maxItems / 64; itemCount <= maxItems; itemCount *= 8) {
+        htw_SpatialStorage *ss = htw_geo_createSpatialStorage(maxItems);
+        for (u32 i = 0; i < itemCount; i++) {
+            htw_geo_spatialInsert(ss, (htw_geo_GridCoord){xxh_hash2d(0, i, 0) % wrapMap->mapWidth, xxh_hash2d(1, i, 0) % wrapMap->mapHeight}, i);
+        }
+        for (u32 radius = 4; radius <= 16; radius *= 4) {
+            printf("%u radius %u queries, %u items on a %ux%u map; every cell in a spiral, htw_geo_spatialQueryRadius:\n", queries, radius, itemCount, wrapMap->mapWidth, wrapMap->mapHeight);
+            HTW_STOPWATCH(for (u32 q = 0; q < queries; q++) total += spiralQuery(ss, wrapMap, centers[q], radius, found));
+            HTW_STOPWATCH(for (u32 q = 0; q < queries; q++) total += htw_geo_spatialQueryRadius(ss, wrapMap, centers[q], radius, found, maxItems));
+        }
+        htw_geo_destroySpatialStorage(ss);
+    }
+    printf("checksum %zu\n", total);
+    free(found);
+    free(centers);
+    htw_geo_destroyChunkMap(wrapMap);
+}
+
+void run_benchmarks() {
+    bench_randBulk();
+    bench_fillNoise();
+    bench_noiseBatch();
+    bench_parallelGenerators();
+    bench_chunkMapFills();
+    bench_chunkMapSlab();
+    bench_chunkMapFile();
+    bench_cellAccess();
+    bench_stencil();
+    bench_doubleBuffer();
+    bench_changeTracking();
+    bench_cellSchema();
+    bench_typedChunkMap();
+    bench_cellOrder();
+    bench_spatialStorage();
+    bench_spatialRangeQueries();
+    bench_spatialStorageGrowth();
+    bench_concurrentSpatialStorage();
+}
+
+int main(int argc, char* argv[]) {
+    int failures = 0;
+    failures += test_core();
+    failures += test_random();
+    failures += test_geomap();
+    printf("All tests completed. Failures: %i\n", failures);
+
+    // benchmarks are slow, only run when asked for
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        run_benchmarks();
+    }
 }